@@ -326,7 +326,10 @@ void ota_task(void *arg) {
                 tries_partial_count++;
                 result = ota_get_sign(user_repo, haamainfile, signature, port, is_ssl);
                 if (result == 0) {
-                    result = ota_get_file_part(user_repo, haamainfile, BOOT0SECTOR, port, is_ssl, &file_size);
+                    // Compressed image is tried once, falling back to full image if not published or failed
+                    if (tries_partial_count > 1 || ota_get_compressed_file(user_repo, haamainfile, BOOT0SECTOR, port, is_ssl, &file_size) != 0) {
+                        result = ota_get_file_part(user_repo, haamainfile, BOOT0SECTOR, port, is_ssl, &file_size);
+                    }
                     if (result == 0) {
                         if (ota_verify_sign(BOOT0SECTOR, file_size, signature) == 0) {
                             ota_finalize_file(BOOT0SECTOR);
@@ -28,6 +28,8 @@
 #else   // ESP_OPEN_RTOS
 
 #include <esp8266.h>
+#include <FreeRTOS.h>
+#include <task.h>
 #include <sysparam.h>
 #include <spiflash.h>
 #include <rboot-api.h>
@@ -49,7 +51,9 @@
 #include <wolfssl/wolfcrypt/sha512.h>
 #include <wolfssl/wolfcrypt/ecc.h>
 #include <wolfssl/wolfcrypt/asn_public.h>
+#include <heatshrink_decoder.h>
 #include <ota.h>
+#include "ota_flash.h"
 
 #include "header.h"
 
@@ -74,6 +78,7 @@
 
 static ecc_key public_key;
 static uint8_t file_first_byte[] = { 0xff };
+
 static WOLFSSL_CTX* ctx = NULL;
 static char last_host[HOST_LEN];
 static char last_location[LOCATION_LEN];
@@ -488,7 +493,8 @@ static int ota_get_final_location(char* repo, char* file, uint16_t port, const b
     return ret;
 }
 
-static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer, int bufsz, uint16_t port, const bool is_ssl, int* resume) {
+// When decompressed_size is given, file is a heatshrink compressed image, written decompressed to sector
+static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer, int bufsz, uint16_t port, const bool is_ssl, int* resume, int* decompressed_size) {
     INFO("*** DOWNLOADING");
     
     int ota_conn_result, ret = 0;
@@ -506,8 +512,8 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
     int length = collected + 1;
     int clength = 0;
     int last_collected;
-    int writespace = 0;
     int left, header;
+    int flash_error = 0;
 
     if (sector == 0 && buffer == NULL) {
         return -5;      // Needs to be either a sector or a signature/version file
@@ -515,6 +521,11 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
     
     unsigned int connection_tries = 0;
     while ((ota_conn_result = ota_get_final_location(repo, file, port, is_ssl)) <= 0 && connection_tries < 3) {
+        // Compressed image is optional, so its caller falls back to full image at once when server does not have it
+        if (decompressed_size && ota_conn_result == -2) {
+            break;
+        }
+        
         connection_tries++;
         ERROR("Tries %i", connection_tries);
         vTaskDelay(1000 / portTICK_PERIOD_MS);
@@ -562,12 +573,123 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
     
     if (ota_conn_result == 0) {
         char* location;
-        char* recv_buf = malloc(RECV_BUF_LEN);
+        char* recv_buf;
+        
+        // Compressed image: data is received into recv_buf, and decompressed into out_buf, which is written to flash
+        heatshrink_decoder* hsd = NULL;
+        char* out_buf = NULL;
+        int out_len = 0;
+        int out_offset = 0;
+        int hsd_in = 0;
+        
+        if (sector && decompressed_size) {
+            hsd = malloc(sizeof(heatshrink_decoder));
+            recv_buf = malloc(RECV_BUF_LEN);
+            if (hsd && recv_buf) {
+                heatshrink_decoder_reset(hsd);
+                out_buf = ota_flash_pipeline_start(sector, 0, file_first_byte);
+            }
+        } else if (sector) {
+            recv_buf = ota_flash_pipeline_start(sector, collected, file_first_byte);
+        } else {
+            recv_buf = malloc(RECV_BUF_LEN);
+        }
+        
+        if (!recv_buf || (decompressed_size && sector && !out_buf)) {
+            flash_error = -12;  // No memory even for a single buffer, nothing is downloaded
+        }
+        
+        int free_recv_buf() {
+            if (sector && decompressed_size) {
+                free(hsd);
+                free(recv_buf);
+                if (out_buf) {
+                    return ota_flash_pipeline_stop(out_buf);
+                }
+                return 0;
+            }
+            
+            if (sector) {
+                if (recv_buf) {
+                    return ota_flash_pipeline_stop(recv_buf);
+                }
+                return 0;
+            }
+            
+            free(recv_buf);
+            return 0;
+        }
+        
+        int out_buf_flush() {
+            if (out_offset + out_len > MAXFILESIZE) {
+                ERROR("TOO BIG %i/%i", out_offset + out_len, MAXFILESIZE);
+                return -10;
+            }
+            
+            const int result = ota_flash_pipeline_write(&out_buf, out_offset, out_len, MAXFILESIZE);
+            out_offset += out_len;
+            out_len = 0;
+            
+            return result;
+        }
+        
+        int ota_decompress_poll() {
+            HSD_poll_res poll_res;
+            do {
+                size_t polled = 0;
+                poll_res = heatshrink_decoder_poll(hsd, (uint8_t*) out_buf + out_len, RECV_BUF_LEN - out_len, &polled);
+                if (poll_res < 0) {
+                    return -11;     // Decompression error
+                }
+                
+                out_len += polled;
+                if (out_len == RECV_BUF_LEN) {
+                    const int result = out_buf_flush();
+                    if (result < 0) {
+                        return result;
+                    }
+                }
+            } while (poll_res == HSDR_POLL_MORE);
+            
+            return 0;
+        }
+        
+        // Decoder state can not go back, so data downloaded again after a failure is skipped
+        int ota_decompress(char* data, int len) {
+            const int skip = hsd_in - collected;
+            if (skip < 0) {
+                return -11;
+            }
+            
+            if (skip >= len) {
+                return 0;
+            }
+            
+            data += skip;
+            len -= skip;
+            
+            while (len > 0) {
+                size_t sunk = 0;
+                if (heatshrink_decoder_sink(hsd, (uint8_t*) data, len, &sunk) < 0) {
+                    return -11;
+                }
+                
+                data += sunk;
+                len -= sunk;
+                hsd_in += sunk;
+                
+                const int result = ota_decompress_poll();
+                if (result < 0) {
+                    return result;
+                }
+            }
+            
+            return 0;
+        }
         
         connection_tries = 0;
-        while (collected < length && connection_tries < MAX_DOWNLOAD_FILE_TRIES) {
+        while (flash_error == 0 && collected < length && connection_tries < MAX_DOWNLOAD_FILE_TRIES) {
             last_collected = collected;
-            writespace = 0;
             
             snprintf(recv_buf, RECV_BUF_LEN - 1, REQUESTHEAD"%s"REQUESTTAIL"%s"RANGE"%d-%d%s", last_location, last_host, collected, collected + 4095, CRLFCRLF);
             
@@ -601,7 +723,6 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
                             
                             void try_new_conn() {
                                 INFO("--\n%s\n-- %d", recv_buf, ret);
-                                free(recv_buf);
                                 collected = last_collected;
                                 connection_tries++;
                                 if (is_ssl) {
@@ -610,7 +731,6 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
                                 lwip_close(socket);
                                 vTaskDelay(1000 / portTICK_PERIOD_MS);
                                 ota_conn_result = new_connection();
-                                recv_buf = malloc(RECV_BUF_LEN);
                             }
                             
                             location = strstr_lc(recv_buf, "\ncontent-length:");
@@ -655,7 +775,7 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
                         
                         if (length > MAXFILESIZE) {
                             ERROR("TOO BIG %i/%i", length, MAXFILESIZE);
-                            free(recv_buf);
+                            free_recv_buf();
                             return -10;
                         }
                         
@@ -663,42 +783,20 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
                             recv_bytes += ret;
                             if (sector) { // Write to flash
                                 connection_tries = 0;
-                                if (writespace < ret) {
-#ifdef ESP_PLATFORM
-                                    if (esp_partition_erase_range(get_partition(sector), collected, SPI_FLASH_SECTOR_SIZE) != ESP_OK) {
-#else
-                                    INFO_NNL("0x%02X ", (sector + collected) / SPI_FLASH_SECTOR_SIZE);
-                                    if (!spiflash_erase_sector(sector + collected)) {
-#endif
-                                        free(recv_buf);
-                                        return -6; // Erase error
-                                    }
-                                    writespace += SPI_FLASH_SECTOR_SIZE;
+                                
+                                if (hsd) {
+                                    flash_error = ota_decompress(recv_buf, ret);
+                                } else {
+                                    flash_error = ota_flash_pipeline_write(&recv_buf, collected, ret, length);
                                 }
-                                if (collected) {
-#ifdef ESP_PLATFORM
-                                    if (esp_partition_write(get_partition(sector), collected, (uint8_t*) recv_buf, ret) != ESP_OK) {
-#else
-                                    if (!spiflash_write(sector + collected, (uint8_t*) recv_buf, ret)) {
-#endif
-                                        free(recv_buf);
-                                        return -7; // Write error
-                                    }
-                                } else { // At the very beginning, do not write the first byte yet but store it for later
-                                    file_first_byte[0] = (uint8_t) recv_buf[0];
-#ifdef ESP_PLATFORM
-                                    if (esp_partition_write(get_partition(sector), 1, (uint8_t*) recv_buf + 1, ret - 1) != ESP_OK) {
-#else
-                                    if (!spiflash_write(sector + 1, (uint8_t*) recv_buf + 1, ret - 1)) {
-#endif
-                                        free(recv_buf);
-                                        return -8; // Write error
-                                    }
+                                
+                                if (flash_error < 0) {
+                                    free_recv_buf();
+                                    return flash_error;
                                 }
-                                writespace -= ret;
                             } else { // Buffer
                                 if (ret > bufsz) {
-                                    free(recv_buf);
+                                    free_recv_buf();
                                     return -9; // Too big
                                 }
                                 memcpy(buffer, recv_buf, ret);
@@ -756,7 +854,23 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
             }
         }
         
-        free(recv_buf);
+        if (hsd && collected >= length && connection_tries < MAX_DOWNLOAD_FILE_TRIES) {
+            while (flash_error == 0 && heatshrink_decoder_finish(hsd) == HSDR_FINISH_MORE) {
+                flash_error = ota_decompress_poll();
+            }
+            
+            if (flash_error == 0 && out_len > 0) {
+                flash_error = out_buf_flush();
+            }
+            
+            *decompressed_size = out_offset;
+            INFO("Decompressed %i", out_offset);
+        }
+        
+        const int pipeline_error = free_recv_buf();
+        if (flash_error == 0) {
+            flash_error = pipeline_error;
+        }
     }
     
     switch (ota_conn_result) {
@@ -772,6 +886,10 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
         ;
     }
     
+    if (flash_error < 0) {
+        return flash_error;
+    }
+    
     if (resume) {
         *resume = collected;
     }
@@ -786,13 +904,25 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
 int ota_get_file_part(char* repo, char* file, int sector, uint16_t port, const bool is_ssl, int* collected) {
     INFO(">>> File part from %s", repo);
     
-    return ota_get_file_ex(repo, file, sector, NULL, 0, port, is_ssl, collected);
+    return ota_get_file_ex(repo, file, sector, NULL, 0, port, is_ssl, collected, NULL);
 }
 
 int ota_get_file(char* repo, char* file, int sector, uint16_t port, const bool is_ssl) {
     INFO(">>> File from %s", repo);
     
-    return ota_get_file_ex(repo, file, sector, NULL, 0, port, is_ssl, NULL);
+    return ota_get_file_ex(repo, file, sector, NULL, 0, port, is_ssl, NULL, NULL);
+}
+
+int ota_get_compressed_file(char* repo, char* file, int sector, uint16_t port, const bool is_ssl, int* file_size) {
+    INFO(">>> Compressed file from %s", repo);
+    
+    char* compressed_name = malloc(strlen(file) + sizeof(COMPRESSEDFILESUFIX));
+    strcpy(compressed_name, file);
+    strcat(compressed_name, COMPRESSEDFILESUFIX);
+    const int ret = ota_get_file_ex(repo, compressed_name, sector, NULL, 0, port, is_ssl, NULL, file_size);
+    free(compressed_name);
+    
+    return ret;
 }
 
 char* ota_get_version(char* repo, char* version_file, uint16_t port, const bool is_ssl) {
@@ -800,7 +930,7 @@ char* ota_get_version(char* repo, char* version_file, uint16_t port, const bool
 
     uint8_t* version = calloc(1, VERSIONSTRINGLEN + 1);
 
-    if (ota_get_file_ex(repo, version_file, 0, version, VERSIONSTRINGLEN, port, is_ssl, NULL) == 0) {
+    if (ota_get_file_ex(repo, version_file, 0, version, VERSIONSTRINGLEN, port, is_ssl, NULL, NULL) == 0) {
         INFO("**** %s v%s", version_file, (char*) version);
     } else {
         free(version);
@@ -818,17 +948,14 @@ int ota_get_sign(char* repo, char* file, uint8_t* signature, uint16_t port, bool
     strcpy(signame, file);
     strcat(signame, SIGNFILESUFIX);
     memset(signature, 0, SIGNSIZE);
-    ret = ota_get_file_ex(repo, signame, 0, signature, SIGNSIZE, port, is_ssl, NULL);
+    ret = ota_get_file_ex(repo, signame, 0, signature, SIGNSIZE, port, is_ssl, NULL, NULL);
     free(signame);
     
     return ret;
 }
 
-int ota_verify_sign(int start_sector, int filesize, uint8_t* signature) {
-    INFO(">>> Verify");
-    
+static void ota_flash_hash(int start_sector, int filesize, uint8_t* hash) {
     int bytes;
-    uint8_t hash[HASHSIZE];
     uint8_t* buffer = malloc(1024);
     Sha384 sha;
     
@@ -864,6 +991,23 @@ int ota_verify_sign(int start_sector, int filesize, uint8_t* signature) {
     free(buffer);
     
     wc_Sha384Final(&sha, hash);
+}
+
+int ota_verify_sign(int start_sector, int filesize, uint8_t* signature) {
+    INFO(">>> Verify");
+    
+    uint8_t hash[HASHSIZE];
+    
+    // Build with OTA_PARANOID_VERIFY to always hash the image read back from flash
+#ifdef OTA_PARANOID_VERIFY
+    ota_flash_stream_hash_final(start_sector, filesize, NULL);
+    ota_flash_hash(start_sector, filesize, hash);
+#else
+    if (!ota_flash_stream_hash_final(start_sector, filesize, hash)) {
+        INFO("Reading flash");
+        ota_flash_hash(start_sector, filesize, hash);
+    }
+#endif
     
     int verify = 0;
     wc_ecc_verify_hash(signature, SIGNSIZE, hash, HASHSIZE, &verify, &public_key);
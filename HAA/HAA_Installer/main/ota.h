@@ -31,6 +31,7 @@
 #define HAAVERSIONFILE          "haaversion"
 
 #define SIGNFILESUFIX           ".sec"
+#define COMPRESSEDFILESUFIX     ".hs"       // heatshrink -e -w 10 -l 5, signed as the uncompressed image
 #define VERSIONSTRINGLEN        (15)
 
 #define MAX_GLOBAL_TRIES        (2)
@@ -42,6 +43,7 @@
 #define REQUESTTAIL             " HTTP/1.1\r\nHost: "
 #define CRLFCRLF                "\r\n\r\n"
 #define RECV_BUF_LEN            (1390)
+#define OTA_ERASE_AHEAD_SECTORS (2)
 #define HEADER_BUFFER_LEN       (8000)
 #define HOST_LEN                (128)
 #define LOCATION_LEN            (1198)
@@ -56,6 +58,7 @@ void ota_init(char* repo, const bool is_ssl);
 char* ota_get_version(char* repo, char* version_file, uint16_t port, const bool is_ssl);
 int ota_get_file_part(char* repo, char* file, int sector, uint16_t port, const bool is_ssl, int *collected);   // Return number of bytes
 int ota_get_file(char* repo, char* file, int sector, uint16_t port, const bool is_ssl);   // Return number of bytes
+int ota_get_compressed_file(char* repo, char* file, int sector, uint16_t port, const bool is_ssl, int* file_size);
 void ota_finalize_file(int sector);
 int ota_get_sign(char* repo, char* file, uint8_t* signature, uint16_t port, const bool is_ssl);
 int ota_verify_sign(int address, int file_size, uint8_t* signature);
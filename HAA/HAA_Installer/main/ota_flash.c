@@ -0,0 +1,263 @@
+/*
+ * Home Accessory Architect OTA Installer
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_partition.h"
+
+#else   // ESP_OPEN_RTOS
+
+#include <esp8266.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <spiflash.h>
+
+#endif
+
+#include <wolfssl/wolfcrypt/sha512.h>
+#include <ota.h>
+#include "ota_flash.h"
+
+// Two receive buffers are used with writer task: one is filled by downloader while the other one is owned by writer.
+// Without writer task, task is NULL and jobs are done by downloader.
+typedef struct _ota_flash_job {
+    uint8_t* buffer;
+    int offset;
+    int len;
+    int file_size;
+} ota_flash_job_t;
+
+static struct {
+    TaskHandle_t task;
+    QueueHandle_t jobs;
+    QueueHandle_t free_buffers;
+    uint8_t* first_byte;
+    int sector;
+    int erased_end;
+    int written_end;
+    int file_size;
+    int error;
+} ota_flash;
+
+// stream_hash_bytes is the number of bytes hashed from stream_hash_sector, or -1 when streamed hash is not valid
+static Sha384 stream_hash;
+static int stream_hash_sector = 0;
+static int stream_hash_bytes = -1;
+
+// Any data received out of order, like a range downloaded again after a failure, invalidates streamed hash
+static void ota_flash_stream_hash(const int sector, const int offset, const uint8_t* data, const int len) {
+    if (offset == 0) {
+        wc_InitSha384(&stream_hash);
+        stream_hash_sector = sector;
+        stream_hash_bytes = 0;
+    } else if (stream_hash_sector != sector || stream_hash_bytes != offset) {
+        stream_hash_bytes = -1;
+    }
+    
+    if (stream_hash_bytes >= 0) {
+        wc_Sha384Update(&stream_hash, data, len);
+        stream_hash_bytes += len;
+    }
+}
+
+bool ota_flash_stream_hash_final(const int sector, const int file_size, uint8_t* hash) {
+    const bool is_valid = hash && stream_hash_sector == sector && stream_hash_bytes == file_size;
+    if (is_valid) {
+        wc_Sha384Final(&stream_hash, hash);
+    }
+    
+    stream_hash_bytes = -1;
+    
+    return is_valid;
+}
+
+static bool ota_flash_erase_next() {
+#ifdef ESP_PLATFORM
+    if (esp_partition_erase_range(get_partition(ota_flash.sector), ota_flash.erased_end, SPI_FLASH_SECTOR_SIZE) != ESP_OK) {
+#else
+    INFO_NNL("0x%02X ", (ota_flash.sector + ota_flash.erased_end) / SPI_FLASH_SECTOR_SIZE);
+    if (!spiflash_erase_sector(ota_flash.sector + ota_flash.erased_end)) {
+#endif
+        return false;
+    }
+    
+    ota_flash.erased_end += SPI_FLASH_SECTOR_SIZE;
+    
+    return true;
+}
+
+static void ota_flash_do_job(ota_flash_job_t* job) {
+    ota_flash.file_size = job->file_size;
+    
+    if (!ota_flash.error) {
+        // Data downloaded again after a failure: erase its sector again, as it was already written
+        if (job->offset != ota_flash.written_end) {
+            ota_flash.erased_end = job->offset - (job->offset % SPI_FLASH_SECTOR_SIZE);
+        }
+        
+        while (ota_flash.erased_end < job->offset + job->len) {
+            if (!ota_flash_erase_next()) {
+                ota_flash.error = -6;   // Erase error
+                break;
+            }
+        }
+    }
+    
+    if (!ota_flash.error) {
+        if (job->offset) {
+#ifdef ESP_PLATFORM
+            if (esp_partition_write(get_partition(ota_flash.sector), job->offset, job->buffer, job->len) != ESP_OK) {
+#else
+            if (!spiflash_write(ota_flash.sector + job->offset, job->buffer, job->len)) {
+#endif
+                ota_flash.error = -7;   // Write error
+            }
+        } else {    // At the very beginning, do not write the first byte yet but store it for later
+            ota_flash.first_byte[0] = job->buffer[0];
+#ifdef ESP_PLATFORM
+            if (esp_partition_write(get_partition(ota_flash.sector), 1, job->buffer + 1, job->len - 1) != ESP_OK) {
+#else
+            if (!spiflash_write(ota_flash.sector + 1, job->buffer + 1, job->len - 1)) {
+#endif
+                ota_flash.error = -8;   // Write error
+            }
+        }
+        
+        ota_flash.written_end = job->offset + job->len;
+    }
+}
+
+static void ota_flash_writer_task(void* args) {
+    ota_flash_job_t job;
+    
+    for (;;) {
+        // When idle, erase sectors ahead of write pointer
+        const bool erase_ahead = !ota_flash.error &&
+                                 ota_flash.erased_end < ota_flash.file_size &&
+                                 ota_flash.erased_end < ota_flash.written_end + (OTA_ERASE_AHEAD_SECTORS * SPI_FLASH_SECTOR_SIZE);
+        
+        if (xQueueReceive(ota_flash.jobs, &job, erase_ahead ? 0 : portMAX_DELAY) != pdTRUE) {
+            if (!ota_flash_erase_next()) {
+                ota_flash.error = -6;   // Erase error
+            }
+            continue;
+        }
+        
+        // Stop job: flash is not being used now, so writer acknowledges it and ends itself
+        if (!job.buffer) {
+            xQueueSend(ota_flash.free_buffers, &job.buffer, portMAX_DELAY);
+            vTaskDelete(NULL);
+        }
+        
+        ota_flash_do_job(&job);
+        
+        xQueueSend(ota_flash.free_buffers, &job.buffer, portMAX_DELAY);
+    }
+}
+
+char* ota_flash_pipeline_start(const int sector, const int collected, uint8_t* first_byte) {
+    ota_flash.first_byte = first_byte;
+    ota_flash.sector = sector;
+    ota_flash.erased_end = collected;
+    ota_flash.written_end = collected;
+    ota_flash.file_size = 0;
+    ota_flash.error = 0;
+    ota_flash.task = NULL;
+    
+    uint8_t* buffers[2];
+    buffers[0] = malloc(RECV_BUF_LEN);
+    buffers[1] = malloc(RECV_BUF_LEN);
+    
+    ota_flash.jobs = xQueueCreate(1, sizeof(ota_flash_job_t));
+    ota_flash.free_buffers = xQueueCreate(2, sizeof(uint8_t*));
+    
+    if (!buffers[0] || !buffers[1] || !ota_flash.jobs || !ota_flash.free_buffers ||
+        xTaskCreate(ota_flash_writer_task, "OTW", (TASK_SIZE_FACTOR * 512), NULL, (tskIDLE_PRIORITY + 1), &ota_flash.task) != pdPASS) {
+        ERROR("Flash pipeline, writing synchronously");
+        
+        ota_flash.task = NULL;
+        
+        if (ota_flash.jobs) {
+            vQueueDelete(ota_flash.jobs);
+        }
+        
+        if (ota_flash.free_buffers) {
+            vQueueDelete(ota_flash.free_buffers);
+        }
+        
+        // Same single buffer as without writer task
+        if (!buffers[0]) {
+            buffers[0] = buffers[1];
+            buffers[1] = NULL;
+        }
+        
+        free(buffers[1]);
+        
+        return (char*) buffers[0];
+    }
+    
+    xQueueSend(ota_flash.free_buffers, &buffers[1], 0);
+    
+    return (char*) buffers[0];
+}
+
+int ota_flash_pipeline_write(char** buffer, const int offset, const int len, const int file_size) {
+    ota_flash_job_t job = {
+        .buffer = (uint8_t*) *buffer,
+        .offset = offset,
+        .len = len,
+        .file_size = file_size,
+    };
+    
+    ota_flash_stream_hash(ota_flash.sector, offset, job.buffer, len);
+    
+    if (!ota_flash.task) {
+        ota_flash_do_job(&job);
+        return ota_flash.error;
+    }
+    
+    // Hands filled buffer to writer and gets other one, waiting while flash is behind
+    xQueueSend(ota_flash.jobs, &job, portMAX_DELAY);
+    xQueueReceive(ota_flash.free_buffers, buffer, portMAX_DELAY);
+    
+    return ota_flash.error;
+}
+
+int ota_flash_pipeline_stop(char* buffer) {
+    if (!ota_flash.task) {
+        free(buffer);
+        return ota_flash.error;
+    }
+    
+    uint8_t* other_buffer;
+    xQueueReceive(ota_flash.free_buffers, &other_buffer, portMAX_DELAY);
+    
+    // Writer can be erasing ahead, so it is asked to end instead of being deleted
+    ota_flash_job_t stop_job = {
+        .buffer = NULL,
+    };
+    uint8_t* ack;
+    xQueueSend(ota_flash.jobs, &stop_job, portMAX_DELAY);
+    xQueueReceive(ota_flash.free_buffers, &ack, portMAX_DELAY);
+    
+    vQueueDelete(ota_flash.jobs);
+    vQueueDelete(ota_flash.free_buffers);
+    ota_flash.task = NULL;
+    
+    free(other_buffer);
+    free(buffer);
+    
+    return ota_flash.error;
+}
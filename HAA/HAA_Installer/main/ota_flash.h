@@ -0,0 +1,35 @@
+/*
+ * Home Accessory Architect OTA Installer
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifndef __HAA_OTA_FLASH_H__
+#define __HAA_OTA_FLASH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+
+esp_partition_t* get_partition(const unsigned int sector);
+#endif
+
+// Flash writer of downloaded data. When there is memory, it runs in its own task, so next data is received from socket
+// while previous one is being written. Otherwise, data is written synchronously from a single buffer.
+// First byte of file is not written, but stored in first_byte.
+// Written data is also hashed with SHA-384, so verification does not need to read it back from flash.
+
+// Returns first buffer to fill, or NULL if there is no memory for a single buffer
+char* ota_flash_pipeline_start(const int sector, const int collected, uint8_t* first_byte);
+// Hashes and writes filled buffer, and returns a buffer to fill next in same pointer. Returns error code, or 0
+int ota_flash_pipeline_write(char** buffer, const int offset, const int len, const int file_size);
+// Waits until all pending data is written, and frees everything. Returns error code, or 0
+int ota_flash_pipeline_stop(char* buffer);
+
+// Gets SHA-384 of file written at sector, when all of it was written in order. Streamed hash is reset
+bool ota_flash_stream_hash_final(const int sector, const int file_size, uint8_t* hash);
+
+#endif  // __HAA_OTA_FLASH_H__
@@ -0,0 +1,96 @@
+/*
+ * DS18B20 sensors sharing a 1-Wire bus for Home Accessory Architect
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <FreeRTOS.h>
+#include <task.h>
+#endif
+
+#include "../../common/common_headers.h"
+
+#include "ds18b20_bus.h"
+
+// A reading is shared during half of the shortest poll period, so services polling together get same conversion
+void ds18b20_bus_add_sensor(ds18b20_bus_t* ds18b20_bus, const unsigned int sensor_index, const float poll_period) {
+    if (sensor_index > ds18b20_bus->sensor_count) {
+        ds18b20_bus->sensor_count = sensor_index;
+        ds18b20_bus->addrs = realloc(ds18b20_bus->addrs, sensor_index * sizeof(ds18b20_addr_t));
+        ds18b20_bus->temperatures = realloc(ds18b20_bus->temperatures, sensor_index * sizeof(float));
+    }
+    
+    const uint32_t max_age = MS_TO_TICKS(poll_period * 500);
+    if (max_age > 0 && (ds18b20_bus->max_age == 0 || max_age < ds18b20_bus->max_age)) {
+        ds18b20_bus->max_age = max_age;
+    }
+}
+
+float ds18b20_bus_temperature(ds18b20_bus_t* ds18b20_bus, const unsigned int sensor_index) {
+    if (ds18b20_bus->has_results && sensor_index > 0 && sensor_index <= ds18b20_bus->found_count) {
+        return ds18b20_bus->temperatures[sensor_index - 1];
+    }
+    
+    return NAN;
+}
+
+// One CONVERT_T to all sensors of the bus. ROM list is cached, and it is searched again only after a reading error
+// or after DS18B20_BUS_RESCAN_PERIOD_MS. Returns true if temperature_value is already available, or false if
+// it will be published when conversion finishes
+bool ds18b20_bus_request(ds18b20_bus_t* ds18b20_bus, const unsigned int sensor_index, float* temperature_value) {
+    if (ds18b20_bus->is_converting) {
+        return false;
+    }
+    
+    if (ds18b20_bus->has_results && (xTaskGetTickCount() - ds18b20_bus->read_tick) < ds18b20_bus->max_age) {
+        *temperature_value = ds18b20_bus_temperature(ds18b20_bus, sensor_index);
+        return true;
+    }
+    
+    ds18b20_bus->has_results = false;
+    
+    if (ds18b20_bus->needs_scan || (xTaskGetTickCount() - ds18b20_bus->scan_tick) >= MS_TO_TICKS(DS18B20_BUS_RESCAN_PERIOD_MS)) {
+        unsigned int found_count = ds18b20_scan_devices(ds18b20_bus->gpio, ds18b20_bus->gpio_output, ds18b20_bus->addrs, ds18b20_bus->sensor_count);
+        if (found_count > ds18b20_bus->sensor_count) {
+            found_count = ds18b20_bus->sensor_count;
+        }
+        
+        INFO("DS18B20 %i found %i", ds18b20_bus->gpio, found_count);
+        
+        ds18b20_bus->found_count = found_count;
+        ds18b20_bus->scan_tick = xTaskGetTickCount();
+        ds18b20_bus->needs_scan = false;
+    }
+    
+    if (ds18b20_bus->found_count == 0 || !ds18b20_measure(ds18b20_bus->gpio, ds18b20_bus->gpio_output, DS18B20_ANY, false)) {
+        ds18b20_bus->needs_scan = true;
+        *temperature_value = NAN;
+        return true;
+    }
+    
+    ds18b20_bus->is_converting = true;
+    ds18b20_bus->ready_tick = xTaskGetTickCount() + MS_TO_TICKS(DS18B20_CONVERSION_TIME_MS);
+    
+    return false;
+}
+
+// Reads all scratchpads in one pass, once conversion is finished
+void ds18b20_bus_read(ds18b20_bus_t* ds18b20_bus) {
+    onewire_depower(ds18b20_bus->gpio, ds18b20_bus->gpio_output);
+    
+    if (!ds18b20_read_temp_multi(ds18b20_bus->gpio, ds18b20_bus->gpio_output, ds18b20_bus->addrs, ds18b20_bus->found_count, ds18b20_bus->temperatures)) {
+        ds18b20_bus->needs_scan = true;
+    }
+    
+    ds18b20_bus->read_tick = xTaskGetTickCount();
+    ds18b20_bus->has_results = true;
+    ds18b20_bus->is_converting = false;
+}
@@ -0,0 +1,45 @@
+/*
+ * DS18B20 sensors sharing a 1-Wire bus for Home Accessory Architect
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifndef __HAA_DS18B20_BUS_H__
+#define __HAA_DS18B20_BUS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <ds18b20.h>
+
+#define DS18B20_BUS_RESCAN_PERIOD_MS        (10 * 60 * 1000)
+#define DS18B20_CONVERSION_TIME_MS          (750)
+
+typedef struct _ds18b20_bus {
+    int8_t gpio;
+    int8_t gpio_output;
+    uint8_t sensor_count;       // Highest sensor index used by any service
+    uint8_t found_count;
+    bool needs_scan: 1;
+    bool has_results: 1;
+    bool is_converting: 1;
+    
+    uint32_t scan_tick;
+    uint32_t read_tick;
+    uint32_t ready_tick;        // When running conversion finishes
+    uint32_t max_age;           // Ticks a bus reading is shared between services
+    
+    ds18b20_addr_t* addrs;
+    float* temperatures;
+    
+    struct _ds18b20_bus* next;
+} ds18b20_bus_t;
+
+// Sensor index starts at 1. Poll period is in seconds
+void ds18b20_bus_add_sensor(ds18b20_bus_t* ds18b20_bus, const unsigned int sensor_index, const float poll_period);
+float ds18b20_bus_temperature(ds18b20_bus_t* ds18b20_bus, const unsigned int sensor_index);
+bool ds18b20_bus_request(ds18b20_bus_t* ds18b20_bus, const unsigned int sensor_index, float* temperature_value);
+void ds18b20_bus_read(ds18b20_bus_t* ds18b20_bus);
+
+#endif  // __HAA_DS18B20_BUS_H__
@@ -49,6 +49,12 @@
 #define REBOOT_TASK_SIZE                    (TASK_SIZE_FACTOR * (384))
 #define IRRF_CAPTURE_TASK_SIZE              (TASK_SIZE_FACTOR * (512))
 
+#define TASK_DRAM(task_size)                ((task_size) * TASK_DRAM_FACTOR)   // DRAM used by task stack
+
+// Slab caches, objects in use at same time before using heap
+#define ACTION_TASK_SLAB_SIZE               (8)
+#define STR_CH_VALUE_SLAB_SIZE              (8)
+
 // Task Priorities
 #define INITIAL_SETUP_TASK_PRIORITY         (tskIDLE_PRIORITY + 1)
 #define NTP_TASK_PRIORITY                   (tskIDLE_PRIORITY + 1)
@@ -179,11 +185,8 @@
 #define IO_GPIO_ADC_ATTENUATION             io_value[2]
 
 #define TIMETABLE_ACTION_ARRAY              "tt"
-#define ALL_MONS                            13
-#define ALL_MDAYS                           0
-#define ALL_HOURS                           24
-#define ALL_MINS                            60
-#define ALL_WDAYS                           7
+#define TIMETABLE_MAX_SLEEP_S               (3600)
+#define TIMETABLE_CLOCK_JUMP_S              (60)
 
 #define VALVE_SYSTEM_TYPE                   "w"
 #define VALVE_SYSTEM_TYPE_DEFAULT           (0)
@@ -98,6 +98,9 @@
 #include <unistring.h>
 #include <adv_i2c.h>
 #include <adv_pwm.h>
+#include <adv_gpio.h>
+#include <rs_slab.h>
+#include <rs_trace.h>
 
 #include "setup.h"
 #include "ir_code.h"
@@ -117,6 +120,8 @@ main_config_t main_config = {
     
     .wifi_arp_count = 0,
     .wifi_arp_count_max = WIFI_WATCHDOG_ARP_PERIOD_DEFAULT,
+    .extended_gpio_burst = 0,
+    .extended_gpio_burst_task = NULL,
     .wifi_status = WIFI_STATUS_DISCONNECTED,
     .wifi_channel = 0,
     .wifi_ip = 0,
@@ -142,7 +147,6 @@ main_config_t main_config = {
     
     .clock_ready = false,
     .timetable_ready = false,
-    .timetable_last_minute = 60,
     
     //.used_gpio = 0,
     
@@ -164,6 +168,9 @@ main_config_t main_config = {
     
     .delayed_binary_outputs = NULL,
     .zc_delay = 0,
+    
+    .action_task_slab = RS_SLAB_INITIALIZER("ACT", action_task_t, ACTION_TASK_SLAB_SIZE),
+    .str_ch_value_slab = RS_SLAB_INITIALIZER("NWV", str_ch_value_t, STR_CH_VALUE_SLAB_SIZE),
 };
 
 #ifdef ESP_PLATFORM
@@ -174,6 +181,10 @@ static unsigned int IRAM private_abs(int number) {
     return (number < 0 ? -number : number);
 }
 
+RS_TRACE_PROBE(ACT)
+RS_TRACE_PROBE(RGB)
+RS_TRACE_PROBE(FRE)
+
 static void show_freeheap() {
     INFO("Free Heap %"HAA_LONGINT_F, xPortGetFreeHeapSize());
 }
@@ -341,60 +352,97 @@ void mcp_clean_inputs_only() {
     }
 }
 
+// With merge_burst, values set inside ended burst are written too
+static void mcp_write_all_outs(const bool merge_burst) {
+    mcp23017_t* mcp23017 = main_config.mcp23017s;
+    while (mcp23017) {
+        mcp_write_outs(mcp23017, merge_burst);
+        mcp23017 = mcp23017->next;
+    }
+}
+
+// Inside a burst, MCP23017 and Shift Register writes of task that began it are kept apart from shadow outputs,
+// and every changed expander is written once when its last nested burst ends.
+// Other tasks can not begin a burst meanwhile, and their writes are done at once, without values of burst
+void extended_gpio_burst_begin() {
+    const TaskHandle_t current_task = xTaskGetCurrentTaskHandle();
+    
+    HAA_ENTER_CRITICAL_TASK();
+    if (main_config.extended_gpio_burst == 0 || main_config.extended_gpio_burst_task == current_task) {
+        main_config.extended_gpio_burst_task = current_task;
+        main_config.extended_gpio_burst++;
+    }
+    HAA_EXIT_CRITICAL_TASK();
+}
+
+void extended_gpio_burst_end() {
+    const TaskHandle_t current_task = xTaskGetCurrentTaskHandle();
+    unsigned int extended_gpio_burst = 1;
+    
+    HAA_ENTER_CRITICAL_TASK();
+    if (main_config.extended_gpio_burst > 0 && main_config.extended_gpio_burst_task == current_task) {
+        main_config.extended_gpio_burst--;
+        extended_gpio_burst = main_config.extended_gpio_burst;
+        if (extended_gpio_burst == 0) {
+            main_config.extended_gpio_burst_task = NULL;
+        }
+    }
+    HAA_EXIT_CRITICAL_TASK();
+    
+    if (extended_gpio_burst == 0) {
+        mcp_write_all_outs(true);
+    }
+}
+
+static bool extended_gpio_is_in_burst() {
+    return main_config.extended_gpio_burst > 0 && main_config.extended_gpio_burst_task == xTaskGetCurrentTaskHandle();
+}
+
 void extended_gpio_write(const int extended_gpio, bool value) {
     if (extended_gpio < 100) {
         gpio_write(extended_gpio, value);
         
     } else {    // MCP23017 or Shift Register
-        const unsigned int gpio_type = extended_gpio / 100;
-        mcp23017_t* mcp23017 = mcp_find_by_index(gpio_type);
+        mcp23017_t* mcp23017 = mcp_find_by_index(extended_gpio / 100);
         
         if (mcp23017) {
-            unsigned int gpio = extended_gpio % 100;
-            unsigned int out_group = gpio >> 3;     // out_group = gpio / 8
-            const uint8_t bit = 1 << (gpio % 8);
-            
-            if (value) {
-                mcp23017->outs[out_group] |= bit;
-            } else if ((mcp23017->outs[out_group] & bit) != 0) {
-                mcp23017->outs[out_group] ^= bit;
-            }
+            const bool is_in_burst = extended_gpio_is_in_burst();
+            mcp_set_out(mcp23017, extended_gpio % 100, value, is_in_burst);
             
-            if (mcp23017->bus < 100) { // MCP23017
-                uint8_t mcp_reg = 0x14;
-                if (gpio > 7) {
-                    mcp_reg = 0x15;
-                }
-                
-                adv_i2c_slave_write(mcp23017->bus, mcp23017->addr, &mcp_reg, 1, &mcp23017->outs[out_group], 1);
-                
-            } else {    // Shift Register
-                const uint8_t clock_gpio = mcp23017->bus - 100;
-                
-                unsigned int bit_shift = 0;
-                out_group = 0;
-                for (unsigned int i = 0; i < mcp23017->len; i++) {
-                    gpio_write(mcp23017->addr, (bool) (mcp23017->outs[out_group] & (1 << bit_shift)));
-                    
-                    gpio_write(clock_gpio, true);
-                    gpio_write(clock_gpio, false);
-                    
-                    bit_shift++;
-                    if (bit_shift == 8) {
-                        bit_shift = 0;
-                        out_group++;
-                    }
-                }
-                
-                if (mcp23017->latch_gpio >= 0) {
-                    gpio_write(mcp23017->latch_gpio, true);
-                    gpio_write(mcp23017->latch_gpio, false);
-                }
+            if (!is_in_burst) {
+                mcp_write_outs(mcp23017, false);
             }
         }
     }
 }
 
+// Batched writes: GPIOs are switched at once and every MCP23017 port or Shift Register is written only one time
+void extended_gpio_batch_write(extended_gpio_batch_t* extended_gpio_batch, const int extended_gpio, bool value) {
+    if (extended_gpio < 100) {
+        adv_gpio_batch_write(&extended_gpio_batch->gpio_batch, extended_gpio, value);
+        
+    } else {    // MCP23017 or Shift Register
+        mcp23017_t* mcp23017 = mcp_find_by_index(extended_gpio / 100);
+        
+        if (mcp23017) {
+            mcp_set_out(mcp23017, extended_gpio % 100, value, extended_gpio_is_in_burst());
+            extended_gpio_batch->has_mcp23017 = true;
+        }
+    }
+}
+
+void extended_gpio_batch_commit(extended_gpio_batch_t* extended_gpio_batch) {
+    adv_gpio_batch_commit(&extended_gpio_batch->gpio_batch);
+    
+    if (extended_gpio_batch->has_mcp23017) {
+        extended_gpio_batch->has_mcp23017 = false;
+        
+        if (!extended_gpio_is_in_burst()) {
+            mcp_write_all_outs(false);
+        }
+    }
+}
+
 #ifdef ESP_PLATFORM
 static void IRAM_ATTR delayed_binary_output_interrupt(void* args) {
     const uint8_t trigger_gpio = (uint32_t) args;
@@ -594,6 +642,20 @@ void free_heap_watchdog() {
         
         free(space);
         INFO("* Max chunk = %"HAA_LONGINT_F, size + 4);
+        INFO("* Wheel timers = %i, max late %"HAA_LONGINT_F"ms", rs_wheel_timer_active_count(), rs_wheel_timer_max_late_ms());
+        
+        for (unsigned int i = 0; i < HOMEKIT_MEM_SUBSYSTEMS; i++) {
+            homekit_mem_stats_t mem_stats;
+            homekit_mem_get_stats(i, &mem_stats);
+            INFO("* DRAM %i: adm %"HAA_LONGINT_F" (%"HAA_LONGINT_F"B), ref %"HAA_LONGINT_F", fail %"HAA_LONGINT_F", shed %"HAA_LONGINT_F", evict %"HAA_LONGINT_F", min %"HAA_LONGINT_F,
+                 i, mem_stats.admitted, mem_stats.admitted_bytes, mem_stats.refused, mem_stats.failures, mem_stats.sheds, mem_stats.evictions, mem_stats.min_free_heap);
+        }
+        
+        rs_slab_stats_t slab_stats;
+        for (unsigned int i = 0; rs_slab_get_stats(i, &slab_stats); i++) {
+            INFO("* Slab %s: %i/%i (%iB), peak %i, alloc %"HAA_LONGINT_F", heap %"HAA_LONGINT_F,
+                 slab_stats.name, slab_stats.in_use, slab_stats.capacity, slab_stats.object_size, slab_stats.peak, slab_stats.allocs, slab_stats.heap_allocs);
+        }
 #ifndef ESP_PLATFORM
         INFO("* CPU Speed = %"HAA_LONGINT_F, sdk_system_get_cpu_freq());
 #endif
@@ -892,14 +954,9 @@ void wifi_resend_arp() {
     }
 }
 
-int ping_host(char* host) {
-    if (main_config.wifi_status != WIFI_STATUS_CONNECTED) {
-        return false;
-    }
-    
-    int ping_result = -1;
+bool resolve_host(char* host, ip_addr_t* target_ip) {
+    bool result = false;
     
-    ip_addr_t target_ip;
     const struct addrinfo hints = {
         .ai_family = AF_UNSPEC,
         .ai_socktype = SOCK_RAW
@@ -913,22 +970,35 @@ int ping_host(char* host) {
         struct sockaddr* sa = res->ai_addr;
         if (sa->sa_family == AF_INET) {
             struct in_addr ipv4_inaddr = ((struct sockaddr_in*) sa)->sin_addr;
-            memcpy(&target_ip, &ipv4_inaddr, sizeof(target_ip));
+            memcpy(target_ip, &ipv4_inaddr, sizeof(*target_ip));
         }
 #if LWIP_IPV6
         if (sa->sa_family == AF_INET6) {
             struct in_addr ipv6_inaddr = ((struct sockaddr_in6 *)sa)->sin6_addr;
-            memcpy(&target_ip, &ipv6_inaddr, sizeof(target_ip));
+            memcpy(target_ip, &ipv6_inaddr, sizeof(*target_ip));
         }
 #endif
-        ping_result = rs_ping(target_ip);
+        result = true;
     }
     
     if (res) {
         freeaddrinfo(res);
     }
     
-    return ping_result;
+    return result;
+}
+
+int ping_host(char* host) {
+    if (main_config.wifi_status != WIFI_STATUS_CONNECTED) {
+        return false;
+    }
+    
+    ip_addr_t target_ip;
+    if (resolve_host(host, &target_ip)) {
+        return rs_ping(target_ip);
+    }
+    
+    return -1;
 }
 
 void reboot_task() {
@@ -939,12 +1009,14 @@ void reboot_task() {
     
     random_task_short_delay();
     
+    adv_logger_flush();
+    
     sdk_system_restart();
 }
 
 void reboot_haa() {
     if (xTaskCreate(reboot_task, "REB", REBOOT_TASK_SIZE, NULL, REBOOT_TASK_PRIORITY, NULL) != pdPASS) {
-        homekit_remove_oldest_client();
+        homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(REBOOT_TASK_SIZE), HOMEKIT_MEM_PRIORITY_HIGH);
         ERROR("REB");
     }
 }
@@ -1026,7 +1098,7 @@ void ntp_timer_worker(TimerHandle_t xTimer) {
         if (main_config.wifi_status != WIFI_STATUS_CONNECTED) {
             raven_ntp_get_time();
         } else if (xTaskCreate(ntp_task, "NTP", NTP_TASK_SIZE, NULL, NTP_TASK_PRIORITY, NULL) != pdPASS) {
-            homekit_remove_oldest_client();
+            homekit_mem_recover(HOMEKIT_MEM_NETWORK, TASK_DRAM(NTP_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
             raven_ntp_get_time();
             ERROR("NTP");
         }
@@ -1223,9 +1295,10 @@ void wifi_watchdog() {
             }
         }
         
-        if (main_config.wifi_ping_max_errors != 255 && !homekit_is_pairing()) {
+        if (main_config.wifi_ping_max_errors != 255 && !homekit_is_pairing() &&
+            homekit_mem_admit(HOMEKIT_MEM_NETWORK, TASK_DRAM(WIFI_PING_GW_TASK_SIZE), HOMEKIT_MEM_PRIORITY_LOW)) {
             if (xTaskCreate(wifi_ping_gw_task, "GWP", WIFI_PING_GW_TASK_SIZE, NULL, WIFI_PING_GW_TASK_PRIORITY, NULL) != pdPASS) {
-                homekit_remove_oldest_client();
+                homekit_mem_recover(HOMEKIT_MEM_NETWORK, TASK_DRAM(WIFI_PING_GW_TASK_SIZE), HOMEKIT_MEM_PRIORITY_LOW);
                 ERROR("GWP");
             }
         }
@@ -1247,7 +1320,7 @@ void wifi_watchdog() {
         main_config.wifi_error_count = 0;
         
         if (xTaskCreate(wifi_reconnection_task, "RCN", WIFI_RECONNECTION_TASK_SIZE, NULL, WIFI_RECONNECTION_TASK_PRIORITY, NULL) != pdPASS) {
-            homekit_remove_oldest_client();
+            homekit_mem_recover(HOMEKIT_MEM_NETWORK, TASK_DRAM(WIFI_RECONNECTION_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
             ERROR("RCN");
         }
     }
@@ -1264,44 +1337,101 @@ ping_input_t* ping_input_find_by_host(char* host) {
 }
 
 void ping_task() {
-    if (xSemaphoreTake(main_config.network_busy_mutex, MS_TO_TICKS(500)) == pdTRUE) {
-        void ping_input_run_callback_fn(ping_input_callback_fn_t* callbacks) {
-            ping_input_callback_fn_t* ping_input_callback_fn = callbacks;
-            
-            while (ping_input_callback_fn) {
-                if (!ping_input_callback_fn->disable_without_wifi ||
-                    (ping_input_callback_fn->disable_without_wifi && wifi_config_get_ip() >= 0)) {
-                    ping_input_callback_fn->callback(88, ping_input_callback_fn->ch_group, ping_input_callback_fn->param);
-                }
-                ping_input_callback_fn = ping_input_callback_fn->next;
+    void ping_input_run_callback_fn(ping_input_callback_fn_t* callbacks) {
+        ping_input_callback_fn_t* ping_input_callback_fn = callbacks;
+        
+        while (ping_input_callback_fn) {
+            if (!ping_input_callback_fn->disable_without_wifi ||
+                (ping_input_callback_fn->disable_without_wifi && wifi_config_get_ip() >= 0)) {
+                ping_input_callback_fn->callback(88, ping_input_callback_fn->ch_group, ping_input_callback_fn->param);
+            }
+            ping_input_callback_fn = ping_input_callback_fn->next;
+        }
+    }
+    
+    unsigned int ping_input_count = 0;
+    ping_input_t* ping_input = main_config.ping_inputs;
+    while (ping_input) {
+        ping_input_count++;
+        ping_input = ping_input->next;
+    }
+    
+    // All hosts are pinged at same time. Result is -1 for unresolved hosts, like before
+    ip_addr_t ping_targets[ping_input_count];
+    int8_t ping_results[ping_input_count];
+    memset(ping_targets, 0, sizeof(ping_targets));
+    
+    // Network mutex is taken for each DNS lookup and each ping round only, so other network tasks are not delayed by whole sweep
+    unsigned int i = 0;
+    ping_input = main_config.ping_inputs;
+    while (ping_input) {
+        ping_results[i] = -1;
+        if (main_config.wifi_status != WIFI_STATUS_CONNECTED) {
+            ping_results[i] = 0;
+        } else if (xSemaphoreTake(main_config.network_busy_mutex, MS_TO_TICKS(500)) == pdTRUE) {
+            if (resolve_host(ping_input->host, &ping_targets[i])) {
+                IP_SET_TYPE_VAL(ping_targets[i], IPADDR_TYPE_V4);
+                ping_results[i] = 0;
             }
+            
+            xSemaphoreGive(main_config.network_busy_mutex);
         }
         
-        ping_input_t* ping_input = main_config.ping_inputs;
-        while (ping_input) {
-            int ping_result;
+        i++;
+        ping_input = ping_input->next;
+    }
+    
+    for (unsigned int round = 0; round <= PING_RETRIES && main_config.wifi_status == WIFI_STATUS_CONNECTED; round++) {
+        if (xSemaphoreTake(main_config.network_busy_mutex, MS_TO_TICKS(500)) == pdTRUE) {
+            const int result = rs_ping_multi(ping_targets, ping_results, ping_input_count, 0);
+            
+            xSemaphoreGive(main_config.network_busy_mutex);
             
-            unsigned int i = 0;
-            while (((ping_result = ping_host(ping_input->host)) != 1) && i < PING_RETRIES) {
-                i++;
-                vTaskDelay(MS_TO_TICKS(250));
+            if (result < 0) {
+                memset(ping_results, -1, sizeof(ping_results));
+                break;
             }
             
-            if ((ping_result == 1) && (!ping_input->last_response || ping_input->ignore_last_response)) {
-                ping_input->last_response = true;
-                INFO("Ping %s OK", ping_input->host);
-                ping_input_run_callback_fn(ping_input->callback_1);
-                
-            } else if ((ping_result == 0) && (ping_input->last_response || ping_input->ignore_last_response)) {
-                ping_input->last_response = false;
-                INFO("Ping %s FAIL", ping_input->host);
-                ping_input_run_callback_fn(ping_input->callback_0);
+        } else {
+            // Network is busy: unanswered hosts are left unchanged instead of failed
+            for (i = 0; i < ping_input_count; i++) {
+                if (ping_results[i] == 0) {
+                    ping_results[i] = -1;
+                }
             }
+        }
+        
+        unsigned int pending = false;
+        for (i = 0; i < ping_input_count; i++) {
+            if (ping_results[i] == 0) {
+                pending = true;
+                break;
+            }
+        }
+        
+        if (!pending) {
+            break;
+        }
+    }
+    
+    i = 0;
+    ping_input = main_config.ping_inputs;
+    while (ping_input) {
+        const int ping_result = ping_results[i];
+        i++;
+        
+        if ((ping_result == 1) && (!ping_input->last_response || ping_input->ignore_last_response)) {
+            ping_input->last_response = true;
+            INFO("Ping %s OK", ping_input->host);
+            ping_input_run_callback_fn(ping_input->callback_1);
             
-            ping_input = ping_input->next;
+        } else if ((ping_result == 0) && (ping_input->last_response || ping_input->ignore_last_response)) {
+            ping_input->last_response = false;
+            INFO("Ping %s FAIL", ping_input->host);
+            ping_input_run_callback_fn(ping_input->callback_0);
         }
         
-        xSemaphoreGive(main_config.network_busy_mutex);
+        ping_input = ping_input->next;
     }
     
     vTaskDelete(NULL);
@@ -1309,8 +1439,10 @@ void ping_task() {
 
 void ping_task_timer_worker() {
     if (!homekit_is_pairing()) {
-        if (xTaskCreate(ping_task, "PIN", PING_TASK_SIZE, NULL, PING_TASK_PRIORITY, NULL) != pdPASS) {
-            homekit_remove_oldest_client();
+        if (!homekit_mem_admit(HOMEKIT_MEM_NETWORK, TASK_DRAM(PING_TASK_SIZE), HOMEKIT_MEM_PRIORITY_LOW)) {
+            ERROR("PIN DRAM");
+        } else if (xTaskCreate(ping_task, "PIN", PING_TASK_SIZE, NULL, PING_TASK_PRIORITY, NULL) != pdPASS) {
+            homekit_mem_recover(HOMEKIT_MEM_NETWORK, TASK_DRAM(PING_TASK_SIZE), HOMEKIT_MEM_PRIORITY_LOW);
             ERROR("PIN");
         }
     } else {
@@ -1349,34 +1481,69 @@ void setup_mode_toggle() {
 }
 
 // -----
+static int32_t last_state_get_value(last_state_t* last_state) {
+    switch (last_state->ch_type) {
+        case CH_TYPE_INT8:
+        case CH_TYPE_INT:
+            return last_state->ch->value.int_value;
+            
+        case CH_TYPE_FLOAT:
+            return (int32_t) (last_state->ch->value.float_value * FLOAT_FACTOR_SAVE_AS_INT);
+            
+        default:    // case CH_TYPE_BOOL
+            return last_state->ch->value.bool_value;
+    }
+}
+
 void save_states() {
     INFO("Saving");
     last_state_t* last_state = main_config.last_states;
     
     while (last_state) {
-        char saved_state_id[8];
-        itoa(last_state->ch_state_id, saved_state_id, 10);
-        
-        switch (last_state->ch_type) {
-            case CH_TYPE_INT8:
-                sysparam_set_int8(saved_state_id, last_state->ch->value.int_value);
-                break;
-                
-            case CH_TYPE_INT:
-                sysparam_set_int32(saved_state_id, last_state->ch->value.int_value);
-                break;
-                
-            case CH_TYPE_FLOAT:
-                sysparam_set_int32(saved_state_id, (int32_t) (last_state->ch->value.float_value * FLOAT_FACTOR_SAVE_AS_INT));
-                break;
+        // Only changed states are written, so unchanged ones cost no flash access.
+        // Flag is cleared before reading value, so a change while saving is saved next time,
+        // and it is set again when value could not be written
+        if (last_state->dirty) {
+            last_state->dirty = false;
+            
+            char saved_state_id[8];
+            itoa(last_state->ch_state_id, saved_state_id, 10);
+            
+            sysparam_status_t status = SYSPARAM_OK;
+            
+            if (last_state->ch_type == CH_TYPE_STRING) {
+                status = sysparam_set_string(saved_state_id, last_state->ch->value.string_value);
                 
-            case CH_TYPE_STRING:
-                sysparam_set_string(saved_state_id, last_state->ch->value.string_value);
-                break;
+            } else {
+                const int32_t value = last_state_get_value(last_state);
                 
-            default:    // case CH_TYPE_BOOL
-                sysparam_set_bool(saved_state_id, last_state->ch->value.bool_value);
-                break;
+                if (!last_state->has_saved_value || value != last_state->saved_value) {
+                    switch (last_state->ch_type) {
+                        case CH_TYPE_INT8:
+                            status = sysparam_set_int8(saved_state_id, value);
+                            break;
+                            
+                        case CH_TYPE_INT:
+                        case CH_TYPE_FLOAT:
+                            status = sysparam_set_int32(saved_state_id, value);
+                            break;
+                            
+                        default:    // case CH_TYPE_BOOL
+                            status = sysparam_set_bool(saved_state_id, value);
+                            break;
+                    }
+                    
+                    if (status == SYSPARAM_OK) {
+                        last_state->saved_value = value;
+                        last_state->has_saved_value = true;
+                    }
+                }
+            }
+            
+            if (status != SYSPARAM_OK) {
+                ERROR("Saving %s", saved_state_id);
+                last_state->dirty = true;
+            }
         }
         
         last_state = last_state->next;
@@ -1385,6 +1552,15 @@ void save_states() {
 
 void save_states_callback(ch_group_t* ch_group) {
     if (ch_group->save_last_state) {
+        last_state_t* last_state = main_config.last_states;
+        while (last_state) {
+            if (last_state->ch_group == ch_group) {
+                last_state->dirty = true;
+            }
+            
+            last_state = last_state->next;
+        }
+        
         rs_esp_timer_start(SAVE_STATES_TIMER);
     }
 }
@@ -1499,6 +1675,22 @@ void hkc_custom_setup_advanced_setter(homekit_characteristic_t* ch, const homeki
             setup_set_boot_installer();
             reboot_haa();
             
+#ifdef RS_TRACE
+        } else if (selected_advanced_opt == 5) {    // Latency trace summary, also sent to log
+            homekit_value_destruct(&ch->value);
+            char* trace_summary = malloc(RS_TRACE_SUMMARY_SIZE);
+            if (trace_summary) {
+                const size_t trace_summary_len = rs_trace_summary(trace_summary, RS_TRACE_SUMMARY_SIZE);
+                INFO_NNL("%s", trace_summary);
+                ch->value.data_value = (uint8_t*) trace_summary;
+                ch->value.data_size = trace_summary_len;
+                ch->value.is_null = false;
+            }
+            
+        } else if (selected_advanced_opt == 6) {    // Latency trace reset
+            rs_trace_reset();
+            
+#endif
         } else if (selected_advanced_opt == 99) {
             homekit_value_destruct(&ch->value);
         }
@@ -1955,7 +2147,7 @@ void power_monitor_timer_worker(TimerHandle_t xTimer) {
                 ch_group->is_working = true;
                 if (xTaskCreate(power_monitor_task, "PM", POWER_MONITOR_TASK_SIZE, (void*) ch_group, POWER_MONITOR_TASK_PRIORITY, NULL) != pdPASS) {
                     ch_group->is_working = false;
-                    homekit_remove_oldest_client();
+                    homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(POWER_MONITOR_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
                     ERROR("PM");
                 }
             } else {
@@ -2242,7 +2434,7 @@ void set_zones_task(void* args) {
 void set_zones_timer_worker(TimerHandle_t xTimer) {
     if (!homekit_is_pairing()) {
         if (xTaskCreate(set_zones_task, "iAZ", SET_ZONES_TASK_SIZE, (void*) pvTimerGetTimerID(xTimer), SET_ZONES_TASK_PRIORITY, NULL) != pdPASS) {
-            homekit_remove_oldest_client();
+            homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(SET_ZONES_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
             ERROR("iAZ");
             rs_esp_timer_start(xTimer);
         }
@@ -2480,7 +2672,7 @@ void process_th_task(void* args) {
 
 void process_th_timer(TimerHandle_t xTimer) {
     if (xTaskCreate(process_th_task, "TH", PROCESS_TH_TASK_SIZE, (void*) pvTimerGetTimerID(xTimer), PROCESS_TH_TASK_PRIORITY, NULL) != pdPASS) {
-        homekit_remove_oldest_client();
+        homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(PROCESS_TH_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
         ERROR("TH");
         rs_esp_timer_start(xTimer);
     }
@@ -2826,7 +3018,7 @@ void process_hum_task(void* args) {
 
 void process_humidif_timer(TimerHandle_t xTimer) {
     if (xTaskCreate(process_hum_task, "HUM", PROCESS_HUMIDIF_TASK_SIZE, (void*) pvTimerGetTimerID(xTimer), PROCESS_HUMIDIF_TASK_PRIORITY, NULL) != pdPASS) {
-        homekit_remove_oldest_client();
+        homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(PROCESS_HUMIDIF_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
         ERROR("HUM");
         rs_esp_timer_start(xTimer);
     }
@@ -3027,7 +3219,136 @@ void hkc_fan_swing_mode(homekit_characteristic_t* ch, const homekit_value_t valu
 }
     
 // --- TEMPERATURE
-void temperature_task(void* args) {
+ds18b20_bus_t* ds18b20_bus_find(const int gpio) {
+    ds18b20_bus_t* ds18b20_bus = main_config.ds18b20_buses;
+    while (ds18b20_bus && ds18b20_bus->gpio != gpio) {
+        ds18b20_bus = ds18b20_bus->next;
+    }
+    
+    return ds18b20_bus;
+}
+
+void ds18b20_bus_subscribe(const int gpio, const int gpio_output, const unsigned int sensor_index, const float poll_period) {
+    ds18b20_bus_t* ds18b20_bus = ds18b20_bus_find(gpio);
+    
+    if (!ds18b20_bus) {
+        ds18b20_bus = calloc(1, sizeof(ds18b20_bus_t));
+        
+        ds18b20_bus->gpio = gpio;
+        ds18b20_bus->gpio_output = gpio_output;
+        ds18b20_bus->needs_scan = true;
+        
+        ds18b20_bus->next = main_config.ds18b20_buses;
+        main_config.ds18b20_buses = ds18b20_bus;
+    }
+    
+    ds18b20_bus_add_sensor(ds18b20_bus, sensor_index, poll_period);
+}
+
+void temperature_publish(ch_group_t* ch_group, const bool get_temp, float temperature_value, float humidity_value) {
+    if (get_temp) {
+        TH_SENSOR_ERROR_COUNT = 0;
+        
+        if (ch_group->chs > 0 && ch_group->ch[0]) {
+            temperature_value += TH_SENSOR_TEMP_OFFSET;
+            if (temperature_value < -100.f) {
+                temperature_value = -100.f;
+            } else if (temperature_value > 200.f) {
+                temperature_value = 200.f;
+            }
+            
+            temperature_value *= 10.f;
+            temperature_value = ((int) temperature_value) / 10.f;
+            
+            INFO("<%i> TEMP %.1fC", ch_group->serv_index, temperature_value);
+            
+            if (temperature_value != ch_group->ch[0]->value.float_value) {
+                ch_group->ch[0]->value.float_value = temperature_value;
+                homekit_characteristic_notify_safe(ch_group->ch[0]);
+                
+                if (ch_group->serv_type == SERV_TYPE_THERMOSTAT) {
+                    hkc_th_setter(ch_group->ch[0], ch_group->ch[0]->value);
+                }
+            }
+            
+            if (ch_group->main_enabled) {
+                do_wildcard_actions(ch_group, 0, temperature_value);
+            }
+        }
+        
+        if (ch_group->chs > 1 && ch_group->ch[1]) {
+            humidity_value += TH_SENSOR_HUM_OFFSET;
+            if (humidity_value < 0.f) {
+                humidity_value = 0.f;
+            } else if (humidity_value > 100.f) {
+                humidity_value = 100.f;
+            }
+
+            const unsigned int humidity_value_int = humidity_value;
+            
+            INFO("<%i> HUM %i", ch_group->serv_index, humidity_value_int);
+            
+            if (humidity_value_int != (uint8_t) ch_group->ch[1]->value.float_value) {
+                ch_group->ch[1]->value.float_value = humidity_value_int;
+                homekit_characteristic_notify_safe(ch_group->ch[1]);
+                
+                if (ch_group->serv_type == SERV_TYPE_HUMIDIFIER) {
+                    hkc_humidif_setter(ch_group->ch[1], ch_group->ch[1]->value);
+                }
+            }
+            
+            if (ch_group->main_enabled) {
+                do_wildcard_actions(ch_group, 1, humidity_value_int);
+            }
+        }
+        
+    } else {
+        led_blink(5);
+        ERROR("<%i> Read", ch_group->serv_index);
+        
+        TH_SENSOR_ERROR_COUNT++;
+        
+        if (TH_SENSOR_ERROR_COUNT > TH_SENSOR_MAX_ALLOWED_ERRORS) {
+            TH_SENSOR_ERROR_COUNT = 0;
+            
+            if (ch_group->chs > 0 && ch_group->ch[0]) {
+                ch_group->ch[0]->value.float_value = TH_SENSOR_TEMP_VALUE_WHEN_ERROR;
+                homekit_characteristic_notify_safe(ch_group->ch[0]);
+            }
+            
+            if (ch_group->chs > 1 && ch_group->ch[1]) {
+                ch_group->ch[1]->value.float_value = 0;
+                homekit_characteristic_notify_safe(ch_group->ch[1]);
+            }
+            
+            if (ch_group->main_enabled) {
+                do_actions(ch_group, THERMOSTAT_ACTION_SENSOR_ERROR);
+            }
+        }
+    }
+}
+
+// Publishes bus reading to every service waiting for this bus
+void ds18b20_bus_finish(ds18b20_bus_t* ds18b20_bus) {
+    ds18b20_bus_read(ds18b20_bus);
+    
+    ch_group_t* ch_group = main_config.ch_groups;
+    while (ch_group) {
+        if (ch_group->is_working &&
+            ch_group->serv_type >= SERV_TYPE_THERMOSTAT &&
+            ch_group->serv_type <= SERV_TYPE_HUMIDIFIER_WITH_TEMP &&
+            TH_SENSOR_TYPE == 3 &&
+            TH_SENSOR_GPIO == ds18b20_bus->gpio) {
+            const float temperature_value = ds18b20_bus_temperature(ds18b20_bus, TH_SENSOR_INDEX);
+            temperature_publish(ch_group, (temperature_value < 130.f && temperature_value > -60.f), temperature_value, 0);
+            ch_group->is_working = false;
+        }
+        
+        ch_group = ch_group->next;
+    }
+}
+
+bool temperature_read(ch_group_t* ch_group, float* temperature_result, float* humidity_result) {
     float taylor_log(float x) {
         // https://stackoverflow.com/questions/46879166/finding-the-natural-logarithm-of-a-number-using-taylor-series-in-c
         if (x <= 0.0) {
@@ -3050,218 +3371,174 @@ void temperature_task(void* args) {
         return totalValue;
     }
     
-    ch_group_t* ch_group = args;
+    const unsigned int sensor_type = TH_SENSOR_TYPE;
+    const int sensor_gpio = TH_SENSOR_GPIO;
+    const int sensor_gpio_output = TH_SENSOR_GPIO_OUTPUT;
     
     float temperature_value = 0.0;
     float humidity_value = 0.0;
     unsigned int get_temp = false;
-    unsigned int iairzoning = 0;
     
-    if (ch_group->serv_type == SERV_TYPE_IAIRZONING) {
-        iairzoning = ch_group->serv_index;
-        INFO("<%i> iAZ sensors", iairzoning);
-        ch_group = main_config.ch_groups;
-    }
-    
-    while (ch_group) {
-        if (ch_group->serv_type >= SERV_TYPE_THERMOSTAT &&
-            ch_group->serv_type <= SERV_TYPE_HUMIDIFIER_WITH_TEMP) {
-            const unsigned int sensor_type = TH_SENSOR_TYPE;
-            const int sensor_gpio = TH_SENSOR_GPIO;
-            const int sensor_gpio_output = TH_SENSOR_GPIO_OUTPUT;
-            if (sensor_type > 0) {
-                get_temp = false;
-                
-                if (iairzoning == 0 || (iairzoning == (uint8_t) TH_IAIRZONING_CONTROLLER)) {
-                    INFO("<%i> TH sensor", ch_group->serv_index);
-                    
-                    if (sensor_type != 3 && sensor_type < 5) {
-                        dht_sensor_type_t current_sensor_type = DHT_TYPE_DHT22; // sensor_type == 2
-                        
-                        if (sensor_type == 1) {
-                            current_sensor_type = DHT_TYPE_DHT11;
-                        } else if (sensor_type == 4) {
-                            current_sensor_type = DHT_TYPE_SI7021;
-                        }
-                        
-                        get_temp = dht_read_float_data(current_sensor_type, sensor_gpio, sensor_gpio_output, &humidity_value, &temperature_value);
-                        
-                    } else if (sensor_type == 3) {
-                        const unsigned int sensor_index = TH_SENSOR_INDEX;
-                        ds18b20_addr_t ds18b20_addrs[sensor_index];
-                        
-                        const unsigned int scaned_devices = ds18b20_scan_devices(sensor_gpio, sensor_gpio_output, ds18b20_addrs, sensor_index);
-                        
-                        if (scaned_devices >= sensor_index) {
-                            ds18b20_addr_t ds18b20_addr;
-                            ds18b20_addr = ds18b20_addrs[sensor_index - 1];
-                            
-                            ds18b20_measure_and_read_multi(sensor_gpio, sensor_gpio_output, &ds18b20_addr, 1, &temperature_value);
-                            
-                            if (temperature_value < 130.f && temperature_value > -60.f) {
-                                get_temp = true;
-                            }
-                        }
-                        
+    // DS18B20 (sensor_type == 3) is read by its bus
+    if (sensor_type != 3 && sensor_type < 5) {
+        dht_sensor_type_t current_sensor_type = DHT_TYPE_DHT22; // sensor_type == 2
+        
+        if (sensor_type == 1) {
+            current_sensor_type = DHT_TYPE_DHT11;
+        } else if (sensor_type == 4) {
+            current_sensor_type = DHT_TYPE_SI7021;
+        }
+        
+        get_temp = dht_read_float_data(current_sensor_type, sensor_gpio, sensor_gpio_output, &humidity_value, &temperature_value);
+        
 #ifdef ESP_HAS_INTERNAL_TEMP_SENSOR
-                    } else if (sensor_type == 100) {
-                        if (temperature_sensor_get_celsius(main_config.temperature_sensor_handle, &temperature_value) == ESP_OK) {
-                            get_temp = true;
-                        }
+    } else if (sensor_type == 100) {
+        if (temperature_sensor_get_celsius(main_config.temperature_sensor_handle, &temperature_value) == ESP_OK) {
+            get_temp = true;
+        }
 #endif
-                        
-                    } else {
+        
+    } else {
 #ifdef ESP_PLATFORM
-                        int adc_int = haa_adc_oneshot_read_by_gpio(sensor_gpio);
-                        if (adc_int >= 0) {
-                            const float adc = ((float) adc_int) / HAA_ADC_FACTOR;
+        int adc_int = haa_adc_oneshot_read_by_gpio(sensor_gpio);
+        if (adc_int >= 0) {
+            const float adc = ((float) adc_int) / HAA_ADC_FACTOR;
 #else
-                            const float adc = sdk_system_adc_read();
+            const float adc = sdk_system_adc_read();
 #endif
-                            if (sensor_type == 5) {
-                                // https://github.com/arendst/Tasmota/blob/7177c7d8e003bb420d8cae39f544c2b8a9af09fe/tasmota/xsns_02_analog.ino#L201
-                                temperature_value = KELVIN_TO_CELSIUS(3350 / (3350 / 298.15f + taylor_log(((32000 * adc) / ((HAA_ADC_RESOLUTION_ESP8266 * 3.3f) - adc)) / 10000))) - 15;
-                                
-                            } else if (sensor_type == 6) {
-                                temperature_value = KELVIN_TO_CELSIUS(3350 / (3350 / 298.15f - taylor_log(((32000 * adc) / ((HAA_ADC_RESOLUTION_ESP8266 * 3.3f) - adc)) / 10000))) + 15;
-                                
-                            } else if (sensor_type == 7) {
-                                temperature_value = HAA_ADC_MAX_VALUE - adc;
-                                
-                            } else if (sensor_type == 8) {
-                                temperature_value = adc;
-                                
-                            } else if (sensor_type == 9){
-                                humidity_value = HAA_ADC_MAX_VALUE - adc;
-                                
-                            } else {    // th_sensor_type == 10
-                                humidity_value = adc;
-                            }
-                            
-                            if (sensor_type >= 9) {
-                                humidity_value *= 0.09775171066f;  // (100 / 1023)
-                            }
-                            
-                            if (TH_SENSOR_HUM_OFFSET != 0.f && sensor_type < 9) {
-                                temperature_value *= TH_SENSOR_HUM_OFFSET;
-                                
-                            } else if (TH_SENSOR_TEMP_OFFSET != 0.f && sensor_type >= 9) {
-                                humidity_value *= TH_SENSOR_TEMP_OFFSET;
-                            }
-                            
-                            get_temp = true;
+            if (sensor_type == 5) {
+                // https://github.com/arendst/Tasmota/blob/7177c7d8e003bb420d8cae39f544c2b8a9af09fe/tasmota/xsns_02_analog.ino#L201
+                temperature_value = KELVIN_TO_CELSIUS(3350 / (3350 / 298.15f + taylor_log(((32000 * adc) / ((HAA_ADC_RESOLUTION_ESP8266 * 3.3f) - adc)) / 10000))) - 15;
+                
+            } else if (sensor_type == 6) {
+                temperature_value = KELVIN_TO_CELSIUS(3350 / (3350 / 298.15f - taylor_log(((32000 * adc) / ((HAA_ADC_RESOLUTION_ESP8266 * 3.3f) - adc)) / 10000))) + 15;
+                
+            } else if (sensor_type == 7) {
+                temperature_value = HAA_ADC_MAX_VALUE - adc;
+                
+            } else if (sensor_type == 8) {
+                temperature_value = adc;
+                
+            } else if (sensor_type == 9){
+                humidity_value = HAA_ADC_MAX_VALUE - adc;
+                
+            } else {    // th_sensor_type == 10
+                humidity_value = adc;
+            }
+            
+            if (sensor_type >= 9) {
+                humidity_value *= 0.09775171066f;  // (100 / 1023)
+            }
+            
+            if (TH_SENSOR_HUM_OFFSET != 0.f && sensor_type < 9) {
+                temperature_value *= TH_SENSOR_HUM_OFFSET;
+                
+            } else if (TH_SENSOR_TEMP_OFFSET != 0.f && sensor_type >= 9) {
+                humidity_value *= TH_SENSOR_TEMP_OFFSET;
+            }
+            
+            get_temp = true;
 #ifdef ESP_PLATFORM
-                        }
+        }
 #endif
-                    }
-                    
-                    /*
-                     * Only for tests. Keep comment for releases
-                     */
-                    //get_temp = true; temperature_value = (((float) (hwrand() % 51)) / 10.f) + 20; humidity_value = 68;
-                    
-                    if (get_temp) {
-                        TH_SENSOR_ERROR_COUNT = 0;
-                        
-                        if (ch_group->chs > 0 && ch_group->ch[0]) {
-                            temperature_value += TH_SENSOR_TEMP_OFFSET;
-                            if (temperature_value < -100.f) {
-                                temperature_value = -100.f;
-                            } else if (temperature_value > 200.f) {
-                                temperature_value = 200.f;
-                            }
-                            
-                            temperature_value *= 10.f;
-                            temperature_value = ((int) temperature_value) / 10.f;
-                            
-                            INFO("<%i> TEMP %.1fC", ch_group->serv_index, temperature_value);
-                            
-                            if (temperature_value != ch_group->ch[0]->value.float_value) {
-                                ch_group->ch[0]->value.float_value = temperature_value;
-                                homekit_characteristic_notify_safe(ch_group->ch[0]);
-                                
-                                if (ch_group->serv_type == SERV_TYPE_THERMOSTAT) {
-                                    hkc_th_setter(ch_group->ch[0], ch_group->ch[0]->value);
-                                }
-                            }
-                            
-                            if (ch_group->main_enabled) {
-                                do_wildcard_actions(ch_group, 0, temperature_value);
-                            }
-                        }
-                        
-                        if (ch_group->chs > 1 && ch_group->ch[1]) {
-                            humidity_value += TH_SENSOR_HUM_OFFSET;
-                            if (humidity_value < 0.f) {
-                                humidity_value = 0.f;
-                            } else if (humidity_value > 100.f) {
-                                humidity_value = 100.f;
-                            }
+    }
+    
+    /*
+     * Only for tests. Keep comment for releases
+     */
+    //get_temp = true; temperature_value = (((float) (hwrand() % 51)) / 10.f) + 20; humidity_value = 68;
+    
+    *temperature_result = temperature_value;
+    *humidity_result = humidity_value;
+    
+    return get_temp;
+}
 
-                            const unsigned int humidity_value_int = humidity_value;
-                            
-                            INFO("<%i> HUM %i", ch_group->serv_index, humidity_value_int);
-                            
-                            if (humidity_value_int != (uint8_t) ch_group->ch[1]->value.float_value) {
-                                ch_group->ch[1]->value.float_value = humidity_value_int;
-                                homekit_characteristic_notify_safe(ch_group->ch[1]);
-                                
-                                if (ch_group->serv_type == SERV_TYPE_HUMIDIFIER) {
-                                    hkc_humidif_setter(ch_group->ch[1], ch_group->ch[1]->value);
-                                }
-                            }
-                            
-                            if (ch_group->main_enabled) {
-                                do_wildcard_actions(ch_group, 1, humidity_value_int);
-                            }
-                        }
-                        
-                    } else {
-                        led_blink(5);
-                        ERROR("<%i> Read", ch_group->serv_index);
-                        
-                        TH_SENSOR_ERROR_COUNT++;
-                        
-                        if (TH_SENSOR_ERROR_COUNT > TH_SENSOR_MAX_ALLOWED_ERRORS) {
-                            TH_SENSOR_ERROR_COUNT = 0;
-                            
-                            if (ch_group->chs > 0 && ch_group->ch[0]) {
-                                ch_group->ch[0]->value.float_value = TH_SENSOR_TEMP_VALUE_WHEN_ERROR;
-                                homekit_characteristic_notify_safe(ch_group->ch[0]);
-                            }
-                            
-                            if (ch_group->chs > 1 && ch_group->ch[1]) {
-                                ch_group->ch[1]->value.float_value = 0;
-                                homekit_characteristic_notify_safe(ch_group->ch[1]);
-                            }
-                            
-                            if (ch_group->main_enabled) {
-                                do_actions(ch_group, THERMOSTAT_ACTION_SENSOR_ERROR);
-                            }
+// DS18B20 services wait for their bus conversion to finish, while other sensors are read meanwhile
+void temperature_acquire(ch_group_t* ch_group) {
+    INFO("<%i> TH sensor", ch_group->serv_index);
+    
+    float temperature_value = 0.0;
+    float humidity_value = 0.0;
+    bool get_temp = false;
+    
+    if (TH_SENSOR_TYPE == 3) {
+        ds18b20_bus_t* ds18b20_bus = ds18b20_bus_find(TH_SENSOR_GPIO);
+        if (ds18b20_bus) {
+            if (!ds18b20_bus_request(ds18b20_bus, TH_SENSOR_INDEX, &temperature_value)) {
+                return;
+            }
+            
+            get_temp = (temperature_value < 130.f && temperature_value > -60.f);
+        }
+    } else {
+        get_temp = temperature_read(ch_group, &temperature_value, &humidity_value);
+    }
+    
+    temperature_publish(ch_group, get_temp, temperature_value, humidity_value);
+    ch_group->is_working = false;
+}
+
+// Single task for all TH sensors, fed by their poll timers
+void temperature_task(void* args) {
+    for (;;) {
+        // Wait for next poll, or until first running DS18B20 conversion finishes
+        TickType_t wait_ticks = portMAX_DELAY;
+        ds18b20_bus_t* ds18b20_bus = main_config.ds18b20_buses;
+        while (ds18b20_bus) {
+            if (ds18b20_bus->is_converting) {
+                const int32_t remaining_ticks = ds18b20_bus->ready_tick - xTaskGetTickCount();
+                if (remaining_ticks <= 0) {
+                    wait_ticks = 0;
+                } else if ((TickType_t) remaining_ticks < wait_ticks) {
+                    wait_ticks = remaining_ticks;
+                }
+            }
+            
+            ds18b20_bus = ds18b20_bus->next;
+        }
+        
+        ch_group_t* ch_group;
+        if (xQueueReceive(main_config.temperature_queue, &ch_group, wait_ticks) == pdTRUE) {
+            if (ch_group->serv_type == SERV_TYPE_IAIRZONING) {
+                const unsigned int iairzoning = ch_group->serv_index;
+                INFO("<%i> iAZ sensors", iairzoning);
+                
+                ch_group_t* iairzoning_group = ch_group;
+                ch_group = main_config.ch_groups;
+                while (ch_group) {
+                    if (ch_group->serv_type >= SERV_TYPE_THERMOSTAT &&
+                        ch_group->serv_type <= SERV_TYPE_HUMIDIFIER_WITH_TEMP &&
+                        TH_SENSOR_TYPE > 0 &&
+                        iairzoning == (uint8_t) TH_IAIRZONING_CONTROLLER &&
+                        !ch_group->is_working) {
+                        ch_group->is_working = true;
+                        temperature_acquire(ch_group);
+                        
+                        if (ch_group->serv_type == SERV_TYPE_THERMOSTAT) {
+                            vTaskDelay(MS_TO_TICKS(100));
                         }
                     }
+                    
+                    ch_group = ch_group->next;
                 }
+                
+                iairzoning_group->is_working = false;
+            
+            } else if (ch_group->is_working) {  // It could be already published by a DS18B20 bus shared with other services
+                temperature_acquire(ch_group);
             }
         }
         
-        if (iairzoning > 0) {
-            if (ch_group->serv_type == SERV_TYPE_THERMOSTAT && iairzoning == (uint8_t) TH_IAIRZONING_CONTROLLER) {
-                vTaskDelay(MS_TO_TICKS(100));
+        ds18b20_bus = main_config.ds18b20_buses;
+        while (ds18b20_bus) {
+            if (ds18b20_bus->is_converting && (int32_t) (xTaskGetTickCount() - ds18b20_bus->ready_tick) >= 0) {
+                ds18b20_bus_finish(ds18b20_bus);
             }
-
-            ch_group = ch_group->next;
             
-        } else {
-            ch_group->is_working = false;
-            ch_group = NULL;
+            ds18b20_bus = ds18b20_bus->next;
         }
     }
-    
-    if (iairzoning > 0) {
-        ch_group_find_by_serv(iairzoning)->is_working = false;
-    }
-    
-    vTaskDelete(NULL);
 }
 
 void temperature_timer_worker(TimerHandle_t xTimer) {
@@ -3269,9 +3546,8 @@ void temperature_timer_worker(TimerHandle_t xTimer) {
         ch_group_t* ch_group = (ch_group_t*) pvTimerGetTimerID(xTimer);
         if (!ch_group->is_working) {
             ch_group->is_working = true;
-            if (xTaskCreate(temperature_task, "TEM", TEMPERATURE_TASK_SIZE, (void*) ch_group, TEMPERATURE_TASK_PRIORITY, NULL) != pdPASS) {
+            if (xQueueSendToBack(main_config.temperature_queue, &ch_group, 0) != pdTRUE) {
                 ch_group->is_working = false;
-                homekit_remove_oldest_client();
                 ERROR("TEM");
             }
         } else {
@@ -3282,6 +3558,7 @@ void temperature_timer_worker(TimerHandle_t xTimer) {
     }
 }
 
+
 // --- LIGHTBULB
 void hsi2rgbw(uint16_t h, float s, uint8_t v, ch_group_t* ch_group) {
     // * All credits and thanks to Kevin John Cutler    *
@@ -3816,6 +4093,8 @@ static void set_fx_color0(lightbulb_group_t* lightbulb_group) {
 }
 
 void rgbw_set_timer_worker() {
+    RS_TRACE_START(RGB);
+    
     unsigned int all_channels_ready = true;
     
     lightbulb_group_t* lightbulb_group = main_config.lightbulb_groups;
@@ -3948,7 +4227,7 @@ void rgbw_set_timer_worker() {
             
             free(colors);
         } else {
-            homekit_remove_oldest_client();
+            homekit_mem_recover(HOMEKIT_MEM_FX, addressled->max_range, HOMEKIT_MEM_PRIORITY_NORMAL);
             break;
         }
         
@@ -3961,6 +4240,8 @@ void rgbw_set_timer_worker() {
         
         INFO("RGBW done");
     }
+    
+    RS_TRACE_STOP(RGB);
 }
 
 void lightbulb_no_task(ch_group_t* ch_group) {
@@ -4112,7 +4393,7 @@ void lightbulb_task_timer(TimerHandle_t xTimer) {
         lightbulb_group_t* lightbulb_group = lightbulb_group_find(ch_group->ch[0]);
         lightbulb_group->lightbulb_task_running = false;
         
-        homekit_remove_oldest_client();
+        homekit_mem_recover(HOMEKIT_MEM_FX, TASK_DRAM(LIGHTBULB_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
         ERROR("LB");
         rs_esp_timer_start(xTimer);
     }
@@ -4330,8 +4611,10 @@ void autodimmer_call(homekit_characteristic_t* ch0, const homekit_value_t value)
             lightbulb_group->armed_autodimmer = false;
             rs_esp_timer_stop(LIGHTBULB_AUTODIMMER_TIMER);
             
-            if (xTaskCreate(autodimmer_task, "DIM", AUTODIMMER_TASK_SIZE, (void*) ch0, AUTODIMMER_TASK_PRIORITY, NULL) != pdPASS) {
-                homekit_remove_oldest_client();
+            if (!homekit_mem_admit(HOMEKIT_MEM_FX, TASK_DRAM(AUTODIMMER_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL)) {
+                ERROR("DIM DRAM");
+            } else if (xTaskCreate(autodimmer_task, "DIM", AUTODIMMER_TASK_SIZE, (void*) ch0, AUTODIMMER_TASK_PRIORITY, NULL) != pdPASS) {
+                homekit_mem_recover(HOMEKIT_MEM_FX, TASK_DRAM(AUTODIMMER_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
                 ERROR("DIM");
             }
         } else {
@@ -4848,7 +5131,7 @@ void process_fan_task(void* args) {
 
 void process_fan_timer(TimerHandle_t xTimer) {
     if (xTaskCreate(process_fan_task, "FAN", PROCESS_FAN_TASK_SIZE, (void*) pvTimerGetTimerID(xTimer), PROCESS_FAN_TASK_PRIORITY, NULL) != pdPASS) {
-        homekit_remove_oldest_client();
+        homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(PROCESS_FAN_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
         ERROR("FAN");
         rs_esp_timer_start(xTimer);
     }
@@ -4970,7 +5253,7 @@ void light_sensor_timer_worker(TimerHandle_t xTimer) {
             ch_group->is_working = true;
             if (xTaskCreate(light_sensor_task, "LUX", LIGHT_SENSOR_TASK_SIZE, (void*) ch_group, LIGHT_SENSOR_TASK_PRIORITY, NULL) != pdPASS) {
                 ch_group->is_working = false;
-                homekit_remove_oldest_client();
+                homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(LIGHT_SENSOR_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
                 ERROR("LUX");
             }
         } else {
@@ -5296,7 +5579,8 @@ bool set_hkch_value(homekit_characteristic_t* ch_target, const float value) {
     return has_changed;
 }
 
-void* force_alloc(const unsigned int len) {
+// Every retry sheds caches and unverified clients, as any other NORMAL work. Paired clients are never closed here
+void* force_alloc(const homekit_mem_subsystem_t subsystem, const unsigned int len) {
     unsigned int errors = 0;
     void* new_char = NULL;
     
@@ -5305,7 +5589,7 @@ void* force_alloc(const unsigned int len) {
         if (new_char) {
             break;
         } else {
-            homekit_remove_oldest_client();
+            homekit_mem_recover(subsystem, len, HOMEKIT_MEM_PRIORITY_NORMAL);
             errors++;
             vTaskDelay(MS_TO_TICKS(110));
         }
@@ -5516,6 +5800,8 @@ void free_monitor_task(void* args) {
         return false;
     }
     
+    RS_TRACE_START(FRE);
+    
     ch_group_t* ch_group = main_config.ch_groups;
     
     if (args) {
@@ -5901,7 +6187,7 @@ void free_monitor_task(void* args) {
                                                 + ((method_req != NULL) ? strlen(method_req) : 0) + content_len_n
                                                 + 4 + 1; // 4 for fixed chars of "%s /%s%s%s%s%s%s\r\n" +1 for last null only used for logs
                                             
-                                            req = (char*) force_alloc(action_network->len);
+                                            req = (char*) force_alloc(HOMEKIT_MEM_NETWORK, action_network->len);
                                             if (!req) {
                                                 if (method_req) {
                                                     free(method_req);
@@ -6182,6 +6468,8 @@ void free_monitor_task(void* args) {
         reset_uart_buffer();
     }
     
+    RS_TRACE_STOP(FRE);
+    
     vTaskDelete(NULL);
 }
 
@@ -6213,7 +6501,7 @@ void free_monitor_timer_worker(TimerHandle_t xTimer) {
                     ch_group->is_working = true;
                     if (xTaskCreate(free_monitor_task, "FM", FREE_MONITOR_TASK_SIZE, (void*) ch_group, FREE_MONITOR_TASK_PRIORITY, NULL) != pdPASS) {
                         ch_group->is_working = false;
-                        homekit_remove_oldest_client();
+                        homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(FREE_MONITOR_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
                         ERROR("FM");
                     }
                 } else {
@@ -6283,7 +6571,7 @@ void recv_uart_task() {
         if (xTaskCreate(free_monitor_task, "FM", FREE_MONITOR_TASK_SIZE, NULL, FREE_MONITOR_TASK_PRIORITY, NULL) != pdPASS) {
             reset_uart_buffer();
             ERROR("FM");
-            homekit_remove_oldest_client();
+            homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(FREE_MONITOR_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
         }
     } else {
         reset_uart_buffer();
@@ -6317,7 +6605,7 @@ void recv_uart_timer_worker(TimerHandle_t xTimer) {
     if (uart_has_data) {
         if (xTaskCreate(recv_uart_task, "RUA", RECV_UART_TASK_SIZE, NULL, RECV_UART_TASK_PRIORITY, NULL) != pdPASS) {
             ERROR("RUA");
-            homekit_remove_oldest_client();
+            homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(RECV_UART_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
         }
     }
 }
@@ -6601,10 +6889,9 @@ void net_action_task(void* pvParameters) {
                 
                 len += strlen(buffer) - 9;
                 
-                str_ch_value_t* str_ch_value = calloc(1, sizeof(str_ch_value_t));
+                str_ch_value_t* str_ch_value = rs_slab_alloc(&main_config.str_ch_value_slab);
                 
-                str_ch_value->string = strdup(buffer);
-                str_ch_value->next = NULL;
+                strcpy(str_ch_value->string, buffer);
                 INFO("Wildcard val: %s", str_ch_value->string);
                 
                 if (*str_ch_value_ini == NULL) {
@@ -6638,12 +6925,10 @@ void net_action_task(void* pvParameters) {
                 
                 strcat(*new_req, str_ch_value->string);
                 
-                free(str_ch_value->string);
-
                 str_ch_value_t* str_ch_value_old = str_ch_value;
                 str_ch_value = str_ch_value->next;
                 
-                free(str_ch_value_old);
+                rs_slab_free(&main_config.str_ch_value_slab, str_ch_value_old);
 
                 last_pos = content_search + 9;
                 
@@ -6700,7 +6985,7 @@ void net_action_task(void* pvParameters) {
                             + ((method_req != NULL) ? strlen(method_req) : 0) + content_len_n
                         + 4 + 1; // 4 for fixed chars of "%s /%s%s%s%s%s%s\r\n" +1 for last null only used for logs
                         
-                        req = (char*) force_alloc(action_network->len);
+                        req = (char*) force_alloc(HOMEKIT_MEM_NETWORK, action_network->len);
                         if (!req) {
                             if (method_req) {
                                 free(method_req);
@@ -6735,7 +7020,7 @@ void net_action_task(void* pvParameters) {
                         if (action_network->method_n == 3) {
                             action_network->len = content_len_n + 1;    // +1 for last null only used for logs
                             
-                            req = (char*) force_alloc(content_len_n);
+                            req = (char*) force_alloc(HOMEKIT_MEM_NETWORK, content_len_n);
                             if (!req) {
                                 action_network->is_running = false;
                                 action_network = action_network->next;
@@ -6823,7 +7108,7 @@ void net_action_task(void* pvParameters) {
                     if (action_network->method_n == 13) {
                         unsigned int content_len_n = search_str_ch_values(&str_ch_value_first, action_network->content);
                         
-                        char* req = (char*) force_alloc(content_len_n + 1);
+                        char* req = (char*) force_alloc(HOMEKIT_MEM_NETWORK, content_len_n + 1);
                         if (!req) {
                             action_network->is_running = false;
                             action_network = action_network->next;
@@ -6903,7 +7188,7 @@ void net_action_task(void* pvParameters) {
         action_network = action_network->next;
     }
 
-    free(action_task);
+    rs_slab_free(&main_config.action_task_slab, action_task);
     vTaskDelete(NULL);
 }
 
@@ -7002,7 +7287,7 @@ void irrf_tx_task(void* pvParameters) {
                         break;
                 }
                 
-                ir_code = (uint16_t*) force_alloc(sizeof(uint16_t) * ir_code_len);
+                ir_code = (uint16_t*) force_alloc(HOMEKIT_MEM_SYSTEM, sizeof(uint16_t) * ir_code_len);
                 if (!ir_code) {
                     ERROR("DRAM");
                     continue;
@@ -7189,7 +7474,7 @@ void irrf_tx_task(void* pvParameters) {
                 const unsigned int json_ir_code_len = strlen(action_irrf_tx->raw_code);
                 ir_code_len = json_ir_code_len >> 1;
                 
-                ir_code = (uint16_t*) force_alloc(sizeof(uint16_t) * ir_code_len);
+                ir_code = (uint16_t*) force_alloc(HOMEKIT_MEM_SYSTEM, sizeof(uint16_t) * ir_code_len);
                 if (!ir_code) {
                     ERROR("DRAM");
                     continue;
@@ -7276,7 +7561,7 @@ void irrf_tx_task(void* pvParameters) {
         action_irrf_tx = action_irrf_tx->next;
     }
     
-    free(action_task);
+    rs_slab_free(&main_config.action_task_slab, action_task);
     vTaskDelete(NULL);
 }
 
@@ -7315,13 +7600,13 @@ void uart_action_task(void* pvParameters) {
         action_uart = action_uart->next;
     }
     
-    free(action_task);
+    rs_slab_free(&main_config.action_task_slab, action_task);
     vTaskDelete(NULL);
 }
 
 // --- ACTIONS
-void autoswitch_timer(TimerHandle_t xTimer) {
-    action_binary_output_t* action_binary_output = (action_binary_output_t*) pvTimerGetTimerID(xTimer);
+void autoswitch_timer(void* args) {
+    action_binary_output_t* action_binary_output = (action_binary_output_t*) args;
     
     if (action_binary_output->trigger_gpio_mode == 0) {
         extended_gpio_write(action_binary_output->gpio, !action_binary_output->value);
@@ -7330,13 +7615,16 @@ void autoswitch_timer(TimerHandle_t xTimer) {
     }
     
     INFO("Auto DigO %i->%i", action_binary_output->gpio, !action_binary_output->value);
-    
-    rs_esp_timer_delete(xTimer);
 }
 
 void do_actions(ch_group_t* ch_group, uint8_t action) {
+    RS_TRACE_START(ACT);
+    
     INFO("<%i> Run A%i", ch_group->serv_index, action);
     
+    // Nested actions of other services are part of same burst
+    extended_gpio_burst_begin();
+    
     // Copy actions
     action_copy_t* action_copy = ch_group->action_copy;
     while (action_copy) {
@@ -7349,25 +7637,33 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
     }
     
     // Binary outputs
+    extended_gpio_batch_t extended_gpio_batch = {
+        .gpio_batch = ADV_GPIO_BATCH_INIT,
+        .has_mcp23017 = false,
+    };
+    
     action_binary_output_t* action_binary_output = ch_group->action_binary_output;
     while (action_binary_output) {
         if (action_binary_output->action == action) {
             if (action_binary_output->trigger_gpio_mode == 0) {
-                extended_gpio_write(action_binary_output->gpio, action_binary_output->value);
+                extended_gpio_batch_write(&extended_gpio_batch, action_binary_output->gpio, action_binary_output->value);
             } else {
                 set_delayed_binary_output(action_binary_output, action_binary_output->value);
             }
             
             INFO("<%i> DigO %i->%i (%"HAA_LONGINT_F")", ch_group->serv_index, action_binary_output->gpio, action_binary_output->value, action_binary_output->inching);
             
-            if (action_binary_output->inching > 0) {
-                rs_esp_timer_start(rs_esp_timer_create(action_binary_output->inching, pdFALSE, (void*) action_binary_output, autoswitch_timer));
+            // Output already waiting to be switched back keeps its first timeout
+            if (action_binary_output->inching > 0 && !rs_wheel_timer_is_active(&action_binary_output->inching_timer)) {
+                rs_wheel_timer_start(&action_binary_output->inching_timer, action_binary_output->inching);
             }
         }
         
         action_binary_output = action_binary_output->next;
     }
     
+    extended_gpio_batch_commit(&extended_gpio_batch);
+    
     // Service Notification Manager
     action_serv_manager_t* action_serv_manager = ch_group->action_serv_manager;
     ch_group_t* ch_group_ori = ch_group;
@@ -7742,7 +8038,7 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
                                         FM_OVERRIDE_VALUE = action_serv_manager->value;
                                         if (xTaskCreate(free_monitor_task, "FM", FREE_MONITOR_TASK_SIZE, (void*) ch_group, FREE_MONITOR_TASK_PRIORITY, NULL) != pdPASS) {
                                             ch_group->is_working = false;
-                                            homekit_remove_oldest_client();
+                                            homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(FREE_MONITOR_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
                                             ERROR("FM");
                                         }
                                     } else {
@@ -7886,7 +8182,7 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
     }
     
     action_task_t* create_action_task() {
-        action_task_t* action_task = calloc(1, sizeof(action_task_t));
+        action_task_t* action_task = rs_slab_alloc(&main_config.action_task_slab);
         action_task->action = action;
         action_task->ch_group = ch_group;
         
@@ -7900,8 +8196,8 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
             if (action_uart->action == action) {
                 action_task_t* action_task = create_action_task();
                 if (xTaskCreate(uart_action_task, "UAR", UART_ACTION_TASK_SIZE, action_task, UART_ACTION_TASK_PRIORITY, NULL) != pdPASS) {
-                    free(action_task);
-                    homekit_remove_oldest_client();
+                    rs_slab_free(&main_config.action_task_slab, action_task);
+                    homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(UART_ACTION_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
                     ERROR("UAR");
                 }
                 
@@ -7918,9 +8214,12 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
         while (action_network) {
             if (action_network->action == action) {
                 action_task_t* action_task = create_action_task();
-                if (xTaskCreate(net_action_task, "NET", NETWORK_ACTION_TASK_SIZE, action_task, NETWORK_ACTION_TASK_PRIORITY, NULL) != pdPASS) {
-                    free(action_task);
-                    homekit_remove_oldest_client();
+                if (!homekit_mem_admit(HOMEKIT_MEM_NETWORK, TASK_DRAM(NETWORK_ACTION_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL)) {
+                    rs_slab_free(&main_config.action_task_slab, action_task);
+                    ERROR("NET DRAM");
+                } else if (xTaskCreate(net_action_task, "NET", NETWORK_ACTION_TASK_SIZE, action_task, NETWORK_ACTION_TASK_PRIORITY, NULL) != pdPASS) {
+                    rs_slab_free(&main_config.action_task_slab, action_task);
+                    homekit_mem_recover(HOMEKIT_MEM_NETWORK, TASK_DRAM(NETWORK_ACTION_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
                     ERROR("NET");
                 }
                 
@@ -7938,8 +8237,8 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
             if (action_irrf_tx->action == action) {
                 action_task_t* action_task = create_action_task();
                 if (xTaskCreate(irrf_tx_task, "IR", IRRF_TX_TASK_SIZE, action_task, IRRF_TX_TASK_PRIORITY, NULL) != pdPASS) {
-                    free(action_task);
-                    homekit_remove_oldest_client();
+                    rs_slab_free(&main_config.action_task_slab, action_task);
+                    homekit_mem_recover(HOMEKIT_MEM_SYSTEM, TASK_DRAM(IRRF_TX_TASK_SIZE), HOMEKIT_MEM_PRIORITY_NORMAL);
                     ERROR("IR");
                 }
                 
@@ -7949,6 +8248,10 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
             action_irrf_tx = action_irrf_tx->next;
         }
     }
+    
+    extended_gpio_burst_end();
+    
+    RS_TRACE_STOP(ACT);
 }
 
 void do_wildcard_actions(ch_group_t* ch_group, uint8_t index, const float action_value) {
@@ -7980,56 +8283,68 @@ void do_wildcard_actions(ch_group_t* ch_group, uint8_t index, const float action
     }
 }
 
+// Timetable actions list is kept sorted by next time
+static void timetable_action_insert(timetable_action_t* timetable_action) {
+    timetable_action_t** next = &main_config.timetable_actions;
+    while (*next && (*next)->next_time <= timetable_action->next_time) {
+        next = &(*next)->next;
+    }
+    
+    timetable_action->next = *next;
+    *next = timetable_action;
+}
+
 void timetable_actions_timer_worker(TimerHandle_t xTimer) {
     if (!main_config.clock_ready) {
         return;
     }
     
-    struct tm* timeinfo;
-    time_t time = raven_ntp_get_time();
-    timeinfo = localtime(&time);
-    
-    if (!main_config.timetable_ready) {
-        if (timeinfo->tm_sec == 0) {
-            if (rs_esp_timer_change_period(xTimer, 60000) == pdPASS) {
-                main_config.timetable_ready = true;
-            }
-        } else {
-            return;
-        }
-    }
-    
-    if (main_config.timetable_last_minute == timeinfo->tm_min) {
-        return;
-    }
+    const time_t now = raven_ntp_get_time();
+    const uint32_t tick = xTaskGetTickCount();
     
-    main_config.timetable_last_minute = timeinfo->tm_min;
+    // Wall clock moving apart from ticks means a clock change, so all times are calculated again
+    const int32_t clock_jump = (int32_t) (now - main_config.timetable_last_time) - (int32_t) ((tick - main_config.timetable_last_tick) / configTICK_RATE_HZ);
     
-    ch_group_t* ch_group = ch_group_find_by_serv(SERV_TYPE_ROOT_DEVICE);
+    main_config.timetable_last_time = now;
+    main_config.timetable_last_tick = tick;
     
-    if (ch_group->main_enabled) {
+    if (!main_config.timetable_ready || clock_jump > TIMETABLE_CLOCK_JUMP_S || clock_jump < -TIMETABLE_CLOCK_JUMP_S) {
+        main_config.timetable_ready = true;
+        
         timetable_action_t* timetable_action = main_config.timetable_actions;
+        main_config.timetable_actions = NULL;
         while (timetable_action) {
-            if (
-                (timetable_action->mon  == ALL_MONS  || timetable_action->mon  == timeinfo->tm_mon ) &&
-                (timetable_action->mday == ALL_MDAYS || timetable_action->mday == timeinfo->tm_mday) &&
-                (timetable_action->hour == ALL_HOURS || timetable_action->hour == timeinfo->tm_hour) &&
-                (timetable_action->min  == ALL_MINS  || timetable_action->min  == timeinfo->tm_min ) &&
-                (timetable_action->wday == ALL_WDAYS || timetable_action->wday == timeinfo->tm_wday)
-                ) {
-                    do_actions(ch_group, timetable_action->action);
-                }
+            timetable_action_t* next = timetable_action->next;
+            timetable_action->next_time = timetable_action_next_time(timetable_action, now);
+            timetable_action_insert(timetable_action);
+            timetable_action = next;
+        }
+        
+    } else {
+        ch_group_t* ch_group = ch_group_find_by_serv(SERV_TYPE_ROOT_DEVICE);
+        
+        while (main_config.timetable_actions->next_time <= now) {
+            timetable_action_t* timetable_action = main_config.timetable_actions;
+            main_config.timetable_actions = timetable_action->next;
+            
+            if (ch_group->main_enabled) {
+                do_actions(ch_group, timetable_action->action);
+            }
             
-            timetable_action = timetable_action->next;
+            timetable_action->next_time = timetable_action_next_time(timetable_action, timetable_action->next_time);
+            timetable_action_insert(timetable_action);
         }
     }
     
-    if (timeinfo->tm_hour == 03 &&
-        timeinfo->tm_min  == 59 &&
-        timeinfo->tm_sec  != 00 &&
-        rs_esp_timer_change_period(xTimer, 1000) == pdPASS) {
-        main_config.timetable_ready = false;
+    // Sleep until next action, waking up at least each TIMETABLE_MAX_SLEEP_S
+    time_t sleep_time = main_config.timetable_actions->next_time - now;
+    if (sleep_time > TIMETABLE_MAX_SLEEP_S) {
+        sleep_time = TIMETABLE_MAX_SLEEP_S;
+    } else if (sleep_time < 1) {
+        sleep_time = 1;
     }
+    
+    rs_esp_timer_change_period(xTimer, sleep_time * 1000);
 }
 
 // --- IDENTIFY
@@ -8065,9 +8380,7 @@ void run_homekit_server() {
     main_config.wifi_status = WIFI_STATUS_CONNECTED;
     main_config.wifi_ip = wifi_config_get_ip();
     
-    if (main_config.ntp_host && strcmp(main_config.ntp_host, NTP_DISABLE_STRING) == 0) {
-        free(main_config.ntp_host);
-    } else {
+    if (!main_config.ntp_host || strcmp(main_config.ntp_host, NTP_DISABLE_STRING) != 0) {
         rs_esp_timer_start_forced(rs_esp_timer_create(NTP_POLL_PERIOD_MS, pdTRUE, NULL, ntp_timer_worker));
         
         ntp_timer_worker(NULL);
@@ -8147,12 +8460,18 @@ void homekit_re_pair_timer(TimerHandle_t xTimer) {
 void normal_mode_init() {
     main_config.network_busy_mutex = xSemaphoreCreateMutex();
     
-    unistring_t* unistrings = NULL;
-    
     char* txt_config = NULL;
     sysparam_get_string(HAA_SCRIPT_SYSPARAM, &txt_config);
     
-    cJSON_rsf* json_haa = cJSON_rsf_Parse(txt_config);
+    size_t txt_config_len = 0;
+    if (txt_config) {
+        txt_config_len = strlen(txt_config);
+    }
+    
+    // About one unique string each 64 script bytes
+    unistring_t* unistrings = unistring_create(txt_config_len >> 6);
+    
+    cJSON_rsf* json_haa = cJSON_rsf_ParseArena(txt_config, false);
     
     cJSON_rsf* json_accessories = cJSON_rsf_GetObjectItemCaseSensitive(json_haa, ACCESSORIES_ARRAY);
     
@@ -8300,6 +8619,7 @@ void normal_mode_init() {
                 last_state->ch_type = ch_type;
                 last_state->ch_state_id = int_saved_state_id;
                 last_state->ch = ch_group->ch[ch_number];
+                last_state->ch_group = ch_group;
                 last_state->next = main_config.last_states;
                 main_config.last_states = last_state;
                 
@@ -8314,6 +8634,7 @@ void normal_mode_init() {
                         
                         if (status == SYSPARAM_OK) {
                             state = saved_state_int8;
+                            last_state->saved_value = saved_state_int8;
                         }
                         break;
                         
@@ -8322,6 +8643,7 @@ void normal_mode_init() {
                         
                         if (status == SYSPARAM_OK) {
                             state = saved_state_int;
+                            last_state->saved_value = saved_state_int;
                         }
                         break;
                         
@@ -8330,6 +8652,7 @@ void normal_mode_init() {
                         
                         if (status == SYSPARAM_OK) {
                             state = saved_state_int / FLOAT_FACTOR_SAVE_AS_INT;
+                            last_state->saved_value = saved_state_int;
                         }
                         break;
                         
@@ -8345,6 +8668,8 @@ void normal_mode_init() {
                         status = sysparam_get_bool(saved_state_id, &saved_state_bool);
                         
                         if (status == SYSPARAM_OK) {
+                            last_state->saved_value = saved_state_bool;
+                            
                             if (initial_state == INIT_STATE_LAST) {
                                 state = saved_state_bool;
                             } else if (ch_type == CH_TYPE_BOOL) {    // initial_state == INIT_STATE_INV_LAST
@@ -8356,6 +8681,8 @@ void normal_mode_init() {
                 
                 if (status != SYSPARAM_OK) {
                     INFO_NNL("none ");
+                } else {
+                    last_state->has_saved_value = true;
                 }
                 
                 ch_group->save_last_state = true;
@@ -8454,6 +8781,10 @@ void normal_mode_init() {
                         action_binary_output->trigger_gpio = binary_output_data[3];
                         action_binary_output->trigger_gpio_mode = binary_output_data[4];
                         
+                        if (action_binary_output->inching > 0) {
+                            rs_wheel_timer_init(&action_binary_output->inching_timer, autoswitch_timer, (void*) action_binary_output);
+                        }
+                        
                         action_binary_output->next = last_action;
                         last_action = action_binary_output;
                         
@@ -9106,6 +9437,10 @@ void normal_mode_init() {
                 if (cJSON_rsf_GetObjectItemCaseSensitive(json_accessory, TEMPERATURE_SENSOR_INDEX) != NULL) {
                     TH_SENSOR_INDEX = (uint8_t) cJSON_rsf_GetObjectItemCaseSensitive(json_accessory, TEMPERATURE_SENSOR_INDEX)->valuefloat;
                 }
+                
+                if (TH_SENSOR_INDEX > 0) {
+                    ds18b20_bus_subscribe(sensor_gpio, sensor_gpio_output, TH_SENSOR_INDEX, sensor_poll_period(json_accessory, TH_SENSOR_POLL_PERIOD_DEFAULT));
+                }
             } else {
                 dht_init_pin(sensor_gpio, sensor_gpio_output);
             }
@@ -9114,7 +9449,12 @@ void normal_mode_init() {
         return sensor_poll_period(json_accessory, TH_SENSOR_POLL_PERIOD_DEFAULT);
     }
     
+    // Each sensor is queued only once at a time, so its queue has one place per sensor
+    unsigned int th_sensor_count = 0;
+    
     void th_sensor_starter(ch_group_t* ch_group, float poll_period) {
+        th_sensor_count++;
+        
         ch_group->timer = rs_esp_timer_create(poll_period * 1000, pdTRUE, (void*) ch_group, temperature_timer_worker);
     }
     
@@ -9312,11 +9652,10 @@ void normal_mode_init() {
     
     char* log_output_target = NULL;
     if (cJSON_rsf_GetObjectItemCaseSensitive(json_config, LOG_OUTPUT_TARGET) != NULL) {
-        log_output_target = uni_strdup(cJSON_rsf_GetObjectItemCaseSensitive(json_config, LOG_OUTPUT_TARGET)->valuestring, &unistrings);
+        log_output_target = cJSON_rsf_GetObjectItemCaseSensitive(json_config, LOG_OUTPUT_TARGET)->valuestring;
     }
     
     adv_logger_init(log_output_type, log_output_target, true);
-    free(log_output_target);
     
     if (log_output_type > 0) {
         printf_header();
@@ -9324,7 +9663,7 @@ void normal_mode_init() {
         
         char* txt_config_buffer = malloc(256);
         
-        for (unsigned int i = 0; i < strlen(txt_config); i += 255) {
+        for (unsigned int i = 0; i < txt_config_len; i += 255) {
             for (unsigned int j = 0; j < 255; j++) {
                 txt_config_buffer[j] = txt_config[i + j];
                 
@@ -9482,8 +9821,8 @@ void normal_mode_init() {
                         
                     } else {    // Mode OUTPUT
                         if (mcp23017->outs == NULL) {
-                            mcp23017->outs = calloc(2, sizeof(uint8_t));
                             mcp23017->len = 2 * sizeof(uint8_t);
+                            mcp_outs_init(mcp23017, 2);
                         }
                         
                         reg += 0x14;
@@ -9538,7 +9877,7 @@ void normal_mode_init() {
                     
                     unsigned int out_groups = (mcp23017->len >> 3) + 1;
                     
-                    mcp23017->outs = calloc(out_groups, sizeof(uint8_t));
+                    mcp_outs_init(mcp23017, out_groups);
                     
                     for (unsigned int out_group = 0; out_group < cJSON_rsf_GetArraySize(json_mcp23017) - 4; out_group++) {
                         mcp23017->outs[out_group] = (uint8_t) cJSON_rsf_GetArrayItem(json_mcp23017, out_group + 4)->valuefloat;
@@ -13758,6 +14097,11 @@ void normal_mode_init() {
         rs_esp_timer_start_forced(xTimer);
     }
     
+    if (th_sensor_count > 0) {
+        main_config.temperature_queue = xQueueCreate(th_sensor_count, sizeof(ch_group_t*));
+        xTaskCreate(temperature_task, "TEM", TEMPERATURE_TASK_SIZE, NULL, TEMPERATURE_TASK_PRIORITY, NULL);
+    }
+    
     ch_group_t* th_ch_group = main_config.ch_groups;
     while (th_ch_group) {
         if (th_ch_group->serv_type >= SERV_TYPE_THERMOSTAT &&
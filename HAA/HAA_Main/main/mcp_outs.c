@@ -0,0 +1,121 @@
+/*
+ * MCP23017 and Shift Register outputs for Home Accessory Architect
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <stdlib.h>
+
+#ifdef ESP_PLATFORM
+
+#include "driver/gpio.h"
+
+#define gpio_write(gpio, level)     gpio_set_level(gpio, level)
+
+#else
+
+#include <esp8266.h>
+
+#endif
+
+#include <adv_i2c.h>
+
+#include "mcp_outs.h"
+
+#define MCP_OUT_GROUPS(mcp23017)    (((mcp23017)->bus < 100) ? 2 : (((mcp23017)->len >> 3) + 1))
+
+void mcp_outs_init(mcp23017_t* mcp23017, const unsigned int out_groups) {
+    mcp23017->outs = calloc(out_groups, sizeof(uint8_t));
+    mcp23017->burst_outs = calloc(out_groups * 2, sizeof(uint8_t));
+    mcp23017->mutex = xSemaphoreCreateMutex();
+}
+
+void mcp_set_out(mcp23017_t* mcp23017, const unsigned int gpio, const bool value, const bool is_in_burst) {
+    const unsigned int out_group = gpio >> 3;     // out_group = gpio / 8
+    const uint8_t bit = 1 << (gpio % 8);
+    
+    uint8_t dirty_out = 1;      // Shift Register
+    if (mcp23017->bus < 100) {  // MCP23017
+        dirty_out = 1 << out_group;
+    }
+    
+    xSemaphoreTake(mcp23017->mutex, portMAX_DELAY);
+    
+    uint8_t* outs = mcp23017->outs;
+    if (is_in_burst) {
+        outs = mcp23017->burst_outs;
+        mcp23017->burst_outs[MCP_OUT_GROUPS(mcp23017) + out_group] |= bit;
+        mcp23017->burst_dirty_outs |= dirty_out;
+    } else {
+        mcp23017->dirty_outs |= dirty_out;
+    }
+    
+    if (value) {
+        outs[out_group] |= bit;
+    } else {
+        outs[out_group] &= ~bit;
+    }
+    
+    xSemaphoreGive(mcp23017->mutex);
+}
+
+void mcp_write_outs(mcp23017_t* mcp23017, const bool merge_burst) {
+    xSemaphoreTake(mcp23017->mutex, portMAX_DELAY);
+    
+    if (merge_burst && mcp23017->burst_dirty_outs) {
+        const unsigned int out_groups = MCP_OUT_GROUPS(mcp23017);
+        for (unsigned int out_group = 0; out_group < out_groups; out_group++) {
+            const uint8_t mask = mcp23017->burst_outs[out_groups + out_group];
+            mcp23017->outs[out_group] = (mcp23017->outs[out_group] & ~mask) | (mcp23017->burst_outs[out_group] & mask);
+            mcp23017->burst_outs[out_groups + out_group] = 0;
+        }
+        
+        mcp23017->dirty_outs |= mcp23017->burst_dirty_outs;
+        mcp23017->burst_dirty_outs = 0;
+    }
+    
+    if (mcp23017->dirty_outs) {
+        if (mcp23017->bus < 100) { // MCP23017
+            uint8_t mcp_reg = 0x14;
+            
+            if (mcp23017->dirty_outs == 0b11) {
+                // OLATA and OLATB in one sequential write
+                adv_i2c_slave_write(mcp23017->bus, mcp23017->addr, &mcp_reg, 1, mcp23017->outs, 2);
+                
+            } else {
+                const unsigned int out_group = mcp23017->dirty_outs >> 1;
+                mcp_reg += out_group;
+                
+                adv_i2c_slave_write(mcp23017->bus, mcp23017->addr, &mcp_reg, 1, &mcp23017->outs[out_group], 1);
+            }
+            
+        } else {    // Shift Register
+            const uint8_t clock_gpio = mcp23017->bus - 100;
+            
+            unsigned int bit_shift = 0;
+            unsigned int out_group = 0;
+            for (unsigned int i = 0; i < mcp23017->len; i++) {
+                gpio_write(mcp23017->addr, (bool) (mcp23017->outs[out_group] & (1 << bit_shift)));
+                
+                gpio_write(clock_gpio, true);
+                gpio_write(clock_gpio, false);
+                
+                bit_shift++;
+                if (bit_shift == 8) {
+                    bit_shift = 0;
+                    out_group++;
+                }
+            }
+            
+            if (mcp23017->latch_gpio >= 0) {
+                gpio_write(mcp23017->latch_gpio, true);
+                gpio_write(mcp23017->latch_gpio, false);
+            }
+        }
+        
+        mcp23017->dirty_outs = 0;
+    }
+    
+    xSemaphoreGive(mcp23017->mutex);
+}
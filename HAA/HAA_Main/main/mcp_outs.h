@@ -0,0 +1,49 @@
+/*
+ * MCP23017 and Shift Register outputs for Home Accessory Architect
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifndef __HAA_MCP_OUTS_H__
+#define __HAA_MCP_OUTS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include <FreeRTOS.h>
+#include <semphr.h>
+#endif
+
+typedef struct _mcp23017 {
+    uint8_t index;
+    uint8_t bus;
+    uint8_t addr;
+    int8_t latch_gpio;
+    
+    uint8_t len;    // 7 bits
+    uint8_t dirty_outs;         // Out groups pending to be written
+    uint8_t burst_dirty_outs;   // Out groups changed inside a burst, merged when it ends
+    
+    uint8_t* outs;
+    uint8_t* burst_outs;        // Values set inside a burst, followed by their masks
+    
+    SemaphoreHandle_t mutex;    // Taken to change outputs and to write them
+    
+    struct _mcp23017* next;
+} mcp23017_t;
+
+// Takes shadow outputs, all off, and mutex of an output expander
+void mcp_outs_init(mcp23017_t* mcp23017, const unsigned int out_groups);
+
+// Inside a burst, new value is kept apart until burst ends, so writes of other tasks never output it
+void mcp_set_out(mcp23017_t* mcp23017, const unsigned int gpio, const bool value, const bool is_in_burst);
+
+// Writes out groups pending to be written. With merge_burst, values set inside ended burst are written too
+void mcp_write_outs(mcp23017_t* mcp23017, const bool merge_burst);
+
+#endif  // __HAA_MCP_OUTS_H__
@@ -0,0 +1,112 @@
+/*
+ * Timetable actions scheduling for Home Accessory Architect
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include "timetable.h"
+
+static bool timetable_action_day_match(timetable_action_t* timetable_action, struct tm* day) {
+    return (timetable_action->mon  == ALL_MONS  || timetable_action->mon  == day->tm_mon ) &&
+           (timetable_action->mday == ALL_MDAYS || timetable_action->mday == day->tm_mday) &&
+           (timetable_action->wday == ALL_WDAYS || timetable_action->wday == day->tm_wday);
+}
+
+// Returns first minute of the day from given one matching hour and minute, or -1
+static int timetable_action_next_minute(timetable_action_t* timetable_action, const int minute_of_day) {
+    int hour = minute_of_day / 60;
+    int min = minute_of_day % 60;
+    
+    if (timetable_action->hour != ALL_HOURS) {
+        if (timetable_action->hour < hour) {
+            return -1;
+        }
+        
+        if (timetable_action->hour > hour) {
+            min = 0;
+        }
+        
+        hour = timetable_action->hour;
+    }
+    
+    if (timetable_action->min != ALL_MINS) {
+        if (timetable_action->min < min) {
+            if (timetable_action->hour != ALL_HOURS || hour == 23) {
+                return -1;
+            }
+            
+            hour++;
+        }
+        
+        min = timetable_action->min;
+    }
+    
+    return (hour * 60) + min;
+}
+
+// Returns first local time minute after given time when action must run
+time_t timetable_action_next_time(timetable_action_t* timetable_action, const time_t after) {
+    const time_t start = after - (after % 60) + 60;
+    
+    struct tm day;
+    localtime_r(&start, &day);
+    int minute_of_day = (day.tm_hour * 60) + day.tm_min;
+    
+    for (unsigned int i = 0; i < TIMETABLE_MAX_SEARCH_DAYS; i++) {
+        if (timetable_action_day_match(timetable_action, &day)) {
+            while (minute_of_day < 24 * 60 &&
+                   (minute_of_day = timetable_action_next_minute(timetable_action, minute_of_day)) >= 0) {
+                struct tm candidate = {
+                    .tm_year = day.tm_year,
+                    .tm_mon = day.tm_mon,
+                    .tm_mday = day.tm_mday,
+                    .tm_hour = minute_of_day / 60,
+                    .tm_min = minute_of_day % 60,
+                    .tm_isdst = -1,
+                };
+                
+                time_t next_time = mktime(&candidate);
+                
+                if (next_time < start) {
+                    // Repeated hour when DST ends: try its second occurrence
+                    next_time += 3600;
+                    localtime_r(&next_time, &candidate);
+                    if (candidate.tm_hour != minute_of_day / 60 || candidate.tm_min != minute_of_day % 60) {
+                        next_time = 0;
+                    }
+                }
+                
+                if (next_time >= start) {
+                    return next_time;
+                }
+                
+                minute_of_day++;
+            }
+        }
+        
+        minute_of_day = 0;
+        
+        day.tm_wday = (day.tm_wday + 1) % 7;
+        day.tm_mday++;
+        
+        const int year = day.tm_year + 1900;
+        int month_days = 31;
+        if (day.tm_mon == 1) {
+            month_days = ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0) ? 29 : 28;
+        } else if (day.tm_mon == 3 || day.tm_mon == 5 || day.tm_mon == 8 || day.tm_mon == 10) {
+            month_days = 30;
+        }
+        
+        if (day.tm_mday > month_days) {
+            day.tm_mday = 1;
+            day.tm_mon++;
+            if (day.tm_mon > 11) {
+                day.tm_mon = 0;
+                day.tm_year++;
+            }
+        }
+    }
+    
+    return TIMETABLE_NEVER;
+}
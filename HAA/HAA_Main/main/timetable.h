@@ -0,0 +1,41 @@
+/*
+ * Timetable actions scheduling for Home Accessory Architect
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifndef __HAA_TIMETABLE_H__
+#define __HAA_TIMETABLE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define ALL_MONS                            13
+#define ALL_MDAYS                           0
+#define ALL_HOURS                           24
+#define ALL_MINS                            60
+#define ALL_WDAYS                           7
+
+#define TIMETABLE_MAX_SEARCH_DAYS           (366 * 8)
+#define TIMETABLE_NEVER                     ((time_t) INT32_MAX)
+
+typedef struct _timetable_action {
+    uint8_t action;
+    
+    uint8_t mon: 4;
+    uint8_t mday: 5;
+    uint8_t hour: 5;
+    uint8_t min: 6;
+    uint8_t wday: 4;    // 3 bits
+    
+    time_t next_time;
+    
+    struct _timetable_action* next;
+} timetable_action_t;
+
+// Returns first local time minute after given time when action must run, or TIMETABLE_NEVER
+time_t timetable_action_next_time(timetable_action_t* timetable_action, const time_t after);
+
+#endif  // __HAA_TIMETABLE_H__
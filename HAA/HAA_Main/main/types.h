@@ -9,12 +9,20 @@
 #define __HAA_TYPES_H__
 
 #include "lightbulb_fx.h"
+#include "mcp_outs.h"
+#include "ds18b20_bus.h"
+#include "timetable.h"
 
 typedef struct _last_state {
     uint8_t ch_type;
+    bool dirty: 1;                  // Changed since last save
+    bool has_saved_value: 1;
     uint16_t ch_state_id;
     
+    int32_t saved_value;            // Value stored in flash, not used with strings
+    
     homekit_characteristic_t* ch;
+    struct _ch_group* ch_group;
     
     struct _last_state* next;
 } last_state_t;
@@ -34,6 +42,7 @@ typedef struct _action_binary_output {
     uint8_t value: 1;
     
     uint32_t inching;
+    rs_wheel_timer_t inching_timer;     // Only used with inching
     
     struct _action_binary_output* next;
 } action_binary_output_t;
@@ -305,23 +314,15 @@ typedef struct _ping_input {
 } ping_input_t;
 
 typedef struct _str_ch_value {
-    char* string;
+    char string[15];
 
     struct _str_ch_value* next;
 } str_ch_value_t;
 
-typedef struct _mcp23017 {
-    uint8_t index;
-    uint8_t bus;
-    uint8_t addr;
-    int8_t latch_gpio;
-    
-    uint8_t len;    // 7 bits
-    
-    uint8_t* outs;
-    
-    struct _mcp23017* next;
-} mcp23017_t;
+typedef struct _extended_gpio_batch {
+    adv_gpio_batch_t gpio_batch;
+    bool has_mcp23017;
+} extended_gpio_batch_t;
 
 typedef struct _led {
     uint16_t gpio;
@@ -333,18 +334,6 @@ typedef struct _led {
     TimerHandle_t timer;
 } led_t;
 
-typedef struct _timetable_action {
-    uint8_t action;
-    
-    uint8_t mon: 4;
-    uint8_t mday: 5;
-    uint8_t hour: 5;
-    uint8_t min: 6;
-    uint8_t wday: 4;    // 3 bits
-    
-    struct _timetable_action* next;
-} timetable_action_t;
-
 typedef struct _uart_receiver_data {
     uint8_t uart_port: 7;
     uint8_t uart_has_data: 1;
@@ -397,11 +386,11 @@ typedef struct _main_config {
     uint8_t rf_tx_gpio: 7;              // 7 bits
     bool enable_homekit_server: 1;
     
-    uint8_t timetable_last_minute: 6;   // 6 bits
     uint8_t wifi_mode: 3;               // 3 bits
     uint8_t ir_tx_freq: 7;              // 6 bits
     uint8_t wifi_arp_count;
     uint8_t wifi_arp_count_max;
+    uint8_t extended_gpio_burst;
     
     float ping_poll_period;
     
@@ -409,9 +398,15 @@ typedef struct _main_config {
     TimerHandle_t set_lightbulb_timer;
     
     SemaphoreHandle_t network_busy_mutex;
+    TaskHandle_t extended_gpio_burst_task;
+    QueueHandle_t temperature_queue;
+    
+    rs_slab_t action_task_slab;
+    rs_slab_t str_ch_value_slab;
     
     ch_group_t* ch_groups;
     ping_input_t* ping_inputs;
+    ds18b20_bus_t* ds18b20_buses;
     lightbulb_group_t* lightbulb_groups;
     last_state_t* last_states;
     
@@ -421,6 +416,8 @@ typedef struct _main_config {
     
     char* ntp_host;
     timetable_action_t* timetable_actions;
+    time_t timetable_last_time;
+    uint32_t timetable_last_tick;
     
     led_t* status_led;
     
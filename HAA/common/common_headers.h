@@ -11,6 +11,7 @@
 #ifdef ESP_PLATFORM
 
 #define TASK_SIZE_FACTOR                    (5)
+#define TASK_DRAM_FACTOR                    (1)     // Stack size is in bytes
 #define MAX_SETUP_BODY_LEN                  (70000)
 #define MAX_GPIOS                           (GPIO_NUM_MAX)
 
@@ -61,6 +62,7 @@
 #else   // ESP-OPEN-RTOS
 
 #define TASK_SIZE_FACTOR                    (1)
+#define TASK_DRAM_FACTOR                    (4)     // Stack size is in words
 #define MAX_SETUP_BODY_LEN                  (16500)
 #define MAX_GPIOS                           (17)
 
@@ -1,3 +1,12 @@
 #openssl sha384 -binary -out firmware/haa_lcm.bin.sig firmware/haa_lcm.bin; printf "%08x" `cat firmware/haa_lcm.bin | wc -c` | xxd -r -p >> firmware/haa_lcm.bin.sig
 
 ../../../../ecc_signer/ecc_signer --normal firmware/*.bin ../../../../ecc_signer/certs/priv_key.der ../../../../ecc_signer/certs/pub_key.der
+
+# HAAMAIN compressed image, downloaded first by Installer. Window and lookahead must match libs/heatshrink/heatshrink_config.h
+# Its .sec is the one of uncompressed image. heatshrink CLI is built with: make -C sdk/esp-open-rtos-rsf/extras/libesphttpd/libesphttpd/lib/heatshrink heatshrink
+HEATSHRINK=${HEATSHRINK:-heatshrink}
+for haamain in firmware/haamain*.bin; do
+    if [ -f "$haamain" ]; then
+        $HEATSHRINK -e -w 10 -l 5 "$haamain" "$haamain.hs"
+    fi
+done
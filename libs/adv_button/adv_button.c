@@ -27,12 +27,26 @@
 #define gpio_read(gpio)             gpio_get_level(gpio)
 #define gpio_write(gpio, level)     gpio_set_level(gpio, level)
 
+// Interrupts can run in other core, so they take spinlock too
+static portMUX_TYPE adv_button_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+#define ADV_BUTTON_ENTER_CRITICAL()         taskENTER_CRITICAL(&adv_button_spinlock)
+#define ADV_BUTTON_EXIT_CRITICAL()          taskEXIT_CRITICAL(&adv_button_spinlock)
+#define ADV_BUTTON_ENTER_CRITICAL_ISR()     taskENTER_CRITICAL_ISR(&adv_button_spinlock)
+#define ADV_BUTTON_EXIT_CRITICAL_ISR()      taskEXIT_CRITICAL_ISR(&adv_button_spinlock)
+
 #else
 
 #include <FreeRTOS.h>
+#include <task.h>
 #include <esplibs/libmain.h>
 #include <espressif/esp_common.h>
 
+#define ADV_BUTTON_ENTER_CRITICAL()         taskENTER_CRITICAL()
+#define ADV_BUTTON_EXIT_CRITICAL()          taskEXIT_CRITICAL()
+#define ADV_BUTTON_ENTER_CRITICAL_ISR()
+#define ADV_BUTTON_EXIT_CRITICAL_ISR()
+
 #endif
 
 #include <adv_i2c.h>
@@ -57,6 +71,9 @@
 
 #define DISABLE_TIME                        (ADV_BUTTON_DEFAULT_EVAL * 10)
 
+#define MCP_IDLE_POLL_CYCLES                (4)
+#define MCP_ACTIVE_TIME                     (DOUBLEPRESS_TIME)
+
 #define ADC_MID_VALUE                       (511)
 
 
@@ -81,12 +98,15 @@ typedef struct _adv_button {
     bool old_state: 1;              // 1 bit
     bool pulse_low_detected: 1;     // 1 bit
     uint16_t pulse_max_duration_time_us;
+    
+    volatile bool pending;          // Edge detected by interrupt, not evaluated yet
 
     TimerHandle_t press_timer;
     TimerHandle_t hold_timer;
     
     uint32_t last_event_time;
     uint32_t last_pulse_time_us;
+    volatile uint32_t edge_time;    // Ticks when last input edge was detected
     
     adv_button_callback_fn_t* singlepress0_callback_fn;
     adv_button_callback_fn_t* singlepress_callback_fn;
@@ -104,6 +124,9 @@ typedef struct _adv_button_mcp {
     uint8_t bus;
     uint8_t channels;
     
+    uint8_t snapshot_cycle;
+    uint16_t active_cycles;         // Cycles left to poll every evaluation
+    
     uint8_t* value;
     
     struct _adv_button_mcp* next;
@@ -112,11 +135,12 @@ typedef struct _adv_button_mcp {
 typedef struct _adv_button_main_config {
     uint32_t disable_time;
     
-    uint16_t button_evaluate_sleep_countdown;
-    uint16_t button_evaluate_sleep_time;
+    uint16_t mcp_active_cycles;
     
     uint8_t button_evaluate_delay;
     bool continuos_mode;    // 1 bit
+    uint8_t evaluate_cycle;
+    volatile bool evaluate_running;
     
     TimerHandle_t button_evaluate_timer;
 
@@ -155,14 +179,14 @@ static adv_button_mcp_t* mcp_find_by_index(const uint8_t index) {
 }
 
 static void adv_button_read_mcp_channels(adv_button_mcp_t* adv_button_mcp) {
-    if (adv_button_mcp->channels != MCP_CHANNEL_B) {
+    if (adv_button_mcp->channels == MCP_CHANNEL_BOTH) {
+        // GPIOA and GPIOB in one sequential read
         const uint8_t reg = 0x12;
-        adv_i2c_slave_read(adv_button_mcp->bus, adv_button_mcp->addr, &reg, 1, &adv_button_mcp->value[0], 1);
-    }
-    
-    if (adv_button_mcp->channels != MCP_CHANNEL_A) {
-        const uint8_t reg = 0x13;
-        adv_i2c_slave_read(adv_button_mcp->bus, adv_button_mcp->addr, &reg, 1, &adv_button_mcp->value[1], 1);
+        adv_i2c_slave_read(adv_button_mcp->bus, adv_button_mcp->addr, &reg, 1, adv_button_mcp->value, 2);
+        
+    } else {
+        const uint8_t reg = 0x12 + adv_button_mcp->channels;
+        adv_i2c_slave_read(adv_button_mcp->bus, adv_button_mcp->addr, &reg, 1, &adv_button_mcp->value[adv_button_mcp->channels], 1);
     }
 }
 
@@ -191,6 +215,23 @@ static void adv_button_read_shift_register(adv_button_mcp_t* adv_button_mcp) {
     }
 }
 
+// Inputs are read only one time per evaluation cycle, and all buttons share same snapshot
+static void adv_button_update_mcp_snapshot(adv_button_mcp_t* adv_button_mcp) {
+    if (adv_button_mcp->snapshot_cycle != adv_button_main_config->evaluate_cycle) {
+        adv_button_mcp->snapshot_cycle = adv_button_main_config->evaluate_cycle;
+        
+        if (adv_button_mcp->bus < 100) {    // MCP23017
+            adv_button_read_mcp_channels(adv_button_mcp);
+        } else {    // Shift Register
+            adv_button_read_shift_register(adv_button_mcp);
+        }
+    }
+}
+
+static void adv_button_invalidate_mcp_snapshot(adv_button_mcp_t* adv_button_mcp) {
+    adv_button_mcp->snapshot_cycle = adv_button_main_config->evaluate_cycle - 1;
+}
+
 int adv_button_read_by_gpio(const uint16_t gpio) {
     unsigned int result = false;
     
@@ -224,35 +265,35 @@ static void adv_button_run_callback_fn(adv_button_callback_fn_t* callbacks, cons
     }
 }
 
-static inline void push_down(const uint16_t used_gpio) {
+// Press times are measured between input edges, so they do not depend on evaluation delay
+static inline void push_down(adv_button_t* button) {
     const uint32_t now = xTaskGetTickCount();
     
     if ((now - adv_button_main_config->disable_time) > (DISABLE_TIME / portTICK_PERIOD_MS)) {
-        adv_button_t *button = button_find_by_gpio(used_gpio);
         if (button->singlepress0_callback_fn) {
             adv_button_run_callback_fn(button->singlepress0_callback_fn, button->gpio);
         }
 
         rs_esp_timer_start(button->hold_timer);
 
-        button->last_event_time = now;
+        button->last_event_time = button->edge_time;
     }
 }
 
-static inline void push_up(const uint16_t used_gpio) {
+static inline void push_up(adv_button_t* button) {
     const uint32_t now = xTaskGetTickCount();
     
     if ((now - adv_button_main_config->disable_time) > (DISABLE_TIME / portTICK_PERIOD_MS)) {
-        adv_button_t *button = button_find_by_gpio(used_gpio);
-        
         if (button->press_count == DISABLE_PRESS_COUNT) {
             button->press_count = 0;
             return;
         }
         
         rs_esp_timer_stop(button->hold_timer);
+        
+        const uint32_t press_time = button->edge_time - button->last_event_time;
 
-        if ((now - button->last_event_time) > (VERYLONGPRESS_TIME / portTICK_PERIOD_MS)) {
+        if (press_time > (VERYLONGPRESS_TIME / portTICK_PERIOD_MS)) {
             // Very Long button pressed
             button->press_count = 0;
             if (button->verylongpress_callback_fn) {
@@ -262,7 +303,7 @@ static inline void push_up(const uint16_t used_gpio) {
             } else {
                 adv_button_run_callback_fn(button->singlepress_callback_fn, button->gpio);
             }
-        } else if ((now - button->last_event_time) > (LONGPRESS_TIME / portTICK_PERIOD_MS)) {
+        } else if (press_time > (LONGPRESS_TIME / portTICK_PERIOD_MS)) {
             // Long button pressed
             button->press_count = 0;
             if (button->longpress_callback_fn) {
@@ -300,6 +341,23 @@ static inline void adv_button_hold_callback(TimerHandle_t xTimer) {
     adv_button_run_callback_fn(button->holdpress_callback_fn, button->gpio);
 }
 
+static void IRAM adv_button_wake_from_isr() {
+    if (!adv_button_main_config->continuos_mode && !adv_button_main_config->evaluate_running) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        if (xTimerStartFromISR(adv_button_main_config->button_evaluate_timer, &xHigherPriorityTaskWoken) == pdPASS) {
+            adv_button_main_config->evaluate_running = true;
+        }
+        
+#ifdef ESP_PLATFORM
+        if (xHigherPriorityTaskWoken != pdFALSE) {
+            portYIELD_FROM_ISR();
+        }
+#else
+        portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+#endif
+    }
+}
+
 #ifdef ESP_PLATFORM
 static void IRAM_ATTR adv_button_interrupt_pulse(void* args) {
     const uint8_t gpio = (uint32_t) args;
@@ -308,6 +366,12 @@ static void IRAM adv_button_interrupt_pulse(const uint8_t gpio) {
 #endif
     
     adv_button_t *button = button_find_by_gpio(gpio);
+    ADV_BUTTON_ENTER_CRITICAL_ISR();
+    button->pending = true;
+    ADV_BUTTON_EXIT_CRITICAL_ISR();
+    
+    adv_button_wake_from_isr();
+    
     if (button->pulse_max_duration_time_us == 0) {
         if (button->value < button->max_eval) {
             button->value++;
@@ -352,104 +416,140 @@ static void IRAM_ATTR adv_button_interrupt_normal(void* args) {
 #else
 static void IRAM adv_button_interrupt_normal(const uint8_t gpio) {
 #endif
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    if (xTimerStartFromISR(adv_button_main_config->button_evaluate_timer, &xHigherPriorityTaskWoken) == pdPASS) {
-        adv_button_t* button = adv_button_main_config->buttons;
-        while (button) {
-#ifdef ESP_PLATFORM
-            gpio_intr_disable(gpio);
-#else
-            gpio_set_interrupt(button->gpio, GPIO_INTTYPE_NONE, NULL);
-#endif
-            button = button->next;
-        }
-    }
+    adv_button_t* button = button_find_by_gpio(gpio);
+    button->edge_time = xTaskGetTickCountFromISR();
+    ADV_BUTTON_ENTER_CRITICAL_ISR();
+    button->pending = true;
+    ADV_BUTTON_EXIT_CRITICAL_ISR();
     
-#ifdef ESP_PLATFORM
-    if (xHigherPriorityTaskWoken != pdFALSE) {
-        portYIELD_FROM_ISR();
+    adv_button_wake_from_isr();
+}
+
+static void adv_button_poll_mcp(adv_button_mcp_t* adv_button_mcp) {
+    if (adv_button_mcp->active_cycles > 0) {
+        adv_button_mcp->active_cycles--;
+        adv_button_update_mcp_snapshot(adv_button_mcp);
+        
+    } else if ((adv_button_main_config->evaluate_cycle % MCP_IDLE_POLL_CYCLES) == 0) {
+        adv_button_update_mcp_snapshot(adv_button_mcp);
     }
-#else
-    portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
-#endif
 }
 
-static void button_evaluate_fn() {
-    if (!adv_button_main_config->continuos_mode) {
-        if (adv_button_main_config->button_evaluate_sleep_countdown < adv_button_main_config->button_evaluate_sleep_time) {
-            adv_button_main_config->button_evaluate_sleep_countdown++;
-            
-        } else if (rs_esp_timer_stop(adv_button_main_config->button_evaluate_timer) == pdPASS) {
-            adv_button_main_config->button_evaluate_sleep_countdown = 0;
-            adv_button_t* button = adv_button_main_config->buttons;
-            while (button) {
-#ifdef ESP_PLATFORM
-                gpio_intr_enable(button->gpio);
-#else
-                gpio_set_interrupt(button->gpio, GPIO_INTTYPE_EDGE_ANY, adv_button_interrupt_normal);
-#endif
-                button = button->next;
-            }
-        }
+static bool adv_button_is_settled(adv_button_t* button) {
+    if (button->state) {
+        return (button->value == button->max_eval);
     }
     
+    return (button->value == 0);
+}
+
+static void button_evaluate_fn() {
+    const uint32_t now = xTaskGetTickCount();
+    unsigned int active_buttons = 0;
+    
+    adv_button_main_config->evaluate_cycle++;
+    
+    // Idle expanders are polled at lower rate
     adv_button_mcp_t* adv_button_mcp = adv_button_main_config->mcps;
     while (adv_button_mcp) {
-        if (adv_button_mcp->bus < 100) {    // MCP23017
-            adv_button_read_mcp_channels(adv_button_mcp);
-        } else {    // Shift Register
-            adv_button_read_shift_register(adv_button_mcp);
-        }
-        
+        adv_button_poll_mcp(adv_button_mcp);
         adv_button_mcp = adv_button_mcp->next;
     }
     
     adv_button_t* button = adv_button_main_config->buttons;
     while (button) {
         if (button->mode != ADV_BUTTON_PULSE_MODE) {
-            unsigned int read_value;
+            unsigned int has_interrupt = false;
+            unsigned int must_evaluate = true;
+            adv_button_mcp = NULL;
             
             if (button->mode == ADV_BUTTON_NORMAL_MODE) {
 #ifdef ESP_PLATFORM
-                read_value = gpio_read(button->gpio);
+                has_interrupt = !adv_button_main_config->continuos_mode;
 #else
-                if (button->gpio <= 16) {
-                    read_value = gpio_read(button->gpio);
-                } else {    // gpio == 17   (ESP8266 ADC pin)
-                    read_value = (sdk_system_adc_read() > ADC_MID_VALUE);
-                }
+                has_interrupt = (!adv_button_main_config->continuos_mode && button->gpio <= 16);
 #endif
+                
+                if (has_interrupt) {
+                    // Read and cleared at once, so an edge arriving meanwhile is not lost
+                    ADV_BUTTON_ENTER_CRITICAL();
+                    const bool pending = button->pending;
+                    button->pending = false;
+                    ADV_BUTTON_EXIT_CRITICAL();
+                    
+                    // Only buttons with pending edges or not settled yet are evaluated
+                    if (!pending && adv_button_is_settled(button)) {
+                        must_evaluate = false;
+                    }
+                }
+                
             } else {    // MCP23017
-                read_value = adv_button_read_mcp_gpio(button->gpio);
+                adv_button_mcp = mcp_find_by_index(button->gpio / 100);
+                if (!adv_button_mcp || adv_button_mcp->snapshot_cycle != adv_button_main_config->evaluate_cycle) {
+                    must_evaluate = false;
+                }
             }
             
-            if (read_value) {
-                if (button->state) {
-                    button->value = button->max_eval;
-                } else {
-                    if (button->value < button->max_eval) {
-                        button->value++;
-                    }
-                    
-                    if (button->value == button->max_eval) {
-                        button->state = true;
+            if (must_evaluate) {
+                unsigned int read_value;
+                
+                if (button->mode == ADV_BUTTON_NORMAL_MODE) {
+#ifdef ESP_PLATFORM
+                    read_value = gpio_read(button->gpio);
+#else
+                    if (button->gpio <= 16) {
+                        read_value = gpio_read(button->gpio);
+                    } else {    // gpio == 17   (ESP8266 ADC pin)
+                        read_value = (sdk_system_adc_read() > ADC_MID_VALUE);
                     }
+#endif
+                } else {    // MCP23017
+                    read_value = adv_button_read_mcp_gpio(button->gpio);
                 }
-            } else {
-                if (!button->state) {
-                    button->value = 0;
+                
+                // Polled inputs get their edge time from first different read
+                if (!has_interrupt && read_value != button->state && adv_button_is_settled(button)) {
+                    button->edge_time = now;
+                }
+                
+                if (read_value) {
+                    if (button->state) {
+                        button->value = button->max_eval;
+                    } else {
+                        if (button->value < button->max_eval) {
+                            button->value++;
+                        }
+                        
+                        if (button->value == button->max_eval) {
+                            button->state = true;
+                        }
+                    }
                 } else {
-                    if (button->value > 0) {
-                        button->value--;
+                    if (!button->state) {
+                        button->value = 0;
+                    } else {
+                        if (button->value > 0) {
+                            button->value--;
+                        }
+                        
+                        if (button->value == 0) {
+                            button->state = false;
+                        }
                     }
+                }
+                
+                if (!adv_button_is_settled(button) || button->state != button->old_state) {
+                    active_buttons++;
                     
-                    if (button->value == 0) {
-                        button->state = false;
+                    if (adv_button_mcp) {
+                        adv_button_mcp->active_cycles = adv_button_main_config->mcp_active_cycles;
                     }
                 }
             }
             
         } else {    // button->mode == ADV_BUTTON_PULSE_MODE
+            button->pending = false;
+            
             unsigned int my_button_value = button->value;
             if (button->pulse_max_duration_time_us == 0) {
                 if (my_button_value == button->max_eval) {
@@ -475,21 +575,47 @@ static void button_evaluate_fn() {
             }
             
             button->value = my_button_value;
+            
+            if (my_button_value > 0 || button->state) {
+                active_buttons++;
+            }
+            
+            button->edge_time = now;
         }
         
         if (button->state != button->old_state) {
             button->old_state = button->state;
-            adv_button_main_config->button_evaluate_sleep_countdown = 0;
             
             if (button->state ^ button->inverted) {     // 1 HIGH
-                push_up(button->gpio);
+                push_up(button);
             } else {                                    // 0 LOW
-                push_down(button->gpio);
+                push_down(button);
             }
         }
         
         button = button->next;
     }
+    
+    // Without continuous mode, evaluation runs only while there are active buttons
+    if (!adv_button_main_config->continuos_mode && active_buttons == 0) {
+        if (rs_esp_timer_stop(adv_button_main_config->button_evaluate_timer) == pdPASS) {
+            adv_button_main_config->evaluate_running = false;
+            
+            // An edge could arrive before evaluate_running was cleared
+            button = adv_button_main_config->buttons;
+            while (button) {
+                if (button->pending) {
+                    if (rs_esp_timer_start(adv_button_main_config->button_evaluate_timer) == pdPASS) {
+                        adv_button_main_config->evaluate_running = true;
+                    }
+                    
+                    break;
+                }
+                
+                button = button->next;
+            }
+        }
+    }
 }
 
 void adv_button_init(const uint16_t new_delay_ms, const bool continuos_mode) {
@@ -508,7 +634,7 @@ void adv_button_init(const uint16_t new_delay_ms, const bool continuos_mode) {
             adv_button_main_config->button_evaluate_delay = new_delay;
         }
         
-        adv_button_main_config->button_evaluate_sleep_time = ((HOLDPRESS_TIME + 1000) / portTICK_PERIOD_MS) / adv_button_main_config->button_evaluate_delay;
+        adv_button_main_config->mcp_active_cycles = (MCP_ACTIVE_TIME / portTICK_PERIOD_MS) / adv_button_main_config->button_evaluate_delay;
         adv_button_main_config->button_evaluate_timer = rs_esp_timer_create(adv_button_main_config->button_evaluate_delay * portTICK_PERIOD_MS, pdTRUE, NULL, button_evaluate_fn);
         
         adv_button_main_config->continuos_mode = continuos_mode;
@@ -547,6 +673,8 @@ static adv_button_mcp_t* private_adv_button_new_mcp_data(const uint8_t index, co
     
     adv_button_mcp->value = malloc(len * sizeof(uint8_t));
     
+    adv_button_invalidate_mcp_snapshot(adv_button_mcp);
+    
     return adv_button_mcp;
 }
 
@@ -653,18 +781,15 @@ int adv_button_create(const uint16_t gpio, const bool inverted, const uint8_t mo
                     adv_button_mcp->channels = MCP_CHANNEL_B;
                 }
                 
-                adv_button_read_mcp_channels(adv_button_mcp);
-                
             } else if (adv_button_mcp->bus < 100) {
                 if ((adv_button_mcp->channels == MCP_CHANNEL_A && mcp_gpio >= 8) || (adv_button_mcp->channels == MCP_CHANNEL_B && mcp_gpio < 8)) {
                     adv_button_mcp->channels = MCP_CHANNEL_BOTH;
-                    adv_button_read_mcp_channels(adv_button_mcp);
+                    adv_button_invalidate_mcp_snapshot(adv_button_mcp);
                 }
-                
-            } else {    // Shift Register
-                adv_button_read_shift_register(adv_button_mcp);
             }
             
+            adv_button_update_mcp_snapshot(adv_button_mcp);
+            
             button->state = adv_button_read_mcp_gpio(gpio);
             button->old_state = button->state;
             
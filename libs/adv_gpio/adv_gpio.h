@@ -0,0 +1,100 @@
+/*
+ * Advanced GPIO Batch Writer
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifndef __ADV_GPIO_H__
+#define __ADV_GPIO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+typedef uint64_t adv_gpio_mask_t;
+
+#else
+
+#include <esp8266.h>
+
+typedef uint32_t adv_gpio_mask_t;
+
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADV_GPIO_MASK(gpio)                 (((adv_gpio_mask_t) 1) << (gpio))
+
+typedef struct _adv_gpio_batch {
+    adv_gpio_mask_t set_mask;
+    adv_gpio_mask_t clear_mask;
+} adv_gpio_batch_t;
+
+#define ADV_GPIO_BATCH_INIT                 { .set_mask = 0, .clear_mask = 0 }
+
+/*
+ * Writes all masked GPIOs at once using output set/clear registers.
+ * Safe to be used from interrupts.
+ */
+static inline __attribute__((always_inline)) void adv_gpio_write_mask(const adv_gpio_mask_t set_mask, const adv_gpio_mask_t clear_mask) {
+#ifdef ESP_PLATFORM
+    if ((uint32_t) set_mask) {
+        REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t) set_mask);
+    }
+    if ((uint32_t) clear_mask) {
+        REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t) clear_mask);
+    }
+    
+#ifdef GPIO_OUT1_W1TS_REG
+    if (set_mask >> 32) {
+        REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t) (set_mask >> 32));
+    }
+    if (clear_mask >> 32) {
+        REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t) (clear_mask >> 32));
+    }
+#endif
+    
+#else
+    GPIO.OUT_SET = set_mask & GPIO_OUT_PIN_MASK;
+    GPIO.OUT_CLEAR = clear_mask & GPIO_OUT_PIN_MASK;
+    
+    // GPIO16 is not in GPIO registers
+    if ((set_mask | clear_mask) & ADV_GPIO_MASK(16)) {
+        gpio_write(16, set_mask & ADV_GPIO_MASK(16));
+    }
+#endif
+}
+
+static inline void adv_gpio_batch_write(adv_gpio_batch_t* adv_gpio_batch, const uint8_t gpio, const bool value) {
+    const adv_gpio_mask_t gpio_mask = ADV_GPIO_MASK(gpio);
+    
+    if (value) {
+        adv_gpio_batch->set_mask |= gpio_mask;
+        adv_gpio_batch->clear_mask &= ~gpio_mask;
+    } else {
+        adv_gpio_batch->clear_mask |= gpio_mask;
+        adv_gpio_batch->set_mask &= ~gpio_mask;
+    }
+}
+
+static inline void adv_gpio_batch_commit(adv_gpio_batch_t* adv_gpio_batch) {
+    if (adv_gpio_batch->set_mask || adv_gpio_batch->clear_mask) {
+        adv_gpio_write_mask(adv_gpio_batch->set_mask, adv_gpio_batch->clear_mask);
+        
+        adv_gpio_batch->set_mask = 0;
+        adv_gpio_batch->clear_mask = 0;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ADV_GPIO_H__
@@ -0,0 +1,5 @@
+# Component makefile for adv_gpio (header only)
+
+adv_gpio_ROOT := $(dir $(lastword $(MAKEFILE_LIST)))
+
+INC_DIRS += $(adv_gpio_ROOT)
@@ -21,6 +21,11 @@
 
 #define sdk_system_get_time_raw()           ((uint32_t) esp_timer_get_time())
 
+static portMUX_TYPE adv_logger_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+#define ADV_LOGGER_ENTER_CRITICAL()         taskENTER_CRITICAL(&adv_logger_spinlock)
+#define ADV_LOGGER_EXIT_CRITICAL()          taskEXIT_CRITICAL(&adv_logger_spinlock)
+
 #else
 
 #include <espressif/esp_wifi.h>
@@ -34,6 +39,9 @@
 #include <stdout_redirect.h>
 #include <semphr.h>
 
+#define ADV_LOGGER_ENTER_CRITICAL()         taskENTER_CRITICAL()
+#define ADV_LOGGER_EXIT_CRITICAL()          taskEXIT_CRITICAL()
+
 #endif
 
 #include <lwip/err.h>
@@ -44,20 +52,43 @@
 
 #define HEADER_LEN                          (23)
 #define UDP_LOG_LEN                         (1400)
+#define LOG_TIME_LEN                        (9)
+
+// Ring buffer size must be a power of 2
+#ifdef ESP_PLATFORM
+#define ADV_LOGGER_RING_SIZE                (4096)
+#else
+#define ADV_LOGGER_RING_SIZE                (1024)
+#endif
+#define ADV_LOGGER_RING_MASK                (ADV_LOGGER_RING_SIZE - 1)
+
+// Each write is stored as a record: 2 bytes header with payload length, 4 bytes with line time
+// only if header has ADV_LOGGER_RECORD_TIME flag, and payload. Payload bytes are never parsed as records
+#define ADV_LOGGER_RECORD_TIME              (0x8000)
+#define ADV_LOGGER_RECORD_LEN_MASK          (0x7FFF)
+#define ADV_LOGGER_RECORD_HEADER_LEN        (sizeof(uint16_t))
+#define ADV_LOGGER_RECORD_MAX_LEN           (ADV_LOGGER_RING_SIZE / 2)
+
+// Longest time adv_logger_flush() waits for drain task to empty ring
+#define ADV_LOGGER_FLUSH_WAIT_MS            (2000)
+
+#define ADV_LOGGER_DRAIN_PERIOD_MS          (20)
+#define ADV_LOGGER_UDP_BUFFERED_PERIODS     (8)
 
 // Task Stack Size
 #ifdef ESP_PLATFORM
 #define ADV_LOGGER_INIT_TASK_SIZE           (2048)
-#define ADV_LOGGER_BUFFERED_TASK_SIZE       (2048)
+#define ADV_LOGGER_DRAIN_TASK_SIZE          (2048)
 #define ADV_LOGGER_VSNPRINTF_BUFFER_SIZE    (2048)
+#define ADV_LOGGER_VSNPRINTF_STACK_SIZE     (128)
 #else
 #define ADV_LOGGER_INIT_TASK_SIZE           (configMINIMAL_STACK_SIZE)  // 256
-#define ADV_LOGGER_BUFFERED_TASK_SIZE       (configMINIMAL_STACK_SIZE)  // 256
+#define ADV_LOGGER_DRAIN_TASK_SIZE          (configMINIMAL_STACK_SIZE)  // 256
 #endif
 
 // Task Priority
 #define ADV_LOGGER_INIT_TASK_PRIORITY       (tskIDLE_PRIORITY + 0)
-#define ADV_LOGGER_BUFFERED_TASK_PRIORITY   (configMAX_PRIORITIES - 1)
+#define ADV_LOGGER_DRAIN_TASK_PRIORITY      (tskIDLE_PRIORITY + 1)
 
 #define ADV_LOGGER_ADDRESS                  "255.255.255.255"
 #define ADV_LOGGER_PORT                     "45678"
@@ -70,128 +101,254 @@ typedef struct _adv_logger_data {
     
 #ifdef ESP_PLATFORM
     char* ip_address;
-    SemaphoreHandle_t log_sender_semaphore;
 #endif
 
-    int8_t log_type: 4;
-    uint16_t udplogstring_len: 11;
-    uint16_t udplogstring_size: 11;
-    bool is_new_line: 1;
-    bool ready_to_send: 1;
-    bool close_buffered_task: 1;
+    uint16_t udplogstring_len;
+    
+    bool is_new_line;               // Producers side
+    bool drain_is_new_line;         // Drain task side
+    volatile bool ready_to_send;
+    volatile bool close_buffered_task;
     
     TaskHandle_t xHandle;
     
+    char* ring;
+    volatile uint32_t ring_head;    // Only written by producers
+    volatile uint32_t ring_tail;    // Only written by drain task
+    volatile uint32_t dropped;      // Bytes discarded because ring was full
+    uint32_t dropped_reported;
+    
+    uint32_t line_time;
+    
     struct addrinfo* res;
 } adv_logger_data_t;
 
 static adv_logger_data_t* adv_logger_data = NULL;
 
-static ssize_t adv_logger_write(struct _reent* r, int fd, const void* ptr, size_t len) {
+static void adv_logger_ring_copy(const uint32_t position, const void* data, const size_t len) {
+    const size_t offset = position & ADV_LOGGER_RING_MASK;
+    size_t first_len = ADV_LOGGER_RING_SIZE - offset;
+    if (first_len > len) {
+        first_len = len;
+    }
+    
+    memcpy(&adv_logger_data->ring[offset], data, first_len);
+    memcpy(adv_logger_data->ring, ((const char*) data) + first_len, len - first_len);
+}
+
+// Flush can wait for drain task only from a task, with scheduler running and interrupts enabled
+static bool adv_logger_can_wait() {
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING || xTaskGetCurrentTaskHandle() == adv_logger_data->xHandle) {
+        return false;
+    }
+    
 #ifdef ESP_PLATFORM
-    if (xSemaphoreTake(adv_logger_data->log_sender_semaphore, 0) == pdTRUE) {
+    return xPortCanYield();
+#else
+    uint32_t ps;
+    asm volatile("rsr %0, ps" : "=a" (ps));
+    return (ps & 0x0F) == 0;
 #endif
-        int is_adv_logger_data = false;
-        if (adv_logger_data->ready_to_send) {
-            is_adv_logger_data = true;
+}
+
+// Writers never wait: when ring is full, record is discarded and counted. Only adv_logger_flush() waits for drain task
+static void adv_logger_write_record(const char* data, const size_t len) {
+    uint8_t record_header[ADV_LOGGER_RECORD_HEADER_LEN + sizeof(uint32_t)];
+    const uint32_t now = sdk_system_get_time_raw();
+    memcpy(&record_header[ADV_LOGGER_RECORD_HEADER_LEN], &now, sizeof(uint32_t));
+    
+    ADV_LOGGER_ENTER_CRITICAL();
+    
+    uint16_t record_info = len;
+    size_t record_header_len = ADV_LOGGER_RECORD_HEADER_LEN;
+    if (adv_logger_data->is_new_line) {
+        record_info |= ADV_LOGGER_RECORD_TIME;
+        record_header_len += sizeof(uint32_t);
+    }
+    memcpy(record_header, &record_info, ADV_LOGGER_RECORD_HEADER_LEN);
+    
+    const uint32_t head = adv_logger_data->ring_head;
+    if ((head - adv_logger_data->ring_tail) + record_header_len + len <= ADV_LOGGER_RING_SIZE) {
+        adv_logger_ring_copy(head, record_header, record_header_len);
+        adv_logger_ring_copy(head + record_header_len, data, len);
+        adv_logger_data->ring_head = head + record_header_len + len;
+        adv_logger_data->is_new_line = (data[len - 1] == '\n');
+        
+    } else {
+        adv_logger_data->dropped += len;
+    }
+    
+    ADV_LOGGER_EXIT_CRITICAL();
+}
+
+// Producers only copy data to ring buffer. Formatting and output are done by drain task
+static ssize_t adv_logger_write(struct _reent* r, int fd, const void* ptr, size_t len) {
+    size_t written = 0;
+    while (written < len) {
+        size_t record_len = len - written;
+        if (record_len > ADV_LOGGER_RECORD_MAX_LEN) {
+            record_len = ADV_LOGGER_RECORD_MAX_LEN;
         }
         
-        for (size_t i = 0; i < len; i++) {
-            // Auto convert CR to CRLF, ignore other LFs (compatible with Espressif SDK behaviour)
-            if (((char*) ptr)[i] == '\r') {
-                continue;
-            }
-            
-            if (adv_logger_data->udplogstring_len > (UDP_LOG_LEN - 35 - 1)) {
-                is_adv_logger_data = false;
-            }
-            
-            if (((char*) ptr)[i] == '\n') {
-#ifdef ESP_PLATFORM
-                char new_line_char = '\r';
-                uart_write_bytes(0, &new_line_char, 1);
-#else
-                uart_putc(0, '\r');
-#endif
-                
-                if (adv_logger_data->ready_to_send && is_adv_logger_data && adv_logger_data->udplogstring) {
-                    adv_logger_data->udplogstring[adv_logger_data->udplogstring_len] = '\r';
-                    adv_logger_data->udplogstring_len++;
-                }
-            }
-            
+        adv_logger_write_record(((const char*) ptr) + written, record_len);
+        written += record_len;
+    }
+    
+    return len;
+}
+
+static void adv_logger_uart_output(const char* data, const size_t len) {
 #ifdef ESP_PLATFORM
-            uart_write_bytes(0, &((char*) ptr)[i], 1);
+    uart_write_bytes(0, data, len);
 #else
-            uart_putc(0, ((char*) ptr)[i]);
+    for (size_t i = 0; i < len; i++) {
+        while (uart_putc_nowait(0, data[i]) < 0) {
+            vTaskDelay(1);
+        }
+    }
 #endif
+}
+
+static void adv_logger_udp_send() {
+    if (adv_logger_data->udplogstring_len > 0) {
+        lwip_sendto(adv_logger_data->socket, adv_logger_data->udplogstring, adv_logger_data->udplogstring_len, 0, adv_logger_data->res->ai_addr, adv_logger_data->res->ai_addrlen);
+        adv_logger_data->udplogstring_len = 0;
+    }
+}
+
+static void adv_logger_udp_output(const char* data, const size_t len) {
+    if (adv_logger_data->ready_to_send && len <= UDP_LOG_LEN) {
+        if (adv_logger_data->udplogstring_len + len > UDP_LOG_LEN) {
+            adv_logger_udp_send();
+        }
+        
+        memcpy(&adv_logger_data->udplogstring[adv_logger_data->udplogstring_len], data, len);
+        adv_logger_data->udplogstring_len += len;
+    }
+}
+
+static void adv_logger_output(const char* data, const size_t len) {
+    adv_logger_uart_output(data, len);
+    adv_logger_udp_output(data, len);
+}
+
+static void adv_logger_output_line_header() {
+    const uint32_t dropped = adv_logger_data->dropped;
+    if (dropped != adv_logger_data->dropped_reported) {
+        char dropped_msg[40];
+        const int dropped_msg_len = snprintf(dropped_msg, sizeof(dropped_msg), "! Log dropped %u bytes\r\n", (unsigned int) (dropped - adv_logger_data->dropped_reported));
+        adv_logger_data->dropped_reported = dropped;
+        adv_logger_output(dropped_msg, dropped_msg_len);
+    }
+    
+    // Line header is only sent by UDP
+    if (adv_logger_data->ready_to_send) {
+        char log_time[LOG_TIME_LEN + 1];
+        const uint32_t line_time_ms = adv_logger_data->line_time / 1000;
+        snprintf(log_time, LOG_TIME_LEN + 1, "%04u.%03u ", (unsigned int) (line_time_ms / 1000) % 10000, (unsigned int) (line_time_ms % 1000));
+        
+        adv_logger_udp_output(log_time, LOG_TIME_LEN);
+        adv_logger_udp_output(adv_logger_data->header, strlen(adv_logger_data->header));
+        adv_logger_udp_output(": ", 2);
+    }
+}
+
+static void adv_logger_ring_read(const uint32_t position, void* data, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        ((uint8_t*) data)[i] = adv_logger_data->ring[(position + i) & ADV_LOGGER_RING_MASK];
+    }
+}
+
+static void adv_logger_drain() {
+    const char* ring = adv_logger_data->ring;
+    uint32_t tail = adv_logger_data->ring_tail;
+    
+    // Records are always written complete
+    while (tail != adv_logger_data->ring_head) {
+        uint16_t record_info;
+        adv_logger_ring_read(tail, &record_info, ADV_LOGGER_RECORD_HEADER_LEN);
+        tail += ADV_LOGGER_RECORD_HEADER_LEN;
+        
+        if (record_info & ADV_LOGGER_RECORD_TIME) {
+            uint32_t line_time;
+            adv_logger_ring_read(tail, &line_time, sizeof(uint32_t));
+            adv_logger_data->line_time = line_time;
+            tail += sizeof(uint32_t);
+        }
+        
+        size_t len = record_info & ADV_LOGGER_RECORD_LEN_MASK;
+        while (len > 0) {
+            const char* data = &ring[tail & ADV_LOGGER_RING_MASK];
+            size_t run = 1;
             
-            if (adv_logger_data->ready_to_send && is_adv_logger_data && adv_logger_data->udplogstring) {
-                if (adv_logger_data->is_new_line) {
-                    adv_logger_data->is_new_line = false;
-                    adv_logger_data->udplogstring[adv_logger_data->udplogstring_len] = 0;
-                    char buffer[10];
-                    snprintf(buffer, 10, "%08.3f ", (float) sdk_system_get_time_raw() * 1e-6);
-                    strcat(strcat(strcat(adv_logger_data->udplogstring, buffer), adv_logger_data->header), ": ");
-                    adv_logger_data->udplogstring_len = strlen(adv_logger_data->udplogstring);
-                }
+            if (data[0] == '\r') {
+                // Auto convert CR to CRLF, ignore other LFs (compatible with Espressif SDK behaviour)
                 
-                adv_logger_data->udplogstring[adv_logger_data->udplogstring_len] = ((char*) ptr)[i];
-                adv_logger_data->udplogstring_len++;
+            } else {
+                if (adv_logger_data->drain_is_new_line) {
+                    adv_logger_data->drain_is_new_line = false;
+                    adv_logger_output_line_header();
+                }
                 
-                if (((char*) ptr)[i] == '\n') {
-                    adv_logger_data->is_new_line = true;
+                if (data[0] == '\n') {
+                    adv_logger_output("\r\n", 2);
+                    adv_logger_data->drain_is_new_line = true;
+                    
+                } else {
+                    // Longest run of plain chars without wrapping around ring end
+                    size_t run_max = len;
+                    if (run_max > ADV_LOGGER_RING_SIZE - (tail & ADV_LOGGER_RING_MASK)) {
+                        run_max = ADV_LOGGER_RING_SIZE - (tail & ADV_LOGGER_RING_MASK);
+                    }
+                    
+                    while (run < run_max && data[run] != '\n' && data[run] != '\r') {
+                        run++;
+                    }
+                    
+                    adv_logger_output(data, run);
                 }
             }
+            
+            tail += run;
+            len -= run;
         }
         
-#ifdef ESP_PLATFORM
-        xSemaphoreGive(adv_logger_data->log_sender_semaphore);
-#endif
-        
-        return len;
-        
-#ifdef ESP_PLATFORM
+        adv_logger_data->ring_tail = tail;
     }
-    
-    return 0;
-#endif
 }
 
-static void adv_logger_buffered_task() {
+static void adv_logger_drain_task() {
     unsigned int i = 0;
     
     for (;;) {
-        i++;
+        adv_logger_drain();
         
-        if ((i == 8 && adv_logger_data->udplogstring_len > 0) || adv_logger_data->udplogstring_len > (UDP_LOG_LEN / 2)) {
-            adv_logger_data->ready_to_send = false;
-            lwip_sendto(adv_logger_data->socket, adv_logger_data->udplogstring, adv_logger_data->udplogstring_len, 0, adv_logger_data->res->ai_addr, adv_logger_data->res->ai_addrlen);
-            adv_logger_data->udplogstring_len = 0;
-            adv_logger_data->ready_to_send = true;
+        if (adv_logger_data->ready_to_send) {
+            i++;
             
-            i = 0;
+            if (i >= ADV_LOGGER_UDP_BUFFERED_PERIODS || adv_logger_data->udplogstring_len > (UDP_LOG_LEN / 2)) {
+                adv_logger_udp_send();
+                i = 0;
+            }
             
-        } else if (i == 8) {
-            i = 0;
+            if (adv_logger_data->close_buffered_task) {
+                // Only UDP output is closed. UART output is still drained
+                adv_logger_data->ready_to_send = false;
+                free(adv_logger_data->udplogstring);
+                adv_logger_data->udplogstring = NULL;
+            }
         }
         
-        vTaskDelay(20 / portTICK_PERIOD_MS);
-        
-        if (adv_logger_data->close_buffered_task
-#ifdef ESP_PLATFORM
-        && xSemaphoreTake(adv_logger_data->log_sender_semaphore, 100 / portTICK_PERIOD_MS) == pdTRUE
-#endif
-        ) {
-            
-            free(adv_logger_data->udplogstring);
-            adv_logger_data->udplogstring = NULL;
-            
-#ifdef ESP_PLATFORM
-            xSemaphoreGive(adv_logger_data->log_sender_semaphore);
-#endif
-            
-            vTaskDelete(NULL);
+        vTaskDelay(ADV_LOGGER_DRAIN_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+}
+
+void adv_logger_flush() {
+    if (adv_logger_data && adv_logger_can_wait()) {
+        unsigned int waited_ms = 0;
+        while (adv_logger_data->ring_tail != adv_logger_data->ring_head && waited_ms < ADV_LOGGER_FLUSH_WAIT_MS) {
+            vTaskDelay(1);
+            waited_ms += portTICK_PERIOD_MS;
         }
     }
 }
@@ -232,15 +389,15 @@ static void adv_logger_init_task(void* args) {
         vTaskDelay(200 / portTICK_PERIOD_MS);
     }
     
-    adv_logger_data->udplogstring = calloc(1, UDP_LOG_LEN);
-    
-    strcat(adv_logger_data->udplogstring, "\r\nAdv Log (c) 2022-2026 José A. Jiménez Campos\r\n\r\n");
-    adv_logger_data->udplogstring_len = strlen(adv_logger_data->udplogstring);
-
-    xTaskCreate(adv_logger_buffered_task, "LOG", ADV_LOGGER_BUFFERED_TASK_SIZE, NULL, ADV_LOGGER_BUFFERED_TASK_PRIORITY, &adv_logger_data->xHandle);
-    
-    adv_logger_data->is_new_line = true;
-    adv_logger_data->ready_to_send = true;
+    if (!adv_logger_data->close_buffered_task) {
+        adv_logger_data->udplogstring = calloc(1, UDP_LOG_LEN);
+        
+        strcat(adv_logger_data->udplogstring, "\r\nAdv Log (c) 2022-2026 José A. Jiménez Campos\r\n\r\n");
+        adv_logger_data->udplogstring_len = strlen(adv_logger_data->udplogstring);
+        
+        // From here, UDP output is owned by drain task
+        adv_logger_data->ready_to_send = true;
+    }
     
     vTaskDelete(NULL);
 }
@@ -252,14 +409,33 @@ void adv_logger_set_ip_address(char* ip_address) {
 
 int IRAM_ATTR adv_logger_printf(const char* format, ...) {
     if (adv_logger_data) {
-        char* buffer = malloc(ADV_LOGGER_VSNPRINTF_BUFFER_SIZE);
+        // Most log lines fit in stack buffer
+        char stack_buffer[ADV_LOGGER_VSNPRINTF_STACK_SIZE];
+        
+        va_list va;
+        va_start(va, format);
+        int len = vsnprintf(stack_buffer, ADV_LOGGER_VSNPRINTF_STACK_SIZE, format, va);
+        va_end(va);
+        
+        if (len < ADV_LOGGER_VSNPRINTF_STACK_SIZE) {
+            if (len > 0) {
+                return adv_logger_write(NULL, 0, (void*) stack_buffer, len);
+            }
+            
+            return 0;
+        }
+        
+        if (len >= ADV_LOGGER_VSNPRINTF_BUFFER_SIZE) {
+            len = ADV_LOGGER_VSNPRINTF_BUFFER_SIZE - 1;
+        }
+        
+        char* buffer = malloc(len + 1);
         if (buffer) {
-            va_list va;
             va_start(va, format);
-            vsnprintf(buffer, ADV_LOGGER_VSNPRINTF_BUFFER_SIZE - 1, format, va);
+            vsnprintf(buffer, len + 1, format, va);
             va_end(va);
             
-            int res = adv_logger_write(NULL, 0, (void*) buffer, strlen(buffer));
+            int res = adv_logger_write(NULL, 0, (void*) buffer, len);
             
             free(buffer);
             
@@ -278,14 +454,21 @@ void adv_logger_close_buffered_task() {
 void adv_logger_init() {
     adv_logger_data = calloc(1, sizeof(adv_logger_data_t));
     
-#ifdef ESP_PLATFORM
-    adv_logger_data->log_sender_semaphore = xSemaphoreCreateMutex();
-#endif
+    adv_logger_data->ring = malloc(ADV_LOGGER_RING_SIZE);
+    if (!adv_logger_data->ring) {
+        free(adv_logger_data);
+        adv_logger_data = NULL;
+        return;
+    }
+    
+    adv_logger_data->is_new_line = true;
+    adv_logger_data->drain_is_new_line = true;
     
     adv_logger_data->socket = -1;
     adv_logger_data->header = malloc(HEADER_LEN);
     
     xTaskCreate(adv_logger_init_task, "LOG", ADV_LOGGER_INIT_TASK_SIZE, NULL, ADV_LOGGER_INIT_TASK_PRIORITY, NULL);
+    xTaskCreate(adv_logger_drain_task, "LOGD", ADV_LOGGER_DRAIN_TASK_SIZE, NULL, ADV_LOGGER_DRAIN_TASK_PRIORITY, &adv_logger_data->xHandle);
     
 #ifndef ESP_PLATFORM
     set_write_stdout(adv_logger_write);
@@ -23,6 +23,9 @@ extern "C" {
 void adv_logger_init();
 void adv_logger_close_buffered_task();
 
+// Waits until written data is output, like before a reboot
+void adv_logger_flush();
+
 #ifdef ESP_PLATFORM
 int adv_logger_printf(const char* format, ...);
 void adv_logger_set_ip_address(char* ip_address);
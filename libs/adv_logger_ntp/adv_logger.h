@@ -36,6 +36,9 @@ extern "C" {
 
 void adv_logger_init(const uint8_t log_type, char* dest_addr, const bool with_header);
 
+// Waits until written data is output, like before a reboot
+void adv_logger_flush();
+
 #ifdef ESP_PLATFORM
 int adv_logger_printf(const char* format, ...);
 void adv_logger_set_ip_address(char* ip_address);
@@ -19,6 +19,11 @@
 
 #define sdk_system_get_time_raw()           ((uint32_t) esp_timer_get_time())
 
+static portMUX_TYPE adv_logger_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+#define ADV_LOGGER_ENTER_CRITICAL()         taskENTER_CRITICAL(&adv_logger_spinlock)
+#define ADV_LOGGER_EXIT_CRITICAL()          taskEXIT_CRITICAL(&adv_logger_spinlock)
+
 #else
 
 #include <espressif/esp_wifi.h>
@@ -32,6 +37,9 @@
 #include <stdout_redirect.h>
 #include <semphr.h>
 
+#define ADV_LOGGER_ENTER_CRITICAL()         taskENTER_CRITICAL()
+#define ADV_LOGGER_EXIT_CRITICAL()          taskEXIT_CRITICAL()
+
 #endif
 
 #include <lwip/err.h>
@@ -46,20 +54,43 @@
 
 #define HEADER_LEN                          (23)
 #define UDP_LOG_LEN                         (1400)
+#define LOG_TIME_LEN                        (16)
+
+// Ring buffer size must be a power of 2
+#ifdef ESP_PLATFORM
+#define ADV_LOGGER_RING_SIZE                (4096)
+#else
+#define ADV_LOGGER_RING_SIZE                (1024)
+#endif
+#define ADV_LOGGER_RING_MASK                (ADV_LOGGER_RING_SIZE - 1)
+
+// Each write is stored as a record: 2 bytes header with payload length, 4 bytes with line time
+// only if header has ADV_LOGGER_RECORD_TIME flag, and payload. Payload bytes are never parsed as records
+#define ADV_LOGGER_RECORD_TIME              (0x8000)
+#define ADV_LOGGER_RECORD_LEN_MASK          (0x7FFF)
+#define ADV_LOGGER_RECORD_HEADER_LEN        (sizeof(uint16_t))
+#define ADV_LOGGER_RECORD_MAX_LEN           (ADV_LOGGER_RING_SIZE / 2)
+
+// Longest time adv_logger_flush() waits for drain task to empty ring
+#define ADV_LOGGER_FLUSH_WAIT_MS            (2000)
+
+#define ADV_LOGGER_DRAIN_PERIOD_MS          (20)
+#define ADV_LOGGER_UDP_BUFFERED_PERIODS     (8)
 
 // Task Stack Size
 #ifdef ESP_PLATFORM
 #define ADV_LOGGER_INIT_TASK_SIZE           (2048)
-#define ADV_LOGGER_BUFFERED_TASK_SIZE       (2048)
+#define ADV_LOGGER_DRAIN_TASK_SIZE          (2048)
 #define ADV_LOGGER_VSNPRINTF_BUFFER_SIZE    (1024)
+#define ADV_LOGGER_VSNPRINTF_STACK_SIZE     (128)
 #else
 #define ADV_LOGGER_INIT_TASK_SIZE           (configMINIMAL_STACK_SIZE)  // 256
-#define ADV_LOGGER_BUFFERED_TASK_SIZE       (configMINIMAL_STACK_SIZE)  // 256
+#define ADV_LOGGER_DRAIN_TASK_SIZE          (configMINIMAL_STACK_SIZE + 128)
 #endif
 
 // Task Priority
 #define ADV_LOGGER_INIT_TASK_PRIORITY       (tskIDLE_PRIORITY + 0)
-#define ADV_LOGGER_BUFFERED_TASK_PRIORITY   (configMAX_PRIORITIES - 1)
+#define ADV_LOGGER_DRAIN_TASK_PRIORITY      (tskIDLE_PRIORITY + 1)
 
 #define ADV_LOGGER_DEFAULT_DESTINATION      "255.255.255.255:45678"
 
@@ -68,20 +99,29 @@ typedef struct _adv_logger_data {
     
 #ifdef ESP_PLATFORM
     char* ip_address;
-    SemaphoreHandle_t log_sender_semaphore;
 #endif
     
     uint16_t udplogstring_len: 11;
     int8_t log_type: 4;
     bool with_header: 1;
-    
-    uint16_t udplogstring_size: 11;
-    bool is_new_line: 1;
-    bool ready_to_send: 1;
     bool is_buffered: 1;
     
+    bool is_new_line;               // Producers side
+    bool drain_is_new_line;         // Drain task side
+    volatile bool ready_to_send;
+    
     TaskHandle_t xHandle;
     
+    char* ring;
+    volatile uint32_t ring_head;    // Only written by producers
+    volatile uint32_t ring_tail;    // Only written by drain task
+    volatile uint32_t dropped;      // Bytes discarded because ring was full
+    uint32_t dropped_reported;
+    
+    uint32_t line_time;
+    uint32_t log_time_value;
+    char log_time[LOG_TIME_LEN + 1];
+    
     char* udplogstring;
     char* header;
     
@@ -96,172 +136,232 @@ static _WriteFunction* adv_logger_original_write_function = NULL;
 #endif
 #endif
 
-static ssize_t adv_logger_write(struct _reent* r, int fd, const void* ptr, size_t len) {
+static void adv_logger_ring_copy(const uint32_t position, const void* data, const size_t len) {
+    const size_t offset = position & ADV_LOGGER_RING_MASK;
+    size_t first_len = ADV_LOGGER_RING_SIZE - offset;
+    if (first_len > len) {
+        first_len = len;
+    }
+    
+    memcpy(&adv_logger_data->ring[offset], data, first_len);
+    memcpy(adv_logger_data->ring, ((const char*) data) + first_len, len - first_len);
+}
+
+// Flush can wait for drain task only from a task, with scheduler running and interrupts enabled
+static bool adv_logger_can_wait() {
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING || xTaskGetCurrentTaskHandle() == adv_logger_data->xHandle) {
+        return false;
+    }
+    
 #ifdef ESP_PLATFORM
-    if (xSemaphoreTake(adv_logger_data->log_sender_semaphore, 0) == pdTRUE) {
+    return xPortCanYield();
+#else
+    uint32_t ps;
+    asm volatile("rsr %0, ps" : "=a" (ps));
+    return (ps & 0x0F) == 0;
 #endif
-        int is_adv_logger_data = false;
-        if (adv_logger_data->ready_to_send) {
-            if (adv_logger_data->is_buffered) {
-                is_adv_logger_data = true;
-            } else {
-                if (!adv_logger_data->udplogstring) {
-                    adv_logger_data->udplogstring_size = len + 1;
-                    adv_logger_data->udplogstring = calloc(1, len);
-                    if (adv_logger_data->udplogstring) {
-                        is_adv_logger_data = true;
-                    }
-                } else {
-                    adv_logger_data->udplogstring_size += len;
-                    if (adv_logger_data->udplogstring_size <= UDP_LOG_LEN) {
-                        char* new_udplogstring = realloc(adv_logger_data->udplogstring, adv_logger_data->udplogstring_size);
-                        if (new_udplogstring) {
-                            adv_logger_data->udplogstring = new_udplogstring;
-                            is_adv_logger_data = true;
-                        }
-                    }
-                }
+}
+
+// Writers never wait: when ring is full, record is discarded and counted. Only adv_logger_flush() waits for drain task
+static void adv_logger_write_record(const char* data, const size_t len) {
+    uint8_t record_header[ADV_LOGGER_RECORD_HEADER_LEN + sizeof(uint32_t)];
+    const uint32_t now = raven_ntp_get_time();
+    memcpy(&record_header[ADV_LOGGER_RECORD_HEADER_LEN], &now, sizeof(uint32_t));
+    
+    ADV_LOGGER_ENTER_CRITICAL();
+    
+    uint16_t record_info = len;
+    size_t record_header_len = ADV_LOGGER_RECORD_HEADER_LEN;
+    if (adv_logger_data->with_header && adv_logger_data->is_new_line) {
+        record_info |= ADV_LOGGER_RECORD_TIME;
+        record_header_len += sizeof(uint32_t);
+    }
+    memcpy(record_header, &record_info, ADV_LOGGER_RECORD_HEADER_LEN);
+    
+    const uint32_t head = adv_logger_data->ring_head;
+    if ((head - adv_logger_data->ring_tail) + record_header_len + len <= ADV_LOGGER_RING_SIZE) {
+        adv_logger_ring_copy(head, record_header, record_header_len);
+        adv_logger_ring_copy(head + record_header_len, data, len);
+        adv_logger_data->ring_head = head + record_header_len + len;
+        adv_logger_data->is_new_line = (data[len - 1] == '\n');
+        
+    } else {
+        adv_logger_data->dropped += len;
+    }
+    
+    ADV_LOGGER_EXIT_CRITICAL();
+}
+
+// Producers only copy data to ring buffer. Formatting and output are done by drain task
+static ssize_t adv_logger_write(struct _reent* r, int fd, const void* ptr, size_t len) {
+    size_t written = 0;
+    while (written < len) {
+        size_t record_len = len - written;
+        if (record_len > ADV_LOGGER_RECORD_MAX_LEN) {
+            record_len = ADV_LOGGER_RECORD_MAX_LEN;
+        }
+        
+        adv_logger_write_record(((const char*) ptr) + written, record_len);
+        written += record_len;
+    }
+    
+    return len;
+}
+
+static void adv_logger_uart_output(const char* data, const size_t len) {
+    if (adv_logger_data->log_type >= 0) {
+#ifdef ESP_PLATFORM
+        uart_write_bytes(adv_logger_data->log_type, data, len);
+#else
+        for (size_t i = 0; i < len; i++) {
+            while (uart_putc_nowait(adv_logger_data->log_type, data[i]) < 0) {
+                vTaskDelay(1);
             }
         }
+#endif
+    }
+}
+
+static void adv_logger_udp_send() {
+    if (adv_logger_data->udplogstring_len > 0) {
+        lwip_sendto(adv_logger_data->socket, adv_logger_data->udplogstring, adv_logger_data->udplogstring_len, 0, adv_logger_data->res->ai_addr, adv_logger_data->res->ai_addrlen);
+        adv_logger_data->udplogstring_len = 0;
+    }
+}
+
+static void adv_logger_udp_output(const char* data, const size_t len) {
+    if (adv_logger_data->ready_to_send && len <= UDP_LOG_LEN) {
+        if (adv_logger_data->udplogstring_len + len > UDP_LOG_LEN) {
+            adv_logger_udp_send();
+        }
+        
+        memcpy(&adv_logger_data->udplogstring[adv_logger_data->udplogstring_len], data, len);
+        adv_logger_data->udplogstring_len += len;
+    }
+}
+
+static void adv_logger_output(const char* data, const size_t len) {
+    adv_logger_uart_output(data, len);
+    adv_logger_udp_output(data, len);
+}
+
+static void adv_logger_output_line_header() {
+    const uint32_t dropped = adv_logger_data->dropped;
+    if (dropped != adv_logger_data->dropped_reported) {
+        char dropped_msg[40];
+        const int dropped_msg_len = snprintf(dropped_msg, sizeof(dropped_msg), "! Log dropped %u bytes\r\n", (unsigned int) (dropped - adv_logger_data->dropped_reported));
+        adv_logger_data->dropped_reported = dropped;
+        adv_logger_output(dropped_msg, dropped_msg_len);
+    }
+    
+    if (adv_logger_data->with_header) {
+        if (adv_logger_data->log_time_value != adv_logger_data->line_time || adv_logger_data->log_time[0] == 0) {
+            adv_logger_data->log_time_value = adv_logger_data->line_time;
+            raven_ntp_format_log_time(adv_logger_data->line_time, adv_logger_data->log_time, LOG_TIME_LEN);
+            adv_logger_data->log_time[LOG_TIME_LEN - 1] = ' ';
+            adv_logger_data->log_time[LOG_TIME_LEN] = 0;
+        }
         
-        char* buffer = NULL;
+        adv_logger_uart_output(adv_logger_data->log_time, LOG_TIME_LEN);
+        
+        if (adv_logger_data->ready_to_send) {
+            adv_logger_udp_output(adv_logger_data->log_time, LOG_TIME_LEN);
+            adv_logger_udp_output(adv_logger_data->header, strlen(adv_logger_data->header));
+            adv_logger_udp_output(" ", 1);
+        }
+    }
+}
+
+static void adv_logger_ring_read(const uint32_t position, void* data, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        ((uint8_t*) data)[i] = adv_logger_data->ring[(position + i) & ADV_LOGGER_RING_MASK];
+    }
+}
+
+static void adv_logger_drain() {
+    const char* ring = adv_logger_data->ring;
+    uint32_t tail = adv_logger_data->ring_tail;
+    
+    // Records are always written complete
+    while (tail != adv_logger_data->ring_head) {
+        uint16_t record_info;
+        adv_logger_ring_read(tail, &record_info, ADV_LOGGER_RECORD_HEADER_LEN);
+        tail += ADV_LOGGER_RECORD_HEADER_LEN;
         
-        if (adv_logger_data->with_header) {
-            buffer = malloc(17);
+        if (record_info & ADV_LOGGER_RECORD_TIME) {
+            uint32_t line_time;
+            adv_logger_ring_read(tail, &line_time, sizeof(uint32_t));
+            adv_logger_data->line_time = line_time;
+            tail += sizeof(uint32_t);
         }
         
-        for (size_t i = 0; i < len; i++) {
-            // Auto convert CR to CRLF, ignore other LFs (compatible with Espressif SDK behaviour)
-            if (((char*) ptr)[i] == '\r') {
-                continue;
-            }
-            
-            if (adv_logger_data->udplogstring_len > (UDP_LOG_LEN - 40 - 1)) {
-                is_adv_logger_data = false;
-            }
+        size_t len = record_info & ADV_LOGGER_RECORD_LEN_MASK;
+        while (len > 0) {
+            const char* data = &ring[tail & ADV_LOGGER_RING_MASK];
+            size_t run = 1;
             
-            if (((char*) ptr)[i] == '\n') {
-                if (adv_logger_data->log_type >= 0) {
-#ifdef ESP_PLATFORM
-                    char new_line_char = '\r';
-                    uart_write_bytes(adv_logger_data->log_type, &new_line_char, 1);
-#else
-                    uart_putc(adv_logger_data->log_type, '\r');
-#endif
-                }
+            if (data[0] == '\r') {
+                // Auto convert CR to CRLF, ignore other LFs (compatible with Espressif SDK behaviour)
                 
-                if (adv_logger_data->ready_to_send && is_adv_logger_data) {
-                    adv_logger_data->udplogstring[adv_logger_data->udplogstring_len] = '\r';
-                    adv_logger_data->udplogstring_len++;
-                }
-            }
-            
-            if (adv_logger_data->with_header && adv_logger_data->is_new_line) {
-                raven_ntp_get_log_time(buffer, 16);
-                buffer[15] = ' ';
-                buffer[16] = 0;
-            }
-            
-            if (adv_logger_data->log_type >= 0) {
-                if (adv_logger_data->with_header && adv_logger_data->is_new_line) {
-                    for (int j = 0; j < 16; j++) {
-#ifdef ESP_PLATFORM
-                        uart_write_bytes(adv_logger_data->log_type, &buffer[j], 1);
-#else
-                        uart_putc(adv_logger_data->log_type, buffer[j]);
-#endif
-                    }
+            } else {
+                if (adv_logger_data->drain_is_new_line) {
+                    adv_logger_data->drain_is_new_line = false;
+                    adv_logger_output_line_header();
                 }
                 
-#ifdef ESP_PLATFORM
-                uart_write_bytes(adv_logger_data->log_type, &((char*) ptr)[i], 1);
-#else
-                uart_putc(adv_logger_data->log_type, ((char*) ptr)[i]);
-#endif
-            }
-            
-            if (adv_logger_data->ready_to_send && is_adv_logger_data) {
-                if (adv_logger_data->is_new_line) {
-                    if (!adv_logger_data->is_buffered) {
-                        if (adv_logger_data->with_header) {
-                            adv_logger_data->udplogstring_size += 40;
-                        }
-                        if (adv_logger_data->udplogstring_size > UDP_LOG_LEN) {
-                            is_adv_logger_data = false;
-                            continue;
-                        }
-                        
-                        char* new_udplogstring = realloc(adv_logger_data->udplogstring, adv_logger_data->udplogstring_size);
-                        if (new_udplogstring) {
-                            adv_logger_data->udplogstring = new_udplogstring;
-                        } else {
-                            is_adv_logger_data = false;
-                            continue;
-                        }
+                if (data[0] == '\n') {
+                    adv_logger_output("\r\n", 2);
+                    adv_logger_data->drain_is_new_line = true;
+                    
+                } else {
+                    // Longest run of plain chars without wrapping around ring end
+                    size_t run_max = len;
+                    if (run_max > ADV_LOGGER_RING_SIZE - (tail & ADV_LOGGER_RING_MASK)) {
+                        run_max = ADV_LOGGER_RING_SIZE - (tail & ADV_LOGGER_RING_MASK);
                     }
                     
-                    adv_logger_data->udplogstring[adv_logger_data->udplogstring_len] = 0;
-                    if (adv_logger_data->with_header) {
-                        strcat(strcat(strcat(adv_logger_data->udplogstring, buffer), adv_logger_data->header), " ");
+                    while (run < run_max && data[run] != '\n' && data[run] != '\r') {
+                        run++;
                     }
-                    adv_logger_data->udplogstring_len = strlen(adv_logger_data->udplogstring);
+                    
+                    adv_logger_output(data, run);
                 }
-                
-                adv_logger_data->udplogstring[adv_logger_data->udplogstring_len] = ((char*) ptr)[i];
-                adv_logger_data->udplogstring_len++;
             }
             
-            adv_logger_data->is_new_line = false;
-            
-            if (((char*) ptr)[i] == '\n') {
-                adv_logger_data->is_new_line = true;
-            }
+            tail += run;
+            len -= run;
         }
         
-        if (buffer) {
-            free(buffer);
-        }
-        
-        if (!adv_logger_data->is_buffered && adv_logger_data->ready_to_send && adv_logger_data->udplogstring_len > 0) {
-            lwip_sendto(adv_logger_data->socket, adv_logger_data->udplogstring, adv_logger_data->udplogstring_len, 0, adv_logger_data->res->ai_addr, adv_logger_data->res->ai_addrlen);
-            free(adv_logger_data->udplogstring);
-            adv_logger_data->udplogstring = NULL;
-            adv_logger_data->udplogstring_len = 0;
-        }
-        
-#ifdef ESP_PLATFORM
-        xSemaphoreGive(adv_logger_data->log_sender_semaphore);
-#endif
-        
-        return len;
-        
-#ifdef ESP_PLATFORM
+        adv_logger_data->ring_tail = tail;
     }
-    
-    return 0;
-#endif
 }
 
-static void adv_logger_buffered_task() {
+static void adv_logger_drain_task() {
     unsigned int i = 0;
     
     for (;;) {
-        i++;
+        adv_logger_drain();
         
-        if ((i == 8 && adv_logger_data->udplogstring_len > 0) || adv_logger_data->udplogstring_len > (UDP_LOG_LEN / 2)) {
-            
-            adv_logger_data->ready_to_send = false;
-            lwip_sendto(adv_logger_data->socket, adv_logger_data->udplogstring, adv_logger_data->udplogstring_len, 0, adv_logger_data->res->ai_addr, adv_logger_data->res->ai_addrlen);
-            adv_logger_data->udplogstring_len = 0;
-            adv_logger_data->ready_to_send = true;
-            
-            i = 0;
+        if (adv_logger_data->ready_to_send) {
+            i++;
             
-        } else if (i == 8) {
-            i = 0;
+            if (!adv_logger_data->is_buffered || i >= ADV_LOGGER_UDP_BUFFERED_PERIODS || adv_logger_data->udplogstring_len > (UDP_LOG_LEN / 2)) {
+                adv_logger_udp_send();
+                i = 0;
+            }
         }
         
-        vTaskDelay(20 / portTICK_PERIOD_MS);
+        vTaskDelay(ADV_LOGGER_DRAIN_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+}
+
+void adv_logger_flush() {
+    if (adv_logger_data && adv_logger_can_wait()) {
+        unsigned int waited_ms = 0;
+        while (adv_logger_data->ring_tail != adv_logger_data->ring_head && waited_ms < ADV_LOGGER_FLUSH_WAIT_MS) {
+            vTaskDelay(1);
+            waited_ms += portTICK_PERIOD_MS;
+        }
     }
 }
 
@@ -314,21 +414,12 @@ static void adv_logger_init_task(void* args) {
         vTaskDelay(200 / portTICK_PERIOD_MS);
     }
     
-    if (adv_logger_data->is_buffered) {
-        adv_logger_data->udplogstring = calloc(1, UDP_LOG_LEN);
-    } else {
-        adv_logger_data->udplogstring_size = 63;
-        adv_logger_data->udplogstring = calloc(1, adv_logger_data->udplogstring_size);
-    }
+    adv_logger_data->udplogstring = calloc(1, UDP_LOG_LEN);
     
     strcat(adv_logger_data->udplogstring, "\r\nAdv Log (c) 2022-2026 José A. Jiménez Campos\r\n\r\n");
     adv_logger_data->udplogstring_len = strlen(adv_logger_data->udplogstring);
     
-    if (adv_logger_data->is_buffered) {
-        xTaskCreate(adv_logger_buffered_task, "LOG", ADV_LOGGER_BUFFERED_TASK_SIZE, NULL, ADV_LOGGER_BUFFERED_TASK_PRIORITY, &adv_logger_data->xHandle);
-    }
-    
-    adv_logger_data->is_new_line = true;
+    // From here, UDP output is owned by drain task
     adv_logger_data->ready_to_send = true;
     
     vTaskDelete(NULL);
@@ -345,14 +436,33 @@ void adv_logger_set_ip_address(char* ip_address) {
 
 int IRAM_ATTR adv_logger_printf(const char* format, ...) {
     if (adv_logger_data) {
-        char* buffer = malloc(ADV_LOGGER_VSNPRINTF_BUFFER_SIZE);
+        // Most log lines fit in stack buffer
+        char stack_buffer[ADV_LOGGER_VSNPRINTF_STACK_SIZE];
+        
+        va_list va;
+        va_start(va, format);
+        int len = vsnprintf(stack_buffer, ADV_LOGGER_VSNPRINTF_STACK_SIZE, format, va);
+        va_end(va);
+        
+        if (len < ADV_LOGGER_VSNPRINTF_STACK_SIZE) {
+            if (len > 0) {
+                return adv_logger_write(NULL, 0, (void*) stack_buffer, len);
+            }
+            
+            return 0;
+        }
+        
+        if (len >= ADV_LOGGER_VSNPRINTF_BUFFER_SIZE) {
+            len = ADV_LOGGER_VSNPRINTF_BUFFER_SIZE - 1;
+        }
+        
+        char* buffer = malloc(len + 1);
         if (buffer) {
-            va_list va;
             va_start(va, format);
-            vsnprintf(buffer, ADV_LOGGER_VSNPRINTF_BUFFER_SIZE - 1, format, va);
+            vsnprintf(buffer, len + 1, format, va);
             va_end(va);
             
-            int res = adv_logger_write(NULL, 0, (void*) buffer, strlen(buffer));
+            int res = adv_logger_write(NULL, 0, (void*) buffer, len);
             
             free(buffer);
             
@@ -376,6 +486,10 @@ int adv_logger_remove() {
         adv_logger_original_write_function = NULL;
     
         if (adv_logger_data) {
+            if (adv_logger_data->xHandle) {
+                vTaskDelete(adv_logger_data->xHandle);
+            }
+            
             if (adv_logger_data->header) {
                 free(adv_logger_data->header);
             }
@@ -384,7 +498,10 @@ int adv_logger_remove() {
                 free(adv_logger_data->udplogstring);
             }
             
+            free(adv_logger_data->ring);
+            
             free(adv_logger_data);
+            adv_logger_data = NULL;
         }
         
         return 0;
@@ -414,10 +531,15 @@ void adv_logger_init(const uint8_t log_type, char* dest_addr, const bool with_he
         
         adv_logger_data->log_type = (log_type % 4) - 1;
         adv_logger_data->with_header = with_header;
+        adv_logger_data->is_new_line = true;
+        adv_logger_data->drain_is_new_line = true;
         
-#ifdef ESP_PLATFORM
-        adv_logger_data->log_sender_semaphore = xSemaphoreCreateMutex();
-#endif
+        adv_logger_data->ring = malloc(ADV_LOGGER_RING_SIZE);
+        if (!adv_logger_data->ring) {
+            free(adv_logger_data);
+            adv_logger_data = NULL;
+            return;
+        }
         
         if (log_type >= ADV_LOGGER_UDP) {
             if (log_type >= ADV_LOGGER_UDP_BUFFERED) {
@@ -441,6 +563,8 @@ void adv_logger_init(const uint8_t log_type, char* dest_addr, const bool with_he
             xTaskCreate(adv_logger_init_task, "LOG", ADV_LOGGER_INIT_TASK_SIZE, (void*) destination, ADV_LOGGER_INIT_TASK_PRIORITY, NULL);
         }
         
+        xTaskCreate(adv_logger_drain_task, "LOGD", ADV_LOGGER_DRAIN_TASK_SIZE, NULL, ADV_LOGGER_DRAIN_TASK_PRIORITY, &adv_logger_data->xHandle);
+        
 #ifndef ESP_PLATFORM
         set_write_stdout(adv_logger_write);
 #endif
@@ -6,9 +6,12 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 
 #ifdef ESP_PLATFORM
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "driver/gptimer.h"
 #include "esp_attr.h"
@@ -17,21 +20,41 @@
 
 #define ADV_PWM_TIMER_RESOLUTION            (8 * 1000 * 1000)  // 8MHz
 
+static portMUX_TYPE adv_pwm_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+#define ADV_PWM_ENTER_CRITICAL()            taskENTER_CRITICAL(&adv_pwm_spinlock)
+#define ADV_PWM_EXIT_CRITICAL()             taskEXIT_CRITICAL(&adv_pwm_spinlock)
+#define ADV_PWM_ENTER_CRITICAL_ISR()        taskENTER_CRITICAL_ISR(&adv_pwm_spinlock)
+#define ADV_PWM_EXIT_CRITICAL_ISR()         taskEXIT_CRITICAL_ISR(&adv_pwm_spinlock)
+
 #else
 
 #include <espressif/esp_common.h>
 #include <espressif/sdk_private.h>
 #include <esp8266.h>
 #include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+
+#define ADV_PWM_ENTER_CRITICAL()            taskENTER_CRITICAL()
+#define ADV_PWM_EXIT_CRITICAL()             taskEXIT_CRITICAL()
+#define ADV_PWM_ENTER_CRITICAL_ISR()
+#define ADV_PWM_EXIT_CRITICAL_ISR()
 
 #endif
 
+#include <adv_gpio.h>
+
 #include "adv_pwm.h"
 
 #define ADV_PWM_FREQUENCY_DEFAULT           (305)
+#define ADV_PWM_CYCLES                      (8)
+
+#define ADV_PWM_LOCK()                      xSemaphoreTake(adv_pwm_config->lock, portMAX_DELAY)
+#define ADV_PWM_UNLOCK()                    xSemaphoreGive(adv_pwm_config->lock)
 
 typedef struct _adv_pwm_channel {
-    uint16_t duty[8];
+    uint16_t duty[ADV_PWM_CYCLES];
     
     uint16_t dithering;
     uint8_t gpio: 6;    // 5 bits
@@ -42,12 +65,33 @@ typedef struct _adv_pwm_channel {
     struct _adv_pwm_channel* next;
 } adv_pwm_channel_t;
 
+// Each edge applies its GPIO masks and loads timer until next edge.
+// Edge 0 of every cycle is the period start; the rest are sorted by duty.
+typedef struct _adv_pwm_edge {
+    adv_gpio_batch_t gpio_batch;
+    
+    uint32_t load;
+} adv_pwm_edge_t;
+
+typedef struct _adv_pwm_schedule {
+    uint8_t edge_count[ADV_PWM_CYCLES];
+    
+    // Period start masks used while waiting for zero crossing
+    adv_gpio_batch_t zc_gpio_batch[ADV_PWM_CYCLES];
+    
+    adv_pwm_edge_t* edges;  // ADV_PWM_CYCLES * edges_per_cycle
+} adv_pwm_schedule_t;
+
 typedef struct _adv_pwm_config {
-    uint16_t current_duty;
+    uint8_t edge_index;
     uint8_t cycle: 3;
     bool is_running: 1;
     uint8_t zc_status: 4;   // 2 bits
-    uint8_t _align;
+    uint8_t edges_per_cycle;
+    
+    volatile uint8_t active_schedule;
+    volatile bool schedule_pending;
+    uint16_t _align;
     
     uint32_t max_load;
     
@@ -55,7 +99,12 @@ typedef struct _adv_pwm_config {
     gptimer_handle_t gptimer;
 #endif
     
+    // Only one task at a time changes channels and builds back schedule
+    SemaphoreHandle_t lock;
+    
     adv_pwm_channel_t* adv_pwm_channels;
+    
+    adv_pwm_schedule_t schedule[2];
 } adv_pwm_config_t;
 
 static adv_pwm_config_t* adv_pwm_config = NULL;
@@ -97,7 +146,7 @@ static void IRAM_ATTR zero_crossing_interrupt(void* args) {
 #else
 static void IRAM zero_crossing_interrupt(const uint8_t gpio) {
 #endif
-    adv_pwm_config->current_duty = 0;
+    adv_pwm_config->edge_index = 0;
     adv_pwm_config->zc_status = 1;
     
     // Restart timer
@@ -119,65 +168,45 @@ static bool IRAM_ATTR adv_pwm_worker(gptimer_handle_t gptimer, const gptimer_ala
 #else
 static void IRAM adv_pwm_worker() {
 #endif
-    unsigned int next_load = adv_pwm_config->max_load;
-    unsigned int next_duty = UINT16_MAX;
-    
-    adv_pwm_channel_t* adv_pwm_channel = adv_pwm_config->adv_pwm_channels;
-    if (adv_pwm_config->current_duty == 0) {
+    if (adv_pwm_config->edge_index == 0) {
+        // Period boundary: only safe point to swap to a new schedule
+        ADV_PWM_ENTER_CRITICAL_ISR();
+        if (adv_pwm_config->schedule_pending) {
+            adv_pwm_config->active_schedule ^= 1;
+            adv_pwm_config->schedule_pending = false;
+        }
+        ADV_PWM_EXIT_CRITICAL_ISR();
+        
         adv_pwm_config->cycle++;
         
-        while (adv_pwm_channel) {
-            if (adv_pwm_channel->duty[adv_pwm_config->cycle] == 0 ||
-                (!adv_pwm_channel->leading && adv_pwm_config->zc_status == 2 && adv_pwm_channel->duty[adv_pwm_config->cycle] < UINT16_MAX)) {
-                gpio_write(adv_pwm_channel->gpio, adv_pwm_channel->inverted);
-            } else {
-                gpio_write(adv_pwm_channel->gpio, 1 ^ adv_pwm_channel->inverted);
-            }
+        if (adv_pwm_config->zc_status == 2) {
+            adv_pwm_schedule_t* schedule = &adv_pwm_config->schedule[adv_pwm_config->active_schedule];
+            adv_gpio_write_mask(schedule->zc_gpio_batch[adv_pwm_config->cycle].set_mask, schedule->zc_gpio_batch[adv_pwm_config->cycle].clear_mask);
             
-            adv_pwm_channel = adv_pwm_channel->next;
-        }
-        
-        adv_pwm_channel = adv_pwm_config->adv_pwm_channels;
-    }
-    
-    if (adv_pwm_config->zc_status == 2) {
 #ifdef ESP_PLATFORM
-        return 0;
+            return 0;
 #else
-        return;
+            return;
 #endif
-    }
-    
-    while (adv_pwm_channel) {
-        if (adv_pwm_channel->duty[adv_pwm_config->cycle] <= adv_pwm_config->current_duty) {
-            gpio_write(adv_pwm_channel->gpio, adv_pwm_channel->inverted);
-        } else if (adv_pwm_channel->duty[adv_pwm_config->cycle] > adv_pwm_config->current_duty &&
-                   adv_pwm_channel->duty[adv_pwm_config->cycle] < next_duty) {
-            next_duty = adv_pwm_channel->duty[adv_pwm_config->cycle];
         }
-        
-        adv_pwm_channel = adv_pwm_channel->next;
     }
     
-    next_load = (next_duty - adv_pwm_config->current_duty) * adv_pwm_config->max_load / UINT16_MAX;
+    adv_pwm_schedule_t* schedule = &adv_pwm_config->schedule[adv_pwm_config->active_schedule];
+    adv_pwm_edge_t* edge = &schedule->edges[(adv_pwm_config->cycle * adv_pwm_config->edges_per_cycle) + adv_pwm_config->edge_index];
     
-    if (next_duty == UINT16_MAX) {
-        adv_pwm_config->current_duty = 0;
+    adv_gpio_write_mask(edge->gpio_batch.set_mask, edge->gpio_batch.clear_mask);
+    
+    adv_pwm_config->edge_index++;
+    if (adv_pwm_config->edge_index >= schedule->edge_count[adv_pwm_config->cycle]) {
+        adv_pwm_config->edge_index = 0;
         if (adv_pwm_config->zc_status == 1) {
             adv_pwm_config->zc_status = 2;
-            //next_load = next_load >> 1;
         }
-    } else {
-        adv_pwm_config->current_duty = next_duty;
-    }
-    
-    if (next_load == 0) {
-        next_load = 1;
     }
     
 #ifdef ESP_PLATFORM
     gptimer_alarm_config_t alarm_config = {
-        .alarm_count = next_load,
+        .alarm_count = edge->load,
     };
     gptimer_set_alarm_action(gptimer, &alarm_config);
     gptimer_set_raw_count(gptimer, 0);
@@ -185,11 +214,117 @@ static void IRAM adv_pwm_worker() {
     
     return 0;
 #else
-    timer_set_load(FRC1, next_load);
+    timer_set_load(FRC1, edge->load);
 #endif
 }
 
-void adv_pwm_start() {
+static uint32_t adv_pwm_duty_to_load(const unsigned int duty_delta) {
+    const uint32_t load = (uint64_t) duty_delta * adv_pwm_config->max_load / UINT16_MAX;
+    if (load == 0) {
+        return 1;
+    }
+    
+    return load;
+}
+
+static void adv_pwm_schedule_build(adv_pwm_schedule_t* schedule) {
+    const unsigned int edges_per_cycle = adv_pwm_config->edges_per_cycle;
+    
+    for (unsigned int cycle = 0; cycle < ADV_PWM_CYCLES; cycle++) {
+        adv_pwm_edge_t* edges = &schedule->edges[cycle * edges_per_cycle];
+        unsigned int edge_count = 1;
+        
+        memset(edges, 0, sizeof(adv_pwm_edge_t));
+        memset(&schedule->zc_gpio_batch[cycle], 0, sizeof(adv_gpio_batch_t));
+        
+        // While building, edge load holds its duty threshold
+        adv_pwm_channel_t* adv_pwm_channel = adv_pwm_config->adv_pwm_channels;
+        while (adv_pwm_channel) {
+            const unsigned int duty = adv_pwm_channel->duty[cycle];
+            
+            if (duty == 0) {
+                adv_gpio_batch_write(&edges[0].gpio_batch, adv_pwm_channel->gpio, adv_pwm_channel->inverted);
+                adv_gpio_batch_write(&schedule->zc_gpio_batch[cycle], adv_pwm_channel->gpio, adv_pwm_channel->inverted);
+                
+            } else {
+                adv_gpio_batch_write(&edges[0].gpio_batch, adv_pwm_channel->gpio, 1 ^ adv_pwm_channel->inverted);
+                adv_gpio_batch_write(&schedule->zc_gpio_batch[cycle], adv_pwm_channel->gpio,
+                                     (!adv_pwm_channel->leading && duty < UINT16_MAX) ? adv_pwm_channel->inverted : 1 ^ adv_pwm_channel->inverted);
+                
+                if (duty < UINT16_MAX) {
+                    unsigned int i = 1;
+                    while (i < edge_count && edges[i].load < duty) {
+                        i++;
+                    }
+                    
+                    if (i == edge_count || edges[i].load != duty) {
+                        memmove(&edges[i + 1], &edges[i], (edge_count - i) * sizeof(adv_pwm_edge_t));
+                        memset(&edges[i], 0, sizeof(adv_pwm_edge_t));
+                        edges[i].load = duty;
+                        edge_count++;
+                    }
+                    
+                    adv_gpio_batch_write(&edges[i].gpio_batch, adv_pwm_channel->gpio, adv_pwm_channel->inverted);
+                }
+            }
+            
+            adv_pwm_channel = adv_pwm_channel->next;
+        }
+        
+        // Convert duty thresholds to timer loads between consecutive edges
+        unsigned int previous_duty = 0;
+        for (unsigned int i = 1; i < edge_count; i++) {
+            const unsigned int duty = edges[i].load;
+            edges[i - 1].load = adv_pwm_duty_to_load(duty - previous_duty);
+            previous_duty = duty;
+        }
+        edges[edge_count - 1].load = adv_pwm_duty_to_load(UINT16_MAX - previous_duty);
+        
+        schedule->edge_count[cycle] = edge_count;
+    }
+}
+
+static void adv_pwm_schedule_update() {
+    if (!adv_pwm_config->is_running) {
+        adv_pwm_config->schedule_pending = false;
+        adv_pwm_schedule_build(&adv_pwm_config->schedule[adv_pwm_config->active_schedule]);
+        return;
+    }
+    
+    // Back schedule can not be swapped while it is being built
+    ADV_PWM_ENTER_CRITICAL();
+    adv_pwm_config->schedule_pending = false;
+    const unsigned int back_schedule = adv_pwm_config->active_schedule ^ 1;
+    ADV_PWM_EXIT_CRITICAL();
+    
+    adv_pwm_schedule_build(&adv_pwm_config->schedule[back_schedule]);
+    
+    adv_pwm_config->schedule_pending = true;
+}
+
+// Only called with PWM stopped. When there is no memory, old schedules are kept
+static bool adv_pwm_schedule_resize(const unsigned int edges_per_cycle) {
+    adv_pwm_edge_t* edges[2];
+    edges[0] = calloc(ADV_PWM_CYCLES * edges_per_cycle, sizeof(adv_pwm_edge_t));
+    edges[1] = calloc(ADV_PWM_CYCLES * edges_per_cycle, sizeof(adv_pwm_edge_t));
+    
+    if (!edges[0] || !edges[1]) {
+        free(edges[0]);
+        free(edges[1]);
+        return false;
+    }
+    
+    adv_pwm_config->edges_per_cycle = edges_per_cycle;
+    
+    for (unsigned int i = 0; i < 2; i++) {
+        free(adv_pwm_config->schedule[i].edges);
+        adv_pwm_config->schedule[i].edges = edges[i];
+    }
+    
+    return true;
+}
+
+static void adv_pwm_timer_start() {
     if (!adv_pwm_config->is_running) {
 #ifdef ESP_PLATFORM
         gptimer_alarm_config_t alarm_config = {
@@ -209,7 +344,13 @@ void adv_pwm_start() {
     }
 }
 
-void adv_pwm_stop() {
+void adv_pwm_start() {
+    ADV_PWM_LOCK();
+    adv_pwm_timer_start();
+    ADV_PWM_UNLOCK();
+}
+
+static void adv_pwm_timer_stop() {
     if (adv_pwm_config->is_running) {
 #ifdef ESP_PLATFORM
         gptimer_stop(adv_pwm_config->gptimer);
@@ -218,9 +359,14 @@ void adv_pwm_stop() {
         timer_set_run(FRC1, false);
 #endif
         
-        adv_pwm_config->current_duty = 0;
+        adv_pwm_config->edge_index = 0;
         adv_pwm_config->cycle = 0;
         
+        if (adv_pwm_config->schedule_pending) {
+            adv_pwm_config->active_schedule ^= 1;
+            adv_pwm_config->schedule_pending = false;
+        }
+        
         adv_pwm_channel_t* adv_pwm_channel = adv_pwm_config->adv_pwm_channels;
         while (adv_pwm_channel) {
             gpio_write(adv_pwm_channel->gpio, adv_pwm_channel->inverted);
@@ -231,9 +377,18 @@ void adv_pwm_stop() {
     }
 }
 
+void adv_pwm_stop() {
+    ADV_PWM_LOCK();
+    adv_pwm_timer_stop();
+    ADV_PWM_UNLOCK();
+}
+
 static void adv_pwm_init(const unsigned int mode) {
     if (!adv_pwm_config) {
         adv_pwm_config = calloc(1, sizeof(adv_pwm_config_t));
+        
+        adv_pwm_config->lock = xSemaphoreCreateMutex();
+        adv_pwm_schedule_resize(1);
 
 #ifdef ESP_PLATFORM
         gptimer_config_t timer_config = {
@@ -261,8 +416,10 @@ static void adv_pwm_init(const unsigned int mode) {
 void adv_pwm_set_freq(const uint16_t freq) {
     adv_pwm_init(1);
     
+    ADV_PWM_LOCK();
+    
     const unsigned int pwm_was_running = adv_pwm_config->is_running;
-    adv_pwm_stop();
+    adv_pwm_timer_stop();
     
 #ifdef ESP_PLATFORM
     adv_pwm_config->max_load = ADV_PWM_TIMER_RESOLUTION / freq;
@@ -275,9 +432,13 @@ void adv_pwm_set_freq(const uint16_t freq) {
     timer_set_load(FRC1, counts);
 #endif
     
+    adv_pwm_schedule_update();
+    
     if (pwm_was_running) {
-        adv_pwm_start();
+        adv_pwm_timer_start();
     }
+    
+    ADV_PWM_UNLOCK();
 }
 
 void adv_pwm_set_dithering(const uint8_t gpio, const uint16_t dithering) {
@@ -287,65 +448,82 @@ void adv_pwm_set_dithering(const uint8_t gpio, const uint16_t dithering) {
     }
 }
 
-void adv_pwm_set_duty(const uint8_t gpio, uint16_t duty) {
-    adv_pwm_channel_t* adv_pwm_channel = adv_pwm_channel_find_by_gpio(gpio);
-    if (adv_pwm_channel) {
-        if (adv_pwm_channel->leading) {
-            duty = UINT16_MAX - duty;
+static void adv_pwm_channel_set_duty(adv_pwm_channel_t* adv_pwm_channel, uint16_t duty) {
+    if (adv_pwm_channel->leading) {
+        duty = UINT16_MAX - duty;
+    }
+    
+    unsigned int _dithering = adv_pwm_channel->dithering;
+    
+    if (_dithering == 0 || duty == 0 || duty == UINT16_MAX) {
+        for (unsigned int i = 0; i < ADV_PWM_CYCLES; i++) {
+            adv_pwm_channel->duty[i] = duty;
         }
-        
-        unsigned int _dithering = adv_pwm_channel->dithering;
-        
-        if (_dithering == 0 || duty == 0 || duty == UINT16_MAX) {
-            for (unsigned int i = 0; i < 8; i++) {
-                adv_pwm_channel->duty[i] = duty;
-            }
+    } else {
+        if (duty >= (UINT16_MAX - _dithering)) {
+            _dithering = UINT16_MAX - duty;
+        } else if (duty <= _dithering) {
+            _dithering = 0;
         } else {
-            if (duty >= (UINT16_MAX - _dithering)) {
-                _dithering = UINT16_MAX - duty;
-            } else if (duty <= _dithering) {
-                _dithering = 0;
-            } else {
-                _dithering = _dithering * duty / UINT16_MAX;
-            }
+            _dithering = _dithering * duty / UINT16_MAX;
+        }
 
-            adv_pwm_channel->duty[0] = duty + _dithering;
-            adv_pwm_channel->duty[1] = duty + (_dithering >> 1);
-            adv_pwm_channel->duty[2] = duty;
-            adv_pwm_channel->duty[3] = duty - (_dithering >> 1);
-            adv_pwm_channel->duty[4] = duty - _dithering;
-            
-            for (unsigned int i = 5; i < 8; i++) {
-                adv_pwm_channel->duty[i] = adv_pwm_channel->duty[8 - i];
-            }
+        adv_pwm_channel->duty[0] = duty + _dithering;
+        adv_pwm_channel->duty[1] = duty + (_dithering >> 1);
+        adv_pwm_channel->duty[2] = duty;
+        adv_pwm_channel->duty[3] = duty - (_dithering >> 1);
+        adv_pwm_channel->duty[4] = duty - _dithering;
+        
+        for (unsigned int i = 5; i < ADV_PWM_CYCLES; i++) {
+            adv_pwm_channel->duty[i] = adv_pwm_channel->duty[8 - i];
         }
     }
+    
+    adv_pwm_schedule_update();
+}
+
+void adv_pwm_set_duty(const uint8_t gpio, uint16_t duty) {
+    adv_pwm_channel_t* adv_pwm_channel = adv_pwm_channel_find_by_gpio(gpio);
+    if (adv_pwm_channel) {
+        ADV_PWM_LOCK();
+        adv_pwm_channel_set_duty(adv_pwm_channel, duty);
+        ADV_PWM_UNLOCK();
+    }
 }
 
 void adv_pwm_new_channel(const uint8_t gpio, const bool inverted, const bool leading, const uint16_t dithering, const uint16_t duty) {
     adv_pwm_init(0);
     
     if (!adv_pwm_channel_find_by_gpio(gpio)) {
+        ADV_PWM_LOCK();
+        
         const unsigned int is_running = adv_pwm_config->is_running;
         if (is_running) {
-            adv_pwm_stop();
+            adv_pwm_timer_stop();
         }
         
         adv_pwm_channel_t* adv_pwm_channel = calloc(1, sizeof(adv_pwm_channel_t));
         
-        adv_pwm_channel->gpio = gpio;
-        adv_pwm_channel->leading = leading;
-        adv_pwm_channel->inverted = inverted ^ leading;
-        adv_pwm_channel->dithering = dithering;
-        
-        adv_pwm_channel->next = adv_pwm_config->adv_pwm_channels;
-        adv_pwm_config->adv_pwm_channels = adv_pwm_channel;
-        
-        adv_pwm_set_duty(gpio, duty);
+        // Worst case: one edge per channel plus period start. Without memory, channel is not added
+        if (adv_pwm_channel && adv_pwm_schedule_resize(adv_pwm_config->edges_per_cycle + 1)) {
+            adv_pwm_channel->gpio = gpio;
+            adv_pwm_channel->leading = leading;
+            adv_pwm_channel->inverted = inverted ^ leading;
+            adv_pwm_channel->dithering = dithering;
+            
+            adv_pwm_channel->next = adv_pwm_config->adv_pwm_channels;
+            adv_pwm_config->adv_pwm_channels = adv_pwm_channel;
+            
+            adv_pwm_channel_set_duty(adv_pwm_channel, duty);
+        } else {
+            free(adv_pwm_channel);
+        }
         
         if (is_running) {
-            adv_pwm_start();
+            adv_pwm_timer_start();
         }
+        
+        ADV_PWM_UNLOCK();
     }
 }
 
@@ -96,10 +96,53 @@ static cJSON_rsf *cJSON_rsf_New_Item()
     return node;
 }
 
+/* Blocks holding items and strings of a tree parsed by cJSON_rsf_ParseArena(). */
+typedef struct _cjson_arena_block
+{
+    struct _cjson_arena_block *next;
+    size_t size;
+    size_t used;
+} cjson_arena_block;
+
+#define cjson_arena_align(size) (((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+#define CJSON_ARENA_HEADER_SIZE cjson_arena_align(sizeof(cjson_arena_block))
+
+static cjson_arena_block *arena_new_block(const size_t size)
+{
+    cjson_arena_block *block = malloc(CJSON_ARENA_HEADER_SIZE + size);
+    if (block)
+    {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+
+    return block;
+}
+
+static void arena_free(cjson_arena_block *block)
+{
+    cjson_arena_block *next = NULL;
+    while (block != NULL)
+    {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
 /* Delete a cJSON_rsf structure. */
 void cJSON_rsf_Delete(cJSON_rsf *item)
 {
     cJSON_rsf *next = NULL;
+
+    /* Root of an arena tree is the first allocation of its first block */
+    if ((item != NULL) && (item->type & cJSON_rsf_IsArenaRoot))
+    {
+        arena_free((cjson_arena_block*) ((unsigned char*) item - CJSON_ARENA_HEADER_SIZE));
+        return;
+    }
+
     while (item != NULL)
     {
         next = item->next;
@@ -134,8 +177,53 @@ typedef struct
     size_t length;
     size_t offset;
     size_t depth;   /* How deeply nested (in arrays/objects) is the input at the current offset. */
+    cjson_arena_block *arena;   /* Current (last) arena block, or NULL to use the heap. */
+    bool in_situ;   /* Unescape strings inside content, only used with arena. */
 } parse_buffer;
 
+static void *arena_alloc(parse_buffer * const buffer, size_t size)
+{
+    cjson_arena_block *block = buffer->arena;
+    void *pointer = NULL;
+
+    size = cjson_arena_align(size);
+    if ((block->size - block->used) < size)
+    {
+        cjson_arena_block *new_block = arena_new_block((size > CJSON_ARENA_BLOCK_SIZE) ? size : CJSON_ARENA_BLOCK_SIZE);
+        if (new_block == NULL)
+        {
+            return NULL;
+        }
+
+        block->next = new_block;
+        buffer->arena = block = new_block;
+    }
+
+    pointer = (unsigned char*) block + CJSON_ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+
+    return pointer;
+}
+
+/* Item constructor for parser. */
+static cJSON_rsf *parse_new_item(parse_buffer * const buffer)
+{
+    cJSON_rsf *node = NULL;
+
+    if (buffer->arena == NULL)
+    {
+        return cJSON_rsf_New_Item();
+    }
+
+    node = arena_alloc(buffer, sizeof(cJSON_rsf));
+    if (node)
+    {
+        memset(node, 0, sizeof(cJSON_rsf));
+    }
+
+    return node;
+}
+
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
 #define can_read(buffer, size) ((buffer != NULL) && (((buffer)->offset + size) <= (buffer)->length))
 /* check if the buffer can be accessed at the given index (starting with 0) */
@@ -572,7 +660,19 @@ static bool parse_string(cJSON_rsf * const item, parse_buffer * const input_buff
 
         /* This is at most how much we need for the output */
         allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = malloc(allocation_length + sizeof(""));
+        if (input_buffer->in_situ)
+        {
+            /* unescaped string is never longer, so it is written over the input from the opening quote */
+            output = (unsigned char*) buffer_at_offset(input_buffer);
+        }
+        else if (input_buffer->arena)
+        {
+            output = arena_alloc(input_buffer, allocation_length + sizeof(""));
+        }
+        else
+        {
+            output = malloc(allocation_length + sizeof(""));
+        }
         if (output == NULL)
         {
             goto fail; /* allocation failure */
@@ -648,7 +748,7 @@ static bool parse_string(cJSON_rsf * const item, parse_buffer * const input_buff
     return true;
 
 fail:
-    if (output != NULL)
+    if ((output != NULL) && (input_buffer->arena == NULL))
     {
         free(output);
     }
@@ -920,6 +1020,54 @@ fail:
     return NULL;
 }
 
+cJSON_rsf* cJSON_rsf_ParseArena(char *value, const bool in_situ)
+{
+    parse_buffer buffer = { 0, 0, 0, 0 };
+    cjson_arena_block *first_block = NULL;
+    cJSON_rsf *item = NULL;
+    size_t block_size = 0;
+
+    if (value == NULL)
+    {
+        return NULL;
+    }
+
+    buffer.content = (const unsigned char*) value;
+    buffer.length = strlen((const char*) value) + sizeof("");
+    buffer.offset = 0;
+    buffer.in_situ = in_situ;
+
+    /* Items take about four times the text they come from, so small inputs get a small first block */
+    block_size = buffer.length * 4;
+    if (block_size < 256)
+    {
+        block_size = 256;
+    }
+    else if (block_size > CJSON_ARENA_BLOCK_SIZE)
+    {
+        block_size = CJSON_ARENA_BLOCK_SIZE;
+    }
+
+    first_block = arena_new_block(block_size);
+    if (first_block == NULL) /* memory fail */
+    {
+        return NULL;
+    }
+    buffer.arena = first_block;
+
+    item = parse_new_item(&buffer);
+
+    if (!parse_value(item, buffer_skip_whitespace(skip_utf8_bom(&buffer))))
+    {
+        arena_free(first_block);
+        return NULL;
+    }
+
+    item->type |= cJSON_rsf_IsArenaRoot;
+
+    return item;
+}
+
 #define cjson_min(a, b) ((a < b) ? a : b)
 
 static unsigned char *print(const cJSON_rsf * const item, bool format)
@@ -1193,7 +1341,7 @@ static bool parse_array(cJSON_rsf * const item, parse_buffer * const input_buffe
     do
     {
         /* allocate next item */
-        cJSON_rsf *new_item = cJSON_rsf_New_Item();
+        cJSON_rsf *new_item = parse_new_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
@@ -1240,7 +1388,7 @@ success:
     return true;
 
 fail:
-    if (head != NULL)
+    if ((head != NULL) && (input_buffer->arena == NULL))
     {
         cJSON_rsf_Delete(head);
     }
@@ -1347,7 +1495,7 @@ static bool parse_object(cJSON_rsf * const item, parse_buffer * const input_buff
     do
     {
         /* allocate next item */
-        cJSON_rsf *new_item = cJSON_rsf_New_Item();
+        cJSON_rsf *new_item = parse_new_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
@@ -1411,7 +1559,7 @@ success:
     return true;
 
 fail:
-    if (head != NULL)
+    if ((head != NULL) && (input_buffer->arena == NULL))
     {
         cJSON_rsf_Delete(head);
     }
@@ -1655,6 +1803,7 @@ static cJSON_rsf *create_reference(const cJSON_rsf *item)
 
     memcpy(reference, item, sizeof(cJSON_rsf));
     reference->string = NULL;
+    reference->type &= ~cJSON_rsf_IsArenaRoot;
     reference->type |= cJSON_rsf_IsReference;
     reference->next = reference->prev = NULL;
     return reference;
@@ -2361,7 +2510,7 @@ cJSON_rsf* cJSON_rsf_Duplicate(const cJSON_rsf *item, bool recurse)
         goto fail;
     }
     /* Copy over all vars */
-    newitem->type = item->type & (~cJSON_rsf_IsReference);
+    newitem->type = item->type & (~(cJSON_rsf_IsReference | cJSON_rsf_IsArenaRoot));
     if (cJSON_rsf_IsString(item) || cJSON_rsf_IsRaw(item))
     {
         if (item->valuestring)
@@ -2467,7 +2616,10 @@ void cJSON_rsf_Minify(char *json)
             {
                 json++;
             }
-            json += 2;
+            if (*json)
+            {
+                json += 2;
+            }
         }
         else if (*json == '\"')
         {
@@ -2475,13 +2627,16 @@ void cJSON_rsf_Minify(char *json)
             *into++ = (unsigned char)*json++;
             while (*json && (*json != '\"'))
             {
-                if (*json == '\\')
+                if ((*json == '\\') && json[1])
                 {
                     *into++ = (unsigned char)*json++;
                 }
                 *into++ = (unsigned char)*json++;
             }
-            *into++ = (unsigned char)*json++;
+            if (*json)
+            {
+                *into++ = (unsigned char)*json++;
+            }
         }
         else
         {
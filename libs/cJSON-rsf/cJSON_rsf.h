@@ -51,6 +51,7 @@ extern "C"
 
 #define cJSON_rsf_IsReference 256
 #define cJSON_rsf_StringIsConst 512
+#define cJSON_rsf_IsArenaRoot 1024
 
 /* The cJSON_rsf structure: */
 typedef struct _cJSON_rsf {
@@ -81,10 +82,19 @@ typedef struct _cJSON_rsf {
 #define CJSON_NESTING_LIMIT 1000
 #endif
 
+/* Maximum size of each block used by cJSON_rsf_ParseArena(). Bigger strings get their own block. */
+#ifndef CJSON_ARENA_BLOCK_SIZE
+#define CJSON_ARENA_BLOCK_SIZE 2048
+#endif
+
 /* Supply a block of JSON, and this returns a cJSON_rsf object you can interrogate. */
 cJSON_rsf* cJSON_rsf_Parse(const char *value);
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 cJSON_rsf* cJSON_rsf_ParseWithOpts(const char *value, bool require_null_terminated);
+/* ParseArena allocates all items and strings from a few blocks, released at once by cJSON_rsf_Delete() on the returned item.
+ * With in_situ, strings are unescaped inside value instead of copied, so value is modified and must outlive the returned item.
+ * Items of the returned tree must not be detached, replaced or deleted on their own. */
+cJSON_rsf* cJSON_rsf_ParseArena(char *value, const bool in_situ);
 
 /* Render a cJSON_rsf entity to text for transfer/storage. */
 char* cJSON_rsf_Print(const cJSON_rsf *item);
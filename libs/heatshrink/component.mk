@@ -0,0 +1,8 @@
+# Component makefile for heatshrink
+
+INC_DIRS += $(heatshrink_ROOT)
+
+heatshrink_INC_DIR = $(heatshrink_ROOT)
+heatshrink_SRC_DIR = $(heatshrink_ROOT)
+
+$(eval $(call component_compile_rules,heatshrink))
@@ -59,6 +59,49 @@ void homekit_set_max_clients(const unsigned int clients);
 // Remove oldest client to free some DRAM
 void homekit_remove_oldest_client();
 
+// DRAM budget
+// Subsystems can reserve DRAM that other subsystems low priority work can not use, and register low-water callbacks
+// to shed caches. Closing a HomeKit client is the last resort
+typedef enum {
+    HOMEKIT_MEM_HAP = 0,
+    HOMEKIT_MEM_NETWORK,
+    HOMEKIT_MEM_FX,
+    HOMEKIT_MEM_SYSTEM,
+    HOMEKIT_MEM_SUBSYSTEMS
+} homekit_mem_subsystem_t;
+
+typedef enum {
+    HOMEKIT_MEM_PRIORITY_LOW = 0,       // Refused if it would use DRAM reserved by other subsystems. Only sheds caches
+    HOMEKIT_MEM_PRIORITY_NORMAL,        // Can use reserved DRAM, and sheds caches and then not verified clients if needed
+    HOMEKIT_MEM_PRIORITY_HIGH,          // Always admitted, closing oldest client if shedding is not enough
+} homekit_mem_priority_t;
+
+typedef enum {
+    HOMEKIT_MEM_SHED_CACHES = 0,        // Gives DRAM back at once
+    HOMEKIT_MEM_SHED_CLIENTS,           // Closes clients. DRAM is back when server task closes them
+} homekit_mem_shed_level_t;
+
+typedef struct {
+    uint32_t admitted;
+    uint32_t admitted_bytes;
+    uint32_t refused;
+    uint32_t failures;                  // Allocations failed after admission
+    uint32_t sheds;
+    uint32_t evictions;
+    uint32_t min_free_heap;
+} homekit_mem_stats_t;
+
+void homekit_mem_reserve(const homekit_mem_subsystem_t subsystem, const uint32_t bytes);
+void homekit_mem_add_shedder(void (*callback)(const uint32_t needed), const homekit_mem_shed_level_t level);
+
+// Check if new work needing size bytes of DRAM can start
+bool homekit_mem_admit(const homekit_mem_subsystem_t subsystem, const uint32_t size, const homekit_mem_priority_t priority);
+
+// Call after a failed allocation. Sheds like homekit_mem_admit() with same priority
+void homekit_mem_recover(const homekit_mem_subsystem_t subsystem, const uint32_t size, const homekit_mem_priority_t priority);
+
+void homekit_mem_get_stats(const homekit_mem_subsystem_t subsystem, homekit_mem_stats_t* stats);
+
 // Reset HomeKit accessory server, removing all pairings
 void homekit_server_reset();
 
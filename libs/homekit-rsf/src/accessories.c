@@ -2,6 +2,13 @@
 #include <stdint.h>
 #include <string.h>
 #include <homekit/types.h>
+#include <rs_slab.h>
+
+#ifndef HOMEKIT_SLAB_SUBSCRIPTIONS
+#define HOMEKIT_SLAB_SUBSCRIPTIONS  (32)
+#endif
+
+static rs_slab_t subscription_slab = RS_SLAB_INITIALIZER("HKS", homekit_characteristic_subscription_t, HOMEKIT_SLAB_SUBSCRIPTIONS);
 
 bool homekit_value_equal(homekit_value_t *a, homekit_value_t *b) {
     if (a->is_null != b->is_null)
@@ -368,6 +375,8 @@ homekit_accessory_t* homekit_accessory_clone(homekit_accessory_t* ac) {
 }
 
 void homekit_accessories_init(homekit_accessory_t **accessories) {
+    rs_slab_reserve(&subscription_slab);
+
     unsigned int aid = 1;
     for (homekit_accessory_t **accessory_it = accessories; *accessory_it; accessory_it++) {
         homekit_accessory_t *accessory = *accessory_it;
@@ -488,7 +497,7 @@ void homekit_characteristic_add_notify_subscription(
     homekit_characteristic_t *ch,
     void *context
 ) {
-    homekit_characteristic_subscription_t *new_subscription = malloc(sizeof(homekit_characteristic_subscription_t));
+    homekit_characteristic_subscription_t *new_subscription = rs_slab_alloc(&subscription_slab);
     new_subscription->context = context;
     new_subscription->next = NULL;
 
@@ -497,13 +506,13 @@ void homekit_characteristic_add_notify_subscription(
     } else {
         homekit_characteristic_subscription_t *subscription = ch->subscriptions;
         if (subscription->context == context) {
-            free(new_subscription);
+            rs_slab_free(&subscription_slab, new_subscription);
             return;
         }
 
         while (subscription->next) {
             if (subscription->next->context == context) {
-                free(new_subscription);
+                rs_slab_free(&subscription_slab, new_subscription);
                 return;
             }
             subscription = subscription->next;
@@ -525,7 +534,7 @@ void homekit_characteristic_remove_notify_subscription(
 
         homekit_characteristic_subscription_t *c = ch->subscriptions;
         ch->subscriptions = ch->subscriptions->next;
-        free(c);
+        rs_slab_free(&subscription_slab, c);
     }
 
     if (!ch->subscriptions)
@@ -536,7 +545,7 @@ void homekit_characteristic_remove_notify_subscription(
         if (subscription->next->context == context) {
             homekit_characteristic_subscription_t *c = subscription->next;
             subscription->next = subscription->next->next;
-            free(c);
+            rs_slab_free(&subscription_slab, c);
         } else {
             subscription = subscription->next;
         }
@@ -136,16 +136,33 @@ PACK_STRUCT_END
 #define kMaxNameSize        64
 #define kMaxQStr            128         // max incoming question key handled
 
+#define MDNS_MAX_RECORDS            (32)    // Records are selected by bit masks
+#define MDNS_ALL_RECORDS            (0xFFFFFFFF)
+#define MDNS_MCAST_RATE_LIMIT_MS    (1000)  // RFC6762 6: a record is not multicast more than once per second
+
 typedef struct mdns_rsrc {
     struct mdns_rsrc*    rNext;
     u16_t   rType;
+    u8_t    rIndex;                     // Bit of this record in answer masks
+    u32_t   rKeyHash;                   // Case insensitive hash of key
     u32_t   rTTL;
+    TickType_t rMcastTick;              // Last time this record was multicast
     u16_t   rKeySize;
     u16_t   rDataSize;
-    char    rData[kDummyDataSize];      // Key, as C str with . seperators, followed by data in network-ready form
-                                        // at rData[rKeySize]
+    u16_t   rWireSize;
+    char    rData[kDummyDataSize];      // Key, as C str with . seperators, followed by full answer RR in network-ready
+                                        // form at rData[rKeySize], which ends with record data
 } mdns_rsrc;
 
+#define MDNS_RSRC_BIT(rsrcP)        ((u32_t) 1 << (rsrcP)->rIndex)
+
+#define MDNS_MAX_NAMES              (24)    // Names remembered for compression while building a packet
+
+typedef struct mdns_names {
+    unsigned int count;
+    u16_t   offset[MDNS_MAX_NAMES];     // Label sequences already in packet
+} mdns_names;
+
 static struct udp_pcb* gMDNS_pcb = NULL;
 static const ip_addr_t gMulticastV4Addr = DNS_MQUERY_IPV4_GROUP_INIT;
 #if LWIP_IPV6
@@ -158,6 +175,12 @@ static mdns_rsrc*      gDictP = NULL;       // RR database, linked list
 static u8_t* mdns_response = NULL;
 static u16_t mdns_responder_reply_size = 0;
 
+// Last packet built in mdns_response. It is sent again while asked records, IP and RR database do not change
+static u32_t mdns_packet_answers = 0;
+static u32_t mdns_packet_extra = 0;
+static u16_t mdns_packet_len = 0;
+static ip4_addr_t mdns_packet_ip;
+
 #define MDNS_TTL_MULTIPLIER_MS      (1000)  // Set to 1000 to use standard time
 #define MDNS_TTL_SAFE_MARGIN        (7)
 static uint32_t mdns_ttl = 4500;
@@ -443,6 +466,72 @@ static int mdns_str2labels(const char* name, u8_t* lseq, int max)
     return lc;
 }
 
+// FNV-1a hash of a C str, ignoring ASCII case
+static u32_t mdns_hash(const char* str)
+{
+    u32_t hash = 2166136261;
+
+    while (*str) {
+        char c = *str++;
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ (u8_t) c) * 16777619;
+    }
+    return hash;
+}
+
+// Skip a domain name label sequence, return pointer to next field
+static u8_t* mdns_skip_labels(u8_t* p, u8_t* limP)
+{
+    while (p < limP) {
+        u8_t n = *p++;
+        if ((n & 0xC0) == 0xC0) {
+            return p + 1;
+        } else if (n == 0) {
+            return p;
+        }
+        p += n;
+    }
+    return limP + 1;
+}
+
+// Compare a domain name at p, that can be compressed, with an uncompressed label sequence at lp. Case insensitive.
+// Name must be before limP, and its pointers can only go back to a previous name, with at most 8 hops
+static int mdns_labels_equal(u8_t* hdrP, u8_t* p, u8_t* limP, const u8_t* lp)
+{
+    int hops = 0;
+
+    for (;;) {
+        if (p >= limP) {
+            return 0;
+        }
+        u8_t n = *p++;
+        if ((n & 0xC0) == 0xC0) {
+            if (p >= limP || ++hops > 8) {
+                return 0;
+            }
+            u8_t* ptrP = hdrP + (((n & 0x3F) << 8) | *p);
+            if (ptrP >= p - 1) {
+                return 0;
+            }
+            p = ptrP;
+            continue;
+        }
+        if (n != *lp++) {
+            return 0;
+        }
+        if (n == 0) {
+            return 1;
+        }
+        if (p + n > limP || strncasecmp((char*) p, (char*) lp, n) != 0) {
+            return 0;
+        }
+        p += n;
+        lp += n;
+    }
+}
+
 // Unpack a DNS question RR at qp, return pointer to next RR
 static u8_t* mdns_get_question(u8_t* hdrP, u8_t* qp, char* qStr, uint16_t* qClass, uint16_t* qType, u8_t* qUnicast)
 {
@@ -478,6 +567,7 @@ int mdns_buffer_init(uint16_t new_size) {
     }
     
     mdns_responder_reply_size = new_size;
+    mdns_packet_len = 0;
     
     return 0;
 }
@@ -487,6 +577,7 @@ void mdns_buffer_deinit() {
         free(mdns_response);
         mdns_responder_reply_size = 0;
         mdns_response = NULL;
+        mdns_packet_len = 0;
     }
 }
 
@@ -498,6 +589,7 @@ void mdns_clear() {
     
     mdns_rsrc *rsrc = gDictP;
     gDictP = NULL;
+    mdns_packet_len = 0;
 
     while (rsrc) {
         mdns_rsrc *next = rsrc->rNext;
@@ -535,28 +627,60 @@ void mdns_TXT_append(char* txt, size_t txt_size, const char* record, size_t reco
 }
 
 
-// Add a record to the RR database list
+// Record data, at the end of its answer RR
+static u8_t* mdns_rsrc_data(mdns_rsrc* rsrcP)
+{
+    return (u8_t*) &rsrcP->rData[rsrcP->rKeySize + rsrcP->rWireSize - rsrcP->rDataSize];
+}
+
+// Add a record to the RR database list, with its answer RR already encoded
 static void mdns_add_response(const char* vKey, u16_t vType, u32_t ttl, const void* dataP, u16_t vDataSize)
 {
     mdns_rsrc* rsrcP;
-    int keyLen, recSize;
+    int keyLen, recSize, labelsLen;
 
     keyLen = strlen(vKey) + 1;
-    recSize = sizeof(mdns_rsrc) - kDummyDataSize + keyLen + vDataSize;
+    recSize = sizeof(mdns_rsrc) - kDummyDataSize + keyLen + (keyLen + 1) + SIZEOF_DNS_ANSWER + vDataSize;
     rsrcP = (mdns_rsrc*)malloc(recSize);
     if (rsrcP == NULL) {
         HOMEKIT_MDNS_PRINTF("! mDNS alloc %d\n",recSize);
     } else {
+        u8_t* wireP = (u8_t*) &rsrcP->rData[keyLen];
+        labelsLen = mdns_str2labels(vKey, wireP, keyLen + 1);
+        if (labelsLen == 0) {
+            free(rsrcP);
+            return;
+        }
+
+        // Answer fields: may be misaligned, so build and memcpy
+        struct mdns_answer ans;
+        ans.type  = htons(vType);
+        ans.class = htons(DNS_RRCLASS_IN);
+        ans.ttl   = htonl(ttl);
+        ans.len   = htons(vDataSize);
+        memcpy(&wireP[labelsLen], &ans, SIZEOF_DNS_ANSWER);
+        memcpy(&wireP[labelsLen + SIZEOF_DNS_ANSWER], dataP, vDataSize);
+
         rsrcP->rType = vType;
+        rsrcP->rKeyHash = mdns_hash(vKey);
         rsrcP->rTTL = ttl;
+        rsrcP->rMcastTick = xTaskGetTickCount() - (MDNS_MCAST_RATE_LIMIT_MS / portTICK_PERIOD_MS);
         rsrcP->rKeySize = keyLen;
         rsrcP->rDataSize = vDataSize;
+        rsrcP->rWireSize = labelsLen + SIZEOF_DNS_ANSWER + vDataSize;
         memcpy(rsrcP->rData, vKey, keyLen);
-        memcpy(&rsrcP->rData[keyLen], dataP, vDataSize);
 
         if (xSemaphoreTake(gDictMutex, portMAX_DELAY)) {
+            rsrcP->rIndex = gDictP ? gDictP->rIndex + 1 : 0;
+            if (rsrcP->rIndex >= MDNS_MAX_RECORDS) {
+                xSemaphoreGive(gDictMutex);
+                HOMEKIT_MDNS_PRINTF("! mDNS records\n");
+                free(rsrcP);
+                return;
+            }
             rsrcP->rNext = gDictP;
             gDictP = rsrcP;
+            mdns_packet_len = 0;
             xSemaphoreGive(gDictMutex);
         }
 
@@ -758,11 +882,13 @@ void mdns_add_facility(const char* instanceName,   // Friendly name, need not be
     mdns_add_facility_work(instanceName, serviceName, addText, flags, onPort, ttl, ttl_period);
 }
 
+// Keys are compared only when type and hash match
 static mdns_rsrc* mdns_match(const char* qstr, u16_t qType)
 {
+    const u32_t qHash = mdns_hash(qstr);
     mdns_rsrc* rp = gDictP;
     while (rp != NULL) {
-       if (rp->rType == qType || qType == DNS_RRTYPE_ANY) {
+       if ((rp->rType == qType || qType == DNS_RRTYPE_ANY) && rp->rKeyHash == qHash) {
             if (strcasecmp(rp->rData, qstr) == 0) {
 #ifdef qDebugLog
                 HOMEKIT_MDNS_PRINTF(" - matched '%s' %s\n", qstr, mdns_qrtype(rp->rType));
@@ -775,39 +901,249 @@ static mdns_rsrc* mdns_match(const char* qstr, u16_t qType)
     return rp;
 }
 
-// Create answer RR and append to resp[respLen], return new length
-static int mdns_add_to_answer(mdns_rsrc* rsrcP, u8_t* resp, int respLen)
+// Write label sequence lp at resp[respLen], replacing its longest suffix already in the packet by a pointer
+// (RFC1035 4.1.4). Return new length, or 0 if it does not fit
+static int mdns_put_name(u8_t* resp, int respLen, const u8_t* lp, mdns_names* names)
 {
-    // Key is stored as C str, convert to labels
-    size_t rem = mdns_responder_reply_size - respLen;
-    size_t len = mdns_str2labels(rsrcP->rData, &resp[respLen], rem);
-    if (len == 0) {
-        // Overflow, skip this answer.
-        return respLen;
+    const u8_t* sp = lp;
+    u16_t ptr = 0;
+
+    while (*sp && !ptr) {
+        for (unsigned int i = 0; i < names->count; i++) {
+            if (mdns_labels_equal(resp, &resp[names->offset[i]], &resp[respLen], sp)) {
+                ptr = 0xC000 | names->offset[i];
+                break;
+            }
+        }
+        if (!ptr) {
+            sp += *sp + 1;
+        }
     }
-    if ((len + SIZEOF_DNS_ANSWER + rsrcP->rDataSize) > rem) {
-        // Overflow, skip this answer.
-        HOMEKIT_MDNS_PRINTF("! mDNS size %d\n", len + SIZEOF_DNS_ANSWER + rsrcP->rDataSize);
-        return respLen;
+
+    int prefixLen = sp - lp;
+    if (respLen + prefixLen + (ptr ? 2 : 1) > mdns_responder_reply_size) {
+        return 0;
     }
-    respLen += len;
 
-    // Answer fields: may be misaligned, so build and memcpy
-    struct mdns_answer ans;
-    ans.type  = htons(rsrcP->rType);
-    ans.class = htons(DNS_RRCLASS_IN);
-    ans.ttl   = htonl(rsrcP->rTTL);
-    ans.len   = htons(rsrcP->rDataSize);
-    memcpy(&resp[respLen], &ans, SIZEOF_DNS_ANSWER);
-    respLen += SIZEOF_DNS_ANSWER;
+    // Remember new labels, so next names can point to them
+    for (const u8_t* p = lp; p < sp; p += *p + 1) {
+        int offset = respLen + (p - lp);
+        if (names->count < MDNS_MAX_NAMES && offset < 0x3FFF) {
+            names->offset[names->count++] = offset;
+        }
+    }
 
-    // Data for this key
-    memcpy(&resp[respLen], &rsrcP->rData[rsrcP->rKeySize], rsrcP->rDataSize);
-    respLen += rsrcP->rDataSize;
+    memcpy(&resp[respLen], lp, prefixLen);
+    respLen += prefixLen;
+    if (ptr) {
+        resp[respLen++] = ptr >> 8;
+        resp[respLen++] = ptr;
+    } else {
+        resp[respLen++] = 0;
+    }
 
     return respLen;
 }
 
+// Append answer RR to resp[respLen], with its names compressed, return new length
+static int mdns_add_to_answer(mdns_rsrc* rsrcP, u8_t* resp, int respLen, mdns_names* names)
+{
+    u8_t* wireP = (u8_t*) &rsrcP->rData[rsrcP->rKeySize];
+    u8_t* dataP = mdns_rsrc_data(rsrcP);
+    const unsigned int namesCount = names->count;
+
+    int newLen = mdns_put_name(resp, respLen, wireP, names);
+    if (newLen > 0 && newLen + SIZEOF_DNS_ANSWER <= mdns_responder_reply_size) {
+        // Answer fields are already encoded, only data length changes
+        u8_t* ansP = &resp[newLen];
+        memcpy(ansP, dataP - SIZEOF_DNS_ANSWER, SIZEOF_DNS_ANSWER);
+        newLen += SIZEOF_DNS_ANSWER;
+        int dataStart = newLen;
+
+        if (rsrcP->rType == DNS_RRTYPE_PTR) {
+            newLen = mdns_put_name(resp, newLen, dataP, names);
+        } else if (rsrcP->rType == DNS_RRTYPE_SRV) {
+            if (newLen + SIZEOF_DNS_RR_SRV <= mdns_responder_reply_size) {
+                memcpy(&resp[newLen], dataP, SIZEOF_DNS_RR_SRV);
+                newLen = mdns_put_name(resp, newLen + SIZEOF_DNS_RR_SRV, dataP + SIZEOF_DNS_RR_SRV, names);
+            } else {
+                newLen = 0;
+            }
+        } else if (newLen + rsrcP->rDataSize <= mdns_responder_reply_size) {
+            memcpy(&resp[newLen], dataP, rsrcP->rDataSize);
+            newLen += rsrcP->rDataSize;
+        } else {
+            newLen = 0;
+        }
+
+        if (newLen > 0) {
+            u16_t rdLen = htons(newLen - dataStart);
+            memcpy(ansP + SIZEOF_DNS_ANSWER - sizeof(rdLen), &rdLen, sizeof(rdLen));
+            return newLen;
+        }
+    }
+
+    // Overflow, skip this answer.
+    HOMEKIT_MDNS_PRINTF("! mDNS size %d\n", respLen + rsrcP->rWireSize);
+    names->count = namesCount;
+    return respLen;
+}
+
+// Append records selected by mask to mdns_response, return number of added RRs
+static u16_t mdns_add_records(struct netif* netif, u32_t mask, u16_t* respLen, mdns_names* names, u8_t* cacheable)
+{
+    u16_t count = 0;
+
+    for (mdns_rsrc* rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+        if (!(mask & MDNS_RSRC_BIT(rsrcP))) {
+            continue;
+        }
+
+#if LWIP_IPV6
+        if (rsrcP->rType == DNS_RRTYPE_AAAA) {
+            // Emit an answer for each ipv6 address. They are not tracked, so packet is built again next time
+            *cacheable = 0;
+            for (int i = 0; i < LWIP_IPV6_NUM_ADDRESSES; i++) {
+                if (ip6_addr_isvalid(netif_ip6_addr_state(netif, i))) {
+                    const ip6_addr_t *addr6 = netif_ip6_addr(netif, i);
+#ifdef qDebugLog
+                    char addr6_str[IP6ADDR_STRLEN_MAX];
+                    ip6addr_ntoa_r(addr6, addr6_str, IP6ADDR_STRLEN_MAX);
+                    HOMEKIT_MDNS_PRINTF("Updating AAAA record for '%s' to %s\n", rsrcP->rData, addr6_str);
+#endif
+                    memcpy(mdns_rsrc_data(rsrcP), addr6, sizeof(addr6->addr));
+                    u16_t new_len = mdns_add_to_answer(rsrcP, mdns_response, *respLen, names);
+                    if (new_len > *respLen) {
+                        count++;
+                        *respLen = new_len;
+                    }
+                }
+            }
+            continue;
+        }
+#endif
+
+        if (rsrcP->rType == DNS_RRTYPE_A) {
+#ifdef qDebugLog
+            char addr4_str[IP4ADDR_STRLEN_MAX];
+            ip4addr_ntoa_r(netif_ip4_addr(netif), addr4_str, IP4ADDR_STRLEN_MAX);
+            HOMEKIT_MDNS_PRINTF("Updating A record for '%s' to %s\n", rsrcP->rData, addr4_str);
+#endif
+            memcpy(mdns_rsrc_data(rsrcP), netif_ip4_addr(netif), sizeof(ip4_addr_t));
+        }
+
+        u16_t new_len = mdns_add_to_answer(rsrcP, mdns_response, *respLen, names);
+        if (new_len > *respLen) {
+            count++;
+            *respLen = new_len;
+        }
+    }
+
+    return count;
+}
+
+// Build a response with selected records in mdns_response, return its length.
+// Last built packet is reused if it has same records and IP address. Call with gDictMutex taken
+static u16_t mdns_build_packet(struct netif* netif, u32_t answers, u32_t extra)
+{
+    if (mdns_packet_len > 0 &&
+        answers == mdns_packet_answers &&
+        extra == mdns_packet_extra &&
+        ip4_addr_cmp(netif_ip4_addr(netif), &mdns_packet_ip)) {
+        return mdns_packet_len;
+    }
+
+    // Build response header
+    struct mdns_hdr* rHdr = (struct mdns_hdr*) mdns_response;
+    memset(rHdr, 0, SIZEOF_DNS_HDR);
+    rHdr->flags1 = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
+
+    u16_t respLen = SIZEOF_DNS_HDR;
+    u8_t cacheable = 1;
+    mdns_names names;
+    names.count = 0;
+
+    rHdr->numanswers = htons(mdns_add_records(netif, answers, &respLen, &names, &cacheable));
+    if (extra) {
+        rHdr->numextrarr = htons(mdns_add_records(netif, extra, &respLen, &names, &cacheable));
+    }
+
+    mdns_packet_len = 0;
+    if (cacheable) {
+        mdns_packet_answers = answers;
+        mdns_packet_extra = extra;
+        ip4_addr_copy(mdns_packet_ip, *netif_ip4_addr(netif));
+        mdns_packet_len = respLen;
+    }
+
+    return respLen;
+}
+
+// Remember when records were multicast, for rate limiting
+static void mdns_mcast_sent(u32_t mask)
+{
+    const TickType_t now = xTaskGetTickCount();
+    for (mdns_rsrc* rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+        if (mask & MDNS_RSRC_BIT(rsrcP)) {
+            rsrcP->rMcastTick = now;
+        }
+    }
+}
+
+// Check a known answer RR at ap, from answer section of a query. If we have same record and querier's TTL is at least
+// half of ours, its bit is added to known (RFC6762 7.1). Return pointer to next RR, or beyond limP if it is malformed
+static u8_t* mdns_known_answer(u8_t* hdrP, u8_t* ap, u8_t* limP, u32_t* known)
+{
+    struct mdns_answer ans;
+    u8_t* nameP = ap;
+
+    ap = mdns_skip_labels(ap, limP);
+    if (ap + SIZEOF_DNS_ANSWER > limP) {
+        return limP + 1;
+    }
+
+    memcpy(&ans, ap, SIZEOF_DNS_ANSWER);
+    ap += SIZEOF_DNS_ANSWER;
+
+    u16_t rrLen = htons(ans.len);
+    if (ap + rrLen > limP) {
+        return limP + 1;
+    }
+
+    u16_t aType = htons(ans.type);
+    if ((htons(ans.class) & 0x7FFF) == DNS_RRCLASS_IN) {
+        for (mdns_rsrc* rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+            if (rsrcP->rType != aType ||
+                htonl(ans.ttl) < (rsrcP->rTTL >> 1) ||
+                !mdns_labels_equal(hdrP, nameP, limP, (u8_t*) &rsrcP->rData[rsrcP->rKeySize])) {
+                continue;
+            }
+
+            // Names in PTR and SRV data can be compressed by querier
+            u8_t* dataP = mdns_rsrc_data(rsrcP);
+            int same;
+            if (aType == DNS_RRTYPE_PTR) {
+                same = mdns_labels_equal(hdrP, ap, ap + rrLen, dataP);
+            } else if (aType == DNS_RRTYPE_SRV) {
+                same = rrLen > SIZEOF_DNS_RR_SRV &&
+                       memcmp(ap, dataP, SIZEOF_DNS_RR_SRV) == 0 &&
+                       mdns_labels_equal(hdrP, ap + SIZEOF_DNS_RR_SRV, ap + rrLen, dataP + SIZEOF_DNS_RR_SRV);
+            } else {
+                same = rrLen == rsrcP->rDataSize && memcmp(ap, dataP, rrLen) == 0;
+            }
+
+            if (same) {
+#ifdef qDebugLog
+                HOMEKIT_MDNS_PRINTF(" - known answer '%s' %s\n", rsrcP->rData, mdns_qrtype(aType));
+#endif
+                *known |= MDNS_RSRC_BIT(rsrcP);
+            }
+        }
+    }
+
+    return ap + rrLen;
+}
+
 //---------------------------------------------------------------------------
 
 // Send UDP to multicast or unicast address
@@ -865,39 +1201,29 @@ static void mdns_send_mcast(struct netif* netif, const ip_addr_t *addr, u8_t* ms
 }
     
 // Message has passed tests, may want to send an answer
-static void mdns_reply(const ip_addr_t *addr, struct mdns_hdr* hdrP)
+static void mdns_reply(const ip_addr_t *addr, struct mdns_hdr* hdrP, u16_t msgLen)
 {
-    unsigned int i, nquestions, respLen;
-    struct mdns_hdr* rHdr;
-    mdns_rsrc* extra;
+    unsigned int i, nquestions, nanswers;
     u8_t* qBase = (u8_t*)hdrP;
+    u8_t* qLimit = qBase + msgLen;
     u8_t* qp;
-
-    memset(mdns_response, 0, mdns_responder_reply_size);
+    u32_t answers = 0;
+    u32_t extra = 0;
+    u32_t known = 0;
+    u16_t respLen = 0;
 
 #ifdef qDebugLog
     HOMEKIT_MDNS_PRINTF("mDNS_reply\n");
 #endif
-    
-    // Build response header
-    rHdr = (struct mdns_hdr*) mdns_response;
-    rHdr->id = hdrP->id;
-    rHdr->flags1 = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
-    rHdr->flags2 = 0;
-    rHdr->numquestions = 0;
-    rHdr->numanswers = 0;
-    rHdr->numauthrr = 0;
-    rHdr->numextrarr = 0;
-    respLen = SIZEOF_DNS_HDR;
-
-    extra = NULL;
+
     qp = qBase + SIZEOF_DNS_HDR;
     nquestions = htons(hdrP->numquestions);
+    nanswers = htons(hdrP->numanswers);
     u8_t unicast = 1;
 
     if (xSemaphoreTake(gDictMutex, portMAX_DELAY)) {
 
-        for (i = 0; i < nquestions; i++) {
+        for (i = 0; i < nquestions && qp < qLimit; i++) {
             char  qStr[kMaxQStr];
             u16_t qClass, qType;
             u8_t  qUnicast;
@@ -910,54 +1236,17 @@ static void mdns_reply(const ip_addr_t *addr, struct mdns_hdr* hdrP)
                     if (mdns_status == MDNS_STATUS_PROBING_1) {
                         mdns_status = MDNS_STATUS_PROBING_2;
                     }
-#if LWIP_IPV6
-                    if (rsrcP->rType == DNS_RRTYPE_AAAA) {
-                        // Emit an answer for each ipv6 address.
-                        struct netif *netif = ip_current_input_netif();
-                        for (int i = 0; i < LWIP_IPV6_NUM_ADDRESSES; i++) {
-                            if (ip6_addr_isvalid(netif_ip6_addr_state(netif, i))) {
-                                const ip6_addr_t *addr6 = netif_ip6_addr(netif, i);
-#ifdef qDebugLog
-                                char addr6_str[IP6ADDR_STRLEN_MAX];
-                                ip6addr_ntoa_r(addr6, addr6_str, IP6ADDR_STRLEN_MAX);
-                                HOMEKIT_MDNS_PRINTF("Updating AAAA record for '%s' to %s\n", rsrcP->rData, addr6_str);
-#endif
-                                memcpy(&rsrcP->rData[rsrcP->rKeySize], addr6, sizeof(addr6->addr));
-                                size_t new_len = mdns_add_to_answer(rsrcP, mdns_response, respLen);
-                                if (new_len > respLen) {
-                                    rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
-                                    respLen = new_len;
-                                }
-                            }
-                        }
-                        continue;
-                    }
-#endif
 
-                    if (rsrcP->rType == DNS_RRTYPE_A) {
-                        struct netif *netif = ip_current_input_netif();
-#ifdef qDebugLog
-                        char addr4_str[IP4ADDR_STRLEN_MAX];
-                        ip4addr_ntoa_r(netif_ip4_addr(netif), addr4_str, IP4ADDR_STRLEN_MAX);
-                        HOMEKIT_MDNS_PRINTF("Updating A record for '%s' to %s\n", rsrcP->rData, addr4_str);
-#endif
-                        memcpy(&rsrcP->rData[rsrcP->rKeySize], netif_ip4_addr(netif), sizeof(ip4_addr_t));
-                    }
-
-                    size_t new_len = mdns_add_to_answer(rsrcP, mdns_response, respLen);
-                    if (new_len > respLen) {
-                        rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
-                        respLen = new_len;
-                    }
+                    answers |= MDNS_RSRC_BIT(rsrcP);
 
                     // Extra RR logic: if SRV follows PTR, or A follows SRV, volunteer it in extraRR
                     // Not required, but could do more here, see RFC6763 s12
                     if (qType == DNS_RRTYPE_PTR) {
                         if (rsrcP->rNext && rsrcP->rNext->rType == DNS_RRTYPE_SRV)
-                            extra = rsrcP->rNext;
+                            extra |= MDNS_RSRC_BIT(rsrcP->rNext);
                     } else if (qType == DNS_RRTYPE_SRV) {
                         if (rsrcP->rNext && rsrcP->rNext->rType == DNS_RRTYPE_A)
-                            extra = rsrcP->rNext;
+                            extra |= MDNS_RSRC_BIT(rsrcP->rNext);
                     }
 #ifdef qDebugLog
                     HOMEKIT_MDNS_PRINTF("qUnicast: %i\n", qUnicast);
@@ -969,26 +1258,38 @@ static void mdns_reply(const ip_addr_t *addr, struct mdns_hdr* hdrP)
             }
         } // for nQuestions
 
-        xSemaphoreGive(gDictMutex);
-    }
+        // Known-answer suppression
+        for (i = 0; i < nanswers && qp < qLimit && answers; i++) {
+            qp = mdns_known_answer(qBase, qp, qLimit, &known);
+        }
 
-    if (respLen > SIZEOF_DNS_HDR) {
-        if (extra) {
-            if (extra->rType == DNS_RRTYPE_A) {
-                struct netif *netif = ip_current_input_netif();
-#ifdef qDebugLog
-                char addr4_str[IP4ADDR_STRLEN_MAX];
-                ip4addr_ntoa_r(netif_ip4_addr(netif), addr4_str, IP4ADDR_STRLEN_MAX);
-                HOMEKIT_MDNS_PRINTF("Updating A record for '%s' to %s\n", extra->rData, addr4_str);
-#endif
-                memcpy(&extra->rData[extra->rKeySize], netif_ip4_addr(netif), sizeof(ip4_addr_t));
+        answers &= ~known;
+        extra &= ~(known | answers);
+
+        if (answers && !unicast) {
+            // Multicast rate limiting, records sent during last second are not repeated
+            const TickType_t now = xTaskGetTickCount();
+            for (mdns_rsrc* rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+                if ((now - rsrcP->rMcastTick) < (MDNS_MCAST_RATE_LIMIT_MS / portTICK_PERIOD_MS)) {
+                    answers &= ~MDNS_RSRC_BIT(rsrcP);
+                    extra &= ~MDNS_RSRC_BIT(rsrcP);
+                }
             }
-            size_t new_len = mdns_add_to_answer(extra, mdns_response, respLen);
-            if (new_len > respLen) {
-                rHdr->numextrarr = htons(htons(rHdr->numextrarr) + 1);
-                respLen = new_len;
+        }
+
+        if (answers) {
+            respLen = mdns_build_packet(ip_current_input_netif(), answers, extra);
+            ((struct mdns_hdr*) mdns_response)->id = hdrP->id;
+
+            if (!unicast) {
+                mdns_mcast_sent(answers | extra);
             }
         }
+
+        xSemaphoreGive(gDictMutex);
+    }
+
+    if (respLen > SIZEOF_DNS_HDR) {
 #ifdef qDebugLog
         HOMEKIT_MDNS_PRINTF("*** Sending response (unicast: %i)...\n", unicast);
 #endif
@@ -1009,58 +1310,13 @@ static void mdns_announce_netif(struct netif *netif, const ip_addr_t *addr)
     if (mdns_response == NULL) {
         return;
     }
-    memset(mdns_response, 0, mdns_responder_reply_size);
-
-    // Build response header
-    struct mdns_hdr *rHdr = (struct mdns_hdr*) mdns_response;
-    memset(rHdr, 0, sizeof(*rHdr));
-    rHdr->flags1 = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
 
-    size_t respLen = SIZEOF_DNS_HDR;
+    u16_t respLen = 0;
 
     if (xSemaphoreTake(gDictMutex, portMAX_DELAY)) {
-        mdns_rsrc *rsrcP = gDictP;
-        while (rsrcP) {
-#if LWIP_IPV6
-            if (rsrcP->rType == DNS_RRTYPE_AAAA) {
-                // Emit an answer for each ipv6 address.
-                for (int i = 0; i < LWIP_IPV6_NUM_ADDRESSES; i++) {
-                    if (ip6_addr_isvalid(netif_ip6_addr_state(netif, i))) {
-                        const ip6_addr_t *addr6 = netif_ip6_addr(netif, i);
-#ifdef qDebugLog
-                        char addr6_str[IP6ADDR_STRLEN_MAX];
-                        ip6addr_ntoa_r(addr6, addr6_str, IP6ADDR_STRLEN_MAX);
-                        HOMEKIT_MDNS_PRINTF("Updating AAAA record for '%s' to %s\n", rsrcP->rData, addr6_str);
-#endif
-                        memcpy(&rsrcP->rData[rsrcP->rKeySize], addr6, sizeof(addr6->addr));
-                        size_t new_len = mdns_add_to_answer(rsrcP, mdns_response, respLen);
-                        if (new_len > respLen) {
-                            rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
-                            respLen = new_len;
-                        }
-                    }
-                }
-                continue;
-            }
-#endif
-
-            if (rsrcP->rType == DNS_RRTYPE_A) {
-#ifdef qDebugLog
-                char addr4_str[IP4ADDR_STRLEN_MAX];
-                ip4addr_ntoa_r(netif_ip4_addr(netif), addr4_str, IP4ADDR_STRLEN_MAX);
-                HOMEKIT_MDNS_PRINTF("Updating A record for '%s' to %s\n", rsrcP->rData, addr4_str);
-#endif
-                memcpy(&rsrcP->rData[rsrcP->rKeySize], netif_ip4_addr(netif), sizeof(ip4_addr_t));
-            }
-
-            size_t new_len = mdns_add_to_answer(rsrcP, mdns_response, respLen);
-            if (new_len > respLen) {
-                rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
-                respLen = new_len;
-            }
-
-            rsrcP = rsrcP->rNext;
-        }
+        respLen = mdns_build_packet(netif, MDNS_ALL_RECORDS, 0);
+        ((struct mdns_hdr*) mdns_response)->id = 0;
+        mdns_mcast_sent(MDNS_ALL_RECORDS);
 
         xSemaphoreGive(gDictMutex);
     }
@@ -1108,7 +1364,7 @@ static void mdns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_a
     #endif
             if ((hdrP->flags1 & (DNS_FLAG1_RESP + DNS_FLAG1_OPMASK + DNS_FLAG1_TRUNC)) == 0 &&
                 hdrP->numquestions > 0) {
-                mdns_reply(addr, hdrP);
+                mdns_reply(addr, hdrP, p->len);
             }
         }
     }
@@ -1,7 +1,14 @@
 #include <stdlib.h>
 #include <string.h>
+#include <rs_slab.h>
 #include "query_params.h"
 
+#ifndef HOMEKIT_SLAB_QUERY_PARAMS
+#define HOMEKIT_SLAB_QUERY_PARAMS   (6)
+#endif
+
+static rs_slab_t query_param_slab = RS_SLAB_INITIALIZER("HKQ", query_param_t, HOMEKIT_SLAB_QUERY_PARAMS);
+
 
 query_param_t *query_params_parse(const char *s) {
     query_param_t *params = NULL;
@@ -15,7 +22,7 @@ query_param_t *query_params_parse(const char *s) {
             continue;
         }
 
-        query_param_t *param = malloc(sizeof(query_param_t));
+        query_param_t *param = rs_slab_alloc(&query_param_slab);
         param->name = strndup(s+pos, i-pos);
         param->value = NULL;
         param->next = params;
@@ -56,7 +63,7 @@ void query_params_free(query_param_t *params) {
             free(params->name);
         if (params->value)
             free(params->value);
-        free(params);
+        rs_slab_free(&query_param_slab, params);
 
         params = next;
     }
@@ -39,6 +39,8 @@
 #include <wolfssl/wolfcrypt/coding.h>
 
 #include <timers_helper.h>
+#include <rs_slab.h>
+#include <rs_trace.h>
 
 #include "base64.h"
 #include "crypto.h"
@@ -88,6 +90,22 @@
 #define HOMEKIT_NETWORK_PAUSE_COUNT_CRITIC      (10)
 #endif
 
+#ifndef HOMEKIT_MEM_HAP_RESERVE
+#define HOMEKIT_MEM_HAP_RESERVE                 (HOMEKIT_NETWORK_MIN_FREEHEAP - HOMEKIT_MIN_FREEHEAP)
+#endif
+
+#ifndef HOMEKIT_MEM_CLOSE_WAIT_MS
+#define HOMEKIT_MEM_CLOSE_WAIT_MS               (200)
+#endif
+
+#ifndef HOMEKIT_SLAB_CLIENTS
+#define HOMEKIT_SLAB_CLIENTS                    (HOMEKIT_MIN_CLIENTS + 2)
+#endif
+
+#ifndef HOMEKIT_SLAB_NOTIFICATIONS
+#define HOMEKIT_SLAB_NOTIFICATIONS              (16)
+#endif
+
 #ifdef HOMEKIT_DEBUG
 #define TLV_DEBUG(values)                       tlv_debug(values)
 #else
@@ -211,6 +229,14 @@ struct _client_context_t {
     struct _client_context_t *next;
 };
 
+static rs_slab_t client_context_slab = RS_SLAB_INITIALIZER("HKC", client_context_t, HOMEKIT_SLAB_CLIENTS);
+static rs_slab_t notification_slab = RS_SLAB_INITIALIZER("HKN", notification_t, HOMEKIT_SLAB_NOTIFICATIONS);
+
+RS_TRACE_PROBE(HAP)
+RS_TRACE_PROBE(ENC)
+RS_TRACE_PROBE(DEC)
+RS_TRACE_PROBE(NTF)
+
 #ifdef HOMEKIT_GET_CLIENTS_INFO
 int32_t homekit_get_unique_client_ipaddr() {
     if (homekit_server && homekit_server->client_count == 1) {
@@ -361,7 +387,7 @@ void pair_verify_context_free(pair_verify_context_t **context) {
 
 
 client_context_t *client_context_new() {
-    client_context_t *c = calloc(1, sizeof(client_context_t));
+    client_context_t *c = rs_slab_alloc(&client_context_slab);
     if (c) {
         c->pairing_id = -1;
         
@@ -387,7 +413,7 @@ void client_context_free(client_context_t *c) {
     if (c->body)
         free(c->body);
     
-    free(c);
+    rs_slab_free(&client_context_slab, c);
 }
 
 
@@ -444,6 +470,156 @@ void IRAM homekit_remove_oldest_client() {
     }
 }
 
+// --- DRAM budget
+typedef struct _homekit_mem_shedder {
+    void (*callback)(const uint32_t needed);
+    homekit_mem_shed_level_t level;
+    struct _homekit_mem_shedder* next;
+} homekit_mem_shedder_t;
+
+static uint32_t homekit_mem_reserved[HOMEKIT_MEM_SUBSYSTEMS] = { 0 };
+static homekit_mem_stats_t homekit_mem_stats[HOMEKIT_MEM_SUBSYSTEMS];
+static homekit_mem_shedder_t* homekit_mem_shedders = NULL;
+static TaskHandle_t homekit_server_task_handle = NULL;
+
+void homekit_mem_reserve(const homekit_mem_subsystem_t subsystem, const uint32_t bytes) {
+    homekit_mem_reserved[subsystem] = bytes;
+}
+
+// Shedders are kept sorted by level, so all caches are shed before any client is closed
+void homekit_mem_add_shedder(void (*callback)(const uint32_t needed), const homekit_mem_shed_level_t level) {
+    homekit_mem_shedder_t* shedder = malloc(sizeof(homekit_mem_shedder_t));
+    if (shedder) {
+        shedder->callback = callback;
+        shedder->level = level;
+        
+        homekit_mem_shedder_t** shedder_last = &homekit_mem_shedders;
+        while (*shedder_last && (*shedder_last)->level <= level) {
+            shedder_last = &(*shedder_last)->next;
+        }
+        
+        shedder->next = *shedder_last;
+        *shedder_last = shedder;
+    }
+}
+
+void homekit_mem_get_stats(const homekit_mem_subsystem_t subsystem, homekit_mem_stats_t* stats) {
+    memcpy(stats, &homekit_mem_stats[subsystem], sizeof(homekit_mem_stats_t));
+}
+
+// Free DRAM that must remain after admitting new work
+static uint32_t homekit_mem_floor(const homekit_mem_subsystem_t subsystem, const homekit_mem_priority_t priority) {
+    uint32_t floor = HOMEKIT_MIN_FREEHEAP;
+    
+    if (priority == HOMEKIT_MEM_PRIORITY_LOW) {
+        for (unsigned int i = 0; i < HOMEKIT_MEM_SUBSYSTEMS; i++) {
+            if (i != subsystem) {
+                floor += homekit_mem_reserved[i];
+            }
+        }
+    }
+    
+    return floor;
+}
+
+static uint32_t homekit_mem_free_heap(const homekit_mem_subsystem_t subsystem) {
+    const uint32_t free_heap = xPortGetFreeHeapSize();
+    if (homekit_mem_stats[subsystem].min_free_heap == 0 || free_heap < homekit_mem_stats[subsystem].min_free_heap) {
+        homekit_mem_stats[subsystem].min_free_heap = free_heap;
+    }
+    
+    return free_heap;
+}
+
+// Clients are closed later by server task, so other tasks wait for it to get their DRAM back.
+// Server task can not wait for itself: its closed clients are released at end of current loop
+static void homekit_mem_wait_close() {
+    if (homekit_server && homekit_server_task_handle && xTaskGetCurrentTaskHandle() != homekit_server_task_handle) {
+        for (unsigned int i = 0; homekit_server->pending_close && i < (HOMEKIT_MEM_CLOSE_WAIT_MS / 10); i++) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+// Low priority work only sheds caches, normal priority work also closes not verified clients,
+// and high priority work closes oldest client too. Returns free DRAM after shedding
+static uint32_t homekit_mem_shed(const homekit_mem_subsystem_t subsystem, const uint32_t needed, const homekit_mem_priority_t priority) {
+    homekit_mem_stats[subsystem].sheds++;
+    
+    const homekit_mem_shed_level_t max_level = (priority == HOMEKIT_MEM_PRIORITY_LOW) ? HOMEKIT_MEM_SHED_CACHES : HOMEKIT_MEM_SHED_CLIENTS;
+    uint32_t free_heap = homekit_mem_free_heap(subsystem);
+    
+    homekit_mem_shedder_t* shedder = homekit_mem_shedders;
+    while (shedder && free_heap < needed && shedder->level <= max_level) {
+        shedder->callback(needed - free_heap);
+        
+        if (shedder->level == HOMEKIT_MEM_SHED_CLIENTS) {
+            homekit_mem_wait_close();
+        }
+        
+        free_heap = homekit_mem_free_heap(subsystem);
+        shedder = shedder->next;
+    }
+    
+    if (free_heap < needed && priority == HOMEKIT_MEM_PRIORITY_HIGH &&
+        homekit_server && homekit_server->client_count > HOMEKIT_MIN_CLIENTS) {
+        homekit_mem_stats[subsystem].evictions++;
+        homekit_remove_oldest_client();
+        homekit_mem_wait_close();
+        free_heap = homekit_mem_free_heap(subsystem);
+    }
+    
+    return free_heap;
+}
+
+bool homekit_mem_admit(const homekit_mem_subsystem_t subsystem, const uint32_t size, const homekit_mem_priority_t priority) {
+    const uint32_t needed = homekit_mem_floor(subsystem, priority) + size;
+    uint32_t free_heap = homekit_mem_free_heap(subsystem);
+    
+    if (free_heap < needed) {
+        free_heap = homekit_mem_shed(subsystem, needed, priority);
+    }
+    
+    // High priority work is always admitted
+    if (free_heap < needed && priority != HOMEKIT_MEM_PRIORITY_HIGH) {
+        homekit_mem_stats[subsystem].refused++;
+        HOMEKIT_ERROR("DRAM refused %i: %"HK_LONGINT_F"/%"HK_LONGINT_F, subsystem, free_heap, needed);
+        return false;
+    }
+    
+    homekit_mem_stats[subsystem].admitted++;
+    homekit_mem_stats[subsystem].admitted_bytes += size;
+    
+    return true;
+}
+
+void homekit_mem_recover(const homekit_mem_subsystem_t subsystem, const uint32_t size, const homekit_mem_priority_t priority) {
+    homekit_mem_stats[subsystem].failures++;
+    
+    homekit_mem_shed(subsystem, HOMEKIT_MIN_FREEHEAP + size, priority);
+}
+
+// Cache low-water callback: pools of slab caches without objects in use are given back to heap
+static void homekit_shed_slab_pools(const uint32_t needed) {
+    rs_slab_shrink();
+}
+
+// HAP low-water callback: connections not verified yet are closed before any verified one
+static void homekit_shed_unverified_clients(const uint32_t needed) {
+    if (homekit_server) {
+        client_context_t* context = homekit_server->clients;
+        while (context) {
+            if (!context->encrypted && !context->verify_context && !context->disconnect &&
+                !(homekit_server->pairing_context && homekit_server->pairing_context->client == context)) {
+                CLIENT_INFO(context, "Closing unverified");
+                homekit_disconnect_client(context);
+            }
+            
+            context = context->next;
+        }
+    }
+}
+
 
 typedef enum {
     characteristic_format_type   = (1 << 1),
@@ -742,11 +918,13 @@ int client_send_encrypted(client_context_t *context, byte *payload, size_t size)
         }
         
         size_t available = sizeof(homekit_server->encrypted) - 2;
+        RS_TRACE_START(ENC);
         int r = crypto_chacha20poly1305_encrypt(
             context->read_key, nonce, aead, 2,
             payload + payload_offset, chunk_size,
             homekit_server->encrypted + 2, &available
         );
+        RS_TRACE_STOP(ENC);
         if (r) {
             CLIENT_ERROR(context, "Enc payload (%d)", r);
             return -1;
@@ -807,11 +985,13 @@ int client_decrypt(client_context_t *context, byte *payload, size_t payload_size
         }
 
         size_t decrypted_len = *decrypted_size - decrypted_offset;
+        RS_TRACE_START(DEC);
         int r = crypto_chacha20poly1305_decrypt(
             context->write_key, nonce, payload + payload_offset, 2,
             payload + payload_offset + 2, chunk_size + 16,
             decrypted, &decrypted_len
         );
+        RS_TRACE_STOP(DEC);
         if (r) {
             CLIENT_ERROR(context, "Decrypt payload (%d)", r);
             return -1;
@@ -935,7 +1115,7 @@ void send_tlv_response(client_context_t *context, tlv_values_t *values) {
     if (!payload) {
         CLIENT_ERROR(context, "TLV payload DRAM");
         tlv_free(values);
-        homekit_remove_oldest_client();
+        homekit_mem_recover(HOMEKIT_MEM_HAP, payload_size, HOMEKIT_MEM_PRIORITY_NORMAL);
         return;
     }
     
@@ -959,7 +1139,7 @@ void send_tlv_response(client_context_t *context, tlv_values_t *values) {
     if (!response) {
         CLIENT_ERROR(context, "TLV response DRAM");
         free(payload);
-        homekit_remove_oldest_client();
+        homekit_mem_recover(HOMEKIT_MEM_HAP, response_size, HOMEKIT_MEM_PRIORITY_NORMAL);
         return;
     }
     
@@ -1015,7 +1195,7 @@ void send_json_response(client_context_t *context, int status_code, byte *payloa
     char *response = malloc(response_size);
     if (!response) {
         CLIENT_ERROR(context, "Buffer of %d DRAM", response_size);
-        homekit_remove_oldest_client();
+        homekit_mem_recover(HOMEKIT_MEM_HAP, response_size, HOMEKIT_MEM_PRIORITY_NORMAL);
         return;
     }
     size_t response_len = snprintf(response, response_size, http_headers, status_code, status_text, payload_size);
@@ -2323,7 +2503,7 @@ void homekit_server_on_update_characteristics(client_context_t *context, const b
     CLIENT_INFO(context, "Upd CH");
     DEBUG_HEAP();
     
-    cJSON_rsf *json = cJSON_rsf_Parse((char*) data);
+    cJSON_rsf *json = cJSON_rsf_ParseArena((char*) data, true);
 
     if (!json) {
         CLIENT_ERROR(context, "Parse JSON");
@@ -3227,6 +3407,8 @@ int homekit_server_on_body(http_parser *parser, const char *data, size_t length)
 }
 
 int homekit_server_on_message_complete(http_parser *parser) {
+    RS_TRACE_START(HAP);
+    
     client_context_t *context = parser->data;
     
     switch(context->endpoint) {
@@ -3299,6 +3481,8 @@ int homekit_server_on_message_complete(http_parser *parser) {
         context->body = NULL;
         context->body_length = 0;
     }
+    
+    RS_TRACE_STOP(HAP);
 
     return 0;
 }
@@ -3443,8 +3627,10 @@ static inline void homekit_server_accept_client() {
         HOMEKIT_ERROR("[%i] DRAM %s:%d %i/%i HEAP %"HK_LONGINT_F, s, address_buffer, addr.sin_port, homekit_server->client_count, homekit_server->config->max_clients, free_heap);
     }
     
-    if (homekit_server->client_count >= homekit_server->config->max_clients || !new_context) {
+    if (homekit_server->client_count >= homekit_server->config->max_clients) {
         homekit_remove_oldest_client();
+    } else if (!new_context) {
+        homekit_mem_recover(HOMEKIT_MEM_HAP, sizeof(client_context_t), HOMEKIT_MEM_PRIORITY_NORMAL);
     }
 }
 
@@ -3465,7 +3651,7 @@ void homekit_characteristic_notify(homekit_characteristic_t *ch) {
             }
         }
         
-        notification_t* notification_new = calloc(1, sizeof(notification_t));
+        notification_t* notification_new = rs_slab_alloc(&notification_slab);
         
         notification_new->ch = ch;
         
@@ -3478,6 +3664,8 @@ void homekit_characteristic_notify(homekit_characteristic_t *ch) {
 }
 
 static inline void IRAM homekit_server_process_notifications() {
+    RS_TRACE_START(NTF);
+    
     notification_t *notifications = homekit_server->notifications;
     homekit_server->notifications = NULL;
     
@@ -3541,8 +3729,10 @@ static inline void IRAM homekit_server_process_notifications() {
     while (notifications) {
         notification_t* notification_old = notifications;
         notifications = notifications->next;
-        free(notification_old);
+        rs_slab_free(&notification_slab, notification_old);
     }
+    
+    RS_TRACE_STOP(NTF);
 }
 
 static inline void homekit_server_close_clients() {
@@ -3625,12 +3815,13 @@ static void IRAM homekit_run_server() {
             }
             
             if (homekit_low_dram()) {
-                homekit_remove_oldest_client();
+                homekit_mem_recover(HOMEKIT_MEM_HAP, 0, HOMEKIT_MEM_PRIORITY_HIGH);
             }
-            
-            homekit_server_close_clients();
         }
         
+        // Clients closed by other tasks to get DRAM back are released without waiting for network activity
+        homekit_server_close_clients();
+        
         if (homekit_server->notifications) {
             homekit_server_process_notifications();
         }
@@ -3792,6 +3983,14 @@ void homekit_server_init(homekit_server_config_t *config) {
     homekit_server = server_new();
     homekit_server->config = config;
     
+    homekit_mem_reserve(HOMEKIT_MEM_HAP, HOMEKIT_MEM_HAP_RESERVE);
+    homekit_mem_add_shedder(homekit_shed_slab_pools, HOMEKIT_MEM_SHED_CACHES);
+    homekit_mem_add_shedder(homekit_shed_unverified_clients, HOMEKIT_MEM_SHED_CLIENTS);
+    
+    // Pools are taken now, while heap is not fragmented
+    rs_slab_reserve(&client_context_slab);
+    rs_slab_reserve(&notification_slab);
+    
     if (homekit_server->config->max_clients == 0) {
         homekit_server->config->max_clients = HOMEKIT_MAX_CLIENTS_DEFAULT;
     }
@@ -3838,7 +4037,7 @@ void homekit_server_init(homekit_server_config_t *config) {
     }
 #endif
     
-    if (xTaskCreate(homekit_server_task, "HK", server_task_stack, NULL, SERVER_TASK_PRIORITY, NULL) != pdPASS) {
+    if (xTaskCreate(homekit_server_task, "HK", server_task_stack, NULL, SERVER_TASK_PRIORITY, &homekit_server_task_handle) != pdPASS) {
         ERROR("New HK");
     }
 }
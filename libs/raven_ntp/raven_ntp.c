@@ -73,8 +73,11 @@ time_t raven_ntp_get_time() {
 }
 
 void raven_ntp_get_log_time(char* buffer, const size_t buffer_size) {
+    raven_ntp_format_log_time(raven_ntp_get_time(), buffer, buffer_size);
+}
+
+void raven_ntp_format_log_time(time_t utc_time, char* buffer, const size_t buffer_size) {
     struct tm* timeinfo;
-    time_t utc_time = raven_ntp_get_time();
     timeinfo = localtime(&utc_time);
     
     char month[4];
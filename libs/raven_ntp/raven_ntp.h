@@ -17,6 +17,7 @@ extern "C" {
 int raven_ntp_update(char* ntp_server);
 time_t raven_ntp_get_time();
 void raven_ntp_get_log_time(char* buffer, const size_t buffer_size);
+void raven_ntp_format_log_time(time_t utc_time, char* buffer, const size_t buffer_size);
 
 #ifdef __cplusplus
 }
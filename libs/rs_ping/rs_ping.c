@@ -36,6 +36,11 @@
 #define PING_ID        0xFAA0
 #endif
 
+/** ping identifier used by rs_ping_multi() */
+#ifndef PING_MULTI_ID
+#define PING_MULTI_ID  0xFAA1
+#endif
+
 /** ping additional data size to include in the packet */
 #ifndef PING_DATA_SIZE
 #define PING_DATA_SIZE 2
@@ -45,15 +50,15 @@
 static u16_t ping_seq_num;
 
 /** Prepare a echo ICMP request */
-static void ping_prepare_echo(struct icmp_echo_hdr *iecho, u16_t len) {
+static void ping_prepare_echo(struct icmp_echo_hdr *iecho, u16_t len, u16_t id, u16_t seqno) {
     size_t i;
     size_t data_len = len - sizeof(struct icmp_echo_hdr);
 
     ICMPH_TYPE_SET(iecho, ICMP_ECHO);
     ICMPH_CODE_SET(iecho, 0);
     iecho->chksum = 0;
-    iecho->id = PING_ID;
-    iecho->seqno = lwip_htons(++ping_seq_num);
+    iecho->id = id;
+    iecho->seqno = lwip_htons(seqno);
 
     /* fill the additional data buffer with some data */
     for (i = 0; i < data_len; i++) {
@@ -64,7 +69,7 @@ static void ping_prepare_echo(struct icmp_echo_hdr *iecho, u16_t len) {
 }
 
 /* Ping using the socket ip */
-static err_t ping_send(int s, const ip_addr_t *addr) {
+static err_t ping_send(int s, const ip_addr_t *addr, u16_t id, u16_t seqno) {
     int err;
     struct icmp_echo_hdr *iecho;
     struct sockaddr_storage to;
@@ -82,7 +87,7 @@ static err_t ping_send(int s, const ip_addr_t *addr) {
         return ERR_MEM;
     }
 
-    ping_prepare_echo(iecho, (u16_t) ping_size);
+    ping_prepare_echo(iecho, (u16_t) ping_size, id, seqno);
 
 #if LWIP_IPV4
     if (IP_IS_V4(addr)) {
@@ -142,6 +147,12 @@ static int ping_recv(int s) {
                 struct icmp_echo_hdr *iecho;
 
                 iphdr = (struct ip_hdr*) buf;
+                if (len < (int) ((IPH_HL(iphdr) * 4) + sizeof(struct icmp_echo_hdr))) {
+                    // IP header with options leaves no room for ICMP header
+                    fromlen = sizeof(from);
+                    continue;
+                }
+                
                 iecho = (struct icmp_echo_hdr*) (buf + (IPH_HL(iphdr) * 4));
                 if (iecho->id == PING_ID &&
                     iecho->seqno == lwip_htons(ping_seq_num) &&
@@ -189,10 +200,85 @@ int rs_ping(ip_addr_t ping_target) {
     lwip_setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &sndtimeout, sizeof(sndtimeout));
     lwip_setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
     
-    if (ping_send(s, &ping_target) == ERR_OK) {
+    if (ping_send(s, &ping_target, PING_ID, ++ping_seq_num) == ERR_OK) {
         result = ping_recv(s);
     }
     lwip_close(s);
     
     return result;
 }
+
+/** Echo requests are sent to all targets at once, and replies are matched by their sequence number,
+ *  so a sweep takes about one round trip time plus PING_RCV_TIMEO for each retry of unanswered targets */
+int rs_ping_multi(const ip_addr_t* ping_targets, int8_t* results, const unsigned int count, const unsigned int retries) {
+    int s = lwip_socket(AF_INET, SOCK_RAW, IP_PROTO_ICMP);
+    if (s < 0) {
+        printf("! Ping socket (%i)\n", s);
+        return s;
+    }
+    
+    const struct timeval sndtimeout = { 3, 0 };
+    lwip_setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &sndtimeout, sizeof(sndtimeout));
+    
+    // Sequence numbers of this sweep are seq_base + (round * count) + target index
+    const u16_t seq_base = ping_seq_num + 1;
+    ping_seq_num += count * (retries + 1);
+    
+    unsigned int pending = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (results[i] == 0) {
+            pending++;
+        }
+    }
+    
+    for (unsigned int round = 0; round <= retries && pending > 0; round++) {
+        for (unsigned int i = 0; i < count; i++) {
+            if (results[i] == 0) {
+                ping_send(s, &ping_targets[i], PING_MULTI_ID, seq_base + (round * count) + i);
+            }
+        }
+        
+        const uint32_t deadline = sys_now() + PING_RCV_TIMEO;
+        int32_t remaining;
+        while (pending > 0 && (remaining = (int32_t) (deadline - sys_now())) > 0) {
+            const struct timeval timeout = { remaining / 1000, (remaining % 1000) * 1000 };
+            lwip_setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            
+            char buf[64];
+            struct sockaddr_in from;
+            socklen_t fromlen = sizeof(from);
+            const int len = lwip_recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr*) &from, &fromlen);
+            
+            if (len <= 0) {
+                break;
+            }
+            
+            // IP header length is checked too, as options can leave no room for ICMP header
+            if (len >= (int) (sizeof(struct ip_hdr) + sizeof(struct icmp_echo_hdr)) && from.sin_family == AF_INET &&
+                len >= (int) ((IPH_HL((struct ip_hdr*) buf) * 4) + sizeof(struct icmp_echo_hdr))) {
+                struct ip_hdr *iphdr = (struct ip_hdr*) buf;
+                struct icmp_echo_hdr *iecho = (struct icmp_echo_hdr*) (buf + (IPH_HL(iphdr) * 4));
+                
+                const u16_t seq_offset = lwip_ntohs(iecho->seqno) - seq_base;
+                if (iecho->id == PING_MULTI_ID &&
+                    ICMPH_TYPE(iecho) == ICMP_ER &&
+                    seq_offset < count * (retries + 1)) {
+                    const unsigned int i = seq_offset % count;
+                    
+                    ip_addr_t fromaddr;
+                    memset(&fromaddr, 0, sizeof(fromaddr));
+                    inet_addr_to_ip4addr(ip_2_ip4(&fromaddr), &from.sin_addr);
+                    
+                    if (results[i] == 0 && ip4_addr_cmp(ip_2_ip4(&fromaddr), ip_2_ip4(&ping_targets[i]))) {
+                        results[i] = 1;
+                        pending--;
+                    }
+                }
+            }
+        }
+    }
+    
+    lwip_close(s);
+    
+    return 0;
+}
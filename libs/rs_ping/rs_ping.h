@@ -13,4 +13,8 @@
 
 int rs_ping(ip_addr_t ping_addr);
 
+// Pings all targets in parallel. Only targets with results[i] == 0 are pinged, and they are set to 1 when they reply.
+// Returns negative value if socket can not be opened
+int rs_ping_multi(const ip_addr_t* ping_targets, int8_t* results, const unsigned int count, const unsigned int retries);
+
 #endif // __BINARY_PING__
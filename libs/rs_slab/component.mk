@@ -0,0 +1,8 @@
+# Component makefile for rs_slab
+
+INC_DIRS += $(rs_slab_ROOT)
+
+rs_slab_INC_DIR = $(rs_slab_ROOT)
+rs_slab_SRC_DIR = $(rs_slab_ROOT)
+
+$(eval $(call component_compile_rules,rs_slab))
@@ -0,0 +1,204 @@
+/*
+ * RavenSystem Slab Allocator
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static portMUX_TYPE rs_slab_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+#define RS_SLAB_ENTER_CRITICAL()        taskENTER_CRITICAL(&rs_slab_spinlock)
+#define RS_SLAB_EXIT_CRITICAL()         taskEXIT_CRITICAL(&rs_slab_spinlock)
+
+#else   // ESP-OPEN-RTOS
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#define RS_SLAB_ENTER_CRITICAL()        taskENTER_CRITICAL()
+#define RS_SLAB_EXIT_CRITICAL()         taskEXIT_CRITICAL()
+
+#endif
+
+#include "rs_slab.h"
+
+// Free objects store next free object in their first bytes
+#define RS_SLAB_ALIGN                   (sizeof(void*))
+#define RS_SLAB_OBJECT_SIZE(size)       (((size) + RS_SLAB_ALIGN - 1) & ~(RS_SLAB_ALIGN - 1))
+
+static rs_slab_t* rs_slabs = NULL;
+
+void rs_slab_reserve(rs_slab_t* slab) {
+    if (slab->is_reserved) {
+        return;
+    }
+
+    // Heap is not called inside critical section. If other task reserves same cache meanwhile, this pool is discarded
+    const size_t object_size = RS_SLAB_OBJECT_SIZE(slab->object_size);
+    uint8_t* pool = malloc(object_size * slab->capacity);
+    unsigned int capacity = slab->capacity;
+    if (!pool) {
+        capacity = 0;
+    }
+
+    bool is_used = false;
+
+    RS_SLAB_ENTER_CRITICAL();
+
+    if (!slab->is_reserved) {
+        is_used = true;
+
+        // A cache without pool, because there was no memory, takes all its objects from heap
+        slab->is_reserved = true;
+        slab->pool = pool;
+        slab->pool_end = pool + (object_size * capacity);
+        slab->capacity = capacity;
+
+        void* free_list = NULL;
+        for (int i = capacity - 1; i >= 0; i--) {
+            void** object = (void**) (pool + (object_size * i));
+            *object = free_list;
+            free_list = object;
+        }
+        slab->free_list = free_list;
+
+        // A cache reserved again after rs_slab_shrink() is already listed
+        rs_slab_t** slab_last = &rs_slabs;
+        while (*slab_last && *slab_last != slab) {
+            slab_last = &(*slab_last)->next;
+        }
+        if (!*slab_last) {
+            *slab_last = slab;
+        }
+    }
+
+    RS_SLAB_EXIT_CRITICAL();
+
+    if (!is_used && pool) {
+        free(pool);
+    }
+}
+
+void* rs_slab_alloc(rs_slab_t* slab) {
+    if (!slab->is_reserved) {
+        rs_slab_reserve(slab);
+    }
+
+    RS_SLAB_ENTER_CRITICAL();
+
+    void** object = slab->free_list;
+    if (object) {
+        slab->free_list = *object;
+        slab->in_use++;
+        if (slab->in_use > slab->peak) {
+            slab->peak = slab->in_use;
+        }
+    }
+    slab->allocs++;
+
+    RS_SLAB_EXIT_CRITICAL();
+
+    if (object) {
+        memset(object, 0, slab->object_size);
+        return object;
+    }
+
+    void* heap_object = calloc(1, slab->object_size);
+    if (heap_object) {
+        RS_SLAB_ENTER_CRITICAL();
+        slab->heap_allocs++;
+        RS_SLAB_EXIT_CRITICAL();
+    }
+
+    return heap_object;
+}
+
+void rs_slab_free(rs_slab_t* slab, void* object) {
+    if (!object) {
+        return;
+    }
+
+    if ((uint8_t*) object >= slab->pool && (uint8_t*) object < slab->pool_end) {
+        RS_SLAB_ENTER_CRITICAL();
+
+        *((void**) object) = slab->free_list;
+        slab->free_list = object;
+        slab->in_use--;
+
+        RS_SLAB_EXIT_CRITICAL();
+
+    } else {
+        free(object);
+    }
+}
+
+size_t rs_slab_shrink() {
+    size_t freed = 0;
+
+    rs_slab_t* slab = rs_slabs;
+    while (slab) {
+        uint8_t* pool = NULL;
+        size_t pool_size = 0;
+
+        RS_SLAB_ENTER_CRITICAL();
+
+        // Without objects in use, no pointer into pool exists. Cache takes a new pool at its next allocation
+        if (slab->is_reserved && slab->pool && slab->in_use == 0) {
+            pool = slab->pool;
+            pool_size = slab->pool_end - slab->pool;
+
+            slab->is_reserved = false;
+            slab->pool = NULL;
+            slab->pool_end = NULL;
+            slab->free_list = NULL;
+        }
+
+        rs_slab_t* slab_next = slab->next;
+
+        RS_SLAB_EXIT_CRITICAL();
+
+        if (pool) {
+            free(pool);
+            freed += pool_size;
+        }
+
+        slab = slab_next;
+    }
+
+    return freed;
+}
+
+bool rs_slab_get_stats(const unsigned int index, rs_slab_stats_t* stats) {
+    bool found = false;
+
+    RS_SLAB_ENTER_CRITICAL();
+
+    rs_slab_t* slab = rs_slabs;
+    for (unsigned int i = 0; slab && i < index; i++) {
+        slab = slab->next;
+    }
+
+    if (slab) {
+        found = true;
+
+        stats->name = slab->name;
+        stats->object_size = slab->object_size;
+        stats->capacity = slab->capacity;
+        stats->in_use = slab->in_use;
+        stats->peak = slab->peak;
+        stats->allocs = slab->allocs;
+        stats->heap_allocs = slab->heap_allocs;
+    }
+
+    RS_SLAB_EXIT_CRITICAL();
+
+    return found;
+}
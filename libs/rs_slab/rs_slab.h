@@ -0,0 +1,69 @@
+/*
+ * RavenSystem Slab Allocator
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifndef __RS_SLAB_H__
+#define __RS_SLAB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Fixed size object caches for small and short living objects.
+// Pool of each cache is taken from heap in one block at first use, and objects are reused from it,
+// so they don't fragment heap. When pool is full, objects are taken from heap, and returned to it when freed.
+typedef struct _rs_slab {
+    const char* name;
+    uint16_t object_size;
+    uint16_t capacity;
+
+    bool is_reserved;
+    uint8_t* pool;
+    uint8_t* pool_end;
+    void* free_list;
+
+    uint16_t in_use;
+    uint16_t peak;
+    uint32_t allocs;
+    uint32_t heap_allocs;       // Allocations served by heap because pool was full
+
+    struct _rs_slab* next;
+} rs_slab_t;
+
+#define RS_SLAB_INITIALIZER(slab_name, type, slab_capacity)     { .name = (slab_name), .object_size = sizeof(type), .capacity = (slab_capacity) }
+
+typedef struct _rs_slab_stats {
+    const char* name;
+    uint16_t object_size;
+    uint16_t capacity;
+    uint16_t in_use;
+    uint16_t peak;
+    uint32_t allocs;
+    uint32_t heap_allocs;
+} rs_slab_stats_t;
+
+// Returns zeroed object, like calloc(), or NULL if there is no memory
+void* rs_slab_alloc(rs_slab_t* slab);
+void rs_slab_free(rs_slab_t* slab, void* object);
+
+// Takes pool from heap now, instead of at first allocation
+void rs_slab_reserve(rs_slab_t* slab);
+
+// Gives back to heap pools of caches without objects in use, like when DRAM is low. Returns freed bytes
+size_t rs_slab_shrink();
+
+// Stats of used caches, by creation order. Returns false when index is beyond last cache
+bool rs_slab_get_stats(const unsigned int index, rs_slab_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __RS_SLAB_H__
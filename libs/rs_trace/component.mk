@@ -0,0 +1,8 @@
+# Component makefile for rs_trace
+
+INC_DIRS += $(rs_trace_ROOT)
+
+rs_trace_INC_DIR = $(rs_trace_ROOT)
+rs_trace_SRC_DIR = $(rs_trace_ROOT)
+
+$(eval $(call component_compile_rules,rs_trace))
@@ -0,0 +1,148 @@
+/*
+ * RavenSystem Latency Trace
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifdef RS_TRACE
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static portMUX_TYPE rs_trace_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+#define RS_TRACE_ENTER_CRITICAL()       taskENTER_CRITICAL(&rs_trace_spinlock)
+#define RS_TRACE_EXIT_CRITICAL()        taskEXIT_CRITICAL(&rs_trace_spinlock)
+
+#else   // ESP-OPEN-RTOS
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#define RS_TRACE_ENTER_CRITICAL()       taskENTER_CRITICAL()
+#define RS_TRACE_EXIT_CRITICAL()        taskEXIT_CRITICAL()
+
+#endif
+
+#include "rs_trace.h"
+
+static rs_trace_probe_t* rs_trace_probes = NULL;
+
+void rs_trace_record(rs_trace_probe_t* probe, const uint32_t start) {
+    const uint32_t elapsed_us = rs_trace_now() - start;
+
+    unsigned int bucket = 0;
+    if (elapsed_us > 0) {
+        bucket = 32 - __builtin_clz(elapsed_us);
+        if (bucket >= RS_TRACE_BUCKETS) {
+            bucket = RS_TRACE_BUCKETS - 1;
+        }
+    }
+
+    RS_TRACE_ENTER_CRITICAL();
+
+    if (!probe->is_registered) {
+        probe->is_registered = true;
+
+        rs_trace_probe_t** probe_last = &rs_trace_probes;
+        while (*probe_last) {
+            probe_last = &(*probe_last)->next;
+        }
+        *probe_last = probe;
+    }
+
+    probe->count++;
+    probe->total_us += elapsed_us;
+    if (elapsed_us > probe->max_us) {
+        probe->max_us = elapsed_us;
+    }
+
+    if (probe->histogram[bucket] < UINT16_MAX) {
+        probe->histogram[bucket]++;
+    }
+
+    RS_TRACE_EXIT_CRITICAL();
+}
+
+// Upper bound of bucket where given per mille of recorded durations is reached
+static uint32_t rs_trace_percentile_us(const uint16_t* histogram, const uint32_t histogram_count, const unsigned int per_mille) {
+    const uint32_t target = ((uint64_t) histogram_count * per_mille + 999) / 1000;
+
+    uint32_t count = 0;
+    for (unsigned int i = 0; i < RS_TRACE_BUCKETS; i++) {
+        count += histogram[i];
+        if (count >= target) {
+            return (1 << i);
+        }
+    }
+
+    return (1 << (RS_TRACE_BUCKETS - 1));
+}
+
+size_t rs_trace_summary(char* buffer, const size_t size) {
+    size_t len = 0;
+    buffer[0] = 0;
+
+    RS_TRACE_ENTER_CRITICAL();
+    rs_trace_probe_t* probe = rs_trace_probes;
+    RS_TRACE_EXIT_CRITICAL();
+
+    while (probe) {
+        // Copied in critical section, so snprintf() is called outside it
+        rs_trace_probe_t probe_copy;
+        RS_TRACE_ENTER_CRITICAL();
+        memcpy(&probe_copy, probe, sizeof(rs_trace_probe_t));
+        RS_TRACE_EXIT_CRITICAL();
+
+        if (probe_copy.count > 0) {
+            uint32_t histogram_count = 0;
+            for (unsigned int i = 0; i < RS_TRACE_BUCKETS; i++) {
+                histogram_count += probe_copy.histogram[i];
+            }
+
+            const int written = snprintf(buffer + len, size - len, "%s n%u avg%u p50<%u p90<%u p99<%u max%u\n",
+                                         probe_copy.name,
+                                         (unsigned int) probe_copy.count,
+                                         (unsigned int) (probe_copy.total_us / probe_copy.count),
+                                         (unsigned int) rs_trace_percentile_us(probe_copy.histogram, histogram_count, 500),
+                                         (unsigned int) rs_trace_percentile_us(probe_copy.histogram, histogram_count, 900),
+                                         (unsigned int) rs_trace_percentile_us(probe_copy.histogram, histogram_count, 990),
+                                         (unsigned int) probe_copy.max_us);
+
+            if (written < 0 || (size_t) written >= size - len) {
+                buffer[len] = 0;
+                break;
+            }
+
+            len += written;
+        }
+
+        probe = probe_copy.next;
+    }
+
+    return len;
+}
+
+void rs_trace_reset() {
+    RS_TRACE_ENTER_CRITICAL();
+
+    rs_trace_probe_t* probe = rs_trace_probes;
+    while (probe) {
+        probe->count = 0;
+        probe->max_us = 0;
+        probe->total_us = 0;
+        memset(probe->histogram, 0, sizeof(probe->histogram));
+
+        probe = probe->next;
+    }
+
+    RS_TRACE_EXIT_CRITICAL();
+}
+
+#endif  // RS_TRACE
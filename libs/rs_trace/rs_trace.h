@@ -0,0 +1,78 @@
+/*
+ * RavenSystem Latency Trace
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifndef __RS_TRACE_H__
+#define __RS_TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Latency probes with a log2 histogram each. They are only built with -DRS_TRACE, and otherwise macros are empty.
+// Probes are declared once per file with RS_TRACE_PROBE(name), and measured with RS_TRACE_START(name) and RS_TRACE_STOP(name).
+
+#ifdef RS_TRACE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <espressif/esp_common.h>
+#endif
+
+#define RS_TRACE_BUCKETS                (24)        // Bucket n has durations from 2^(n-1) to 2^n - 1 us. Last one has all longer durations
+#define RS_TRACE_SUMMARY_SIZE           (1024)
+
+typedef struct _rs_trace_probe {
+    const char* name;
+    bool is_registered;
+
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint16_t histogram[RS_TRACE_BUCKETS];
+
+    struct _rs_trace_probe* next;
+} rs_trace_probe_t;
+
+// Time in us. CPU cycle counter is not used, as ESP8266 one wraps after 26 s at 160 MHz and ESP32 ones differ between cores.
+// This one wraps after 71 minutes, so longer durations are not measured right
+static inline uint32_t rs_trace_now() {
+#ifdef ESP_PLATFORM
+    return (uint32_t) esp_timer_get_time();
+#else
+    return sdk_system_get_time();
+#endif
+}
+
+void rs_trace_record(rs_trace_probe_t* probe, const uint32_t start);
+
+// Writes one line per used probe: name, count, average, p50, p90 and p99 upper bounds, and max, all in us.
+// Returns written length
+size_t rs_trace_summary(char* buffer, const size_t size);
+void rs_trace_reset();
+
+#define RS_TRACE_PROBE(probe)           static rs_trace_probe_t rs_trace_probe_##probe = { .name = #probe };
+#define RS_TRACE_START(probe)           const uint32_t rs_trace_start_##probe = rs_trace_now()
+#define RS_TRACE_STOP(probe)            rs_trace_record(&rs_trace_probe_##probe, rs_trace_start_##probe)
+
+#else   // RS_TRACE
+
+#define RS_TRACE_PROBE(probe)
+#define RS_TRACE_START(probe)
+#define RS_TRACE_STOP(probe)
+
+#endif  // RS_TRACE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __RS_TRACE_H__
@@ -1,116 +1,409 @@
-/*
- * RavenSystem ESP Timers Helper
- *
- * Copyright 2020-2022 José Antonio Jiménez Campos (@RavenSystem)
- *
- */
-
-#include <stdio.h>
-
-#ifdef ESP_PLATFORM
-
-#include "esp_attr.h"
-#define IRAM            IRAM_ATTR
-
-#endif
-
-#include "timers_helper.h"
-
-#define XTIMER_MAX_TRIES                (5)
-
-BaseType_t rs_esp_timer_manager(const uint8_t option, TimerHandle_t xTimer, TickType_t xBlockTime) {
-    if (xTimer) {
-        switch (option) {
-            case TIMER_MANAGER_STOP:
-                return xTimerStop(xTimer, xBlockTime);
-                
-            case TIMER_MANAGER_DELETE:
-                return xTimerDelete(xTimer, xBlockTime);
-                
-            default:    // TIMER_MANAGER_START:
-                return xTimerStart(xTimer, xBlockTime);
-        }
-    }
-    
-    return pdFALSE;
-}
-
-BaseType_t rs_esp_timer_change_period_manager(TimerHandle_t xTimer, const uint32_t new_period_ms, TickType_t xBlockTime) {
-    if (xTimer) {
-        return xTimerChangePeriod(xTimer, new_period_ms / portTICK_PERIOD_MS, xBlockTime);
-    }
-    
-    return pdFALSE;
-}
-
-BaseType_t IRAM rs_esp_timer_manager_from_ISR(const uint8_t option, TimerHandle_t xTimer) {
-    if (xTimer) {
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        
-        switch (option) {
-            case TIMER_MANAGER_STOP:
-                return xTimerStopFromISR(xTimer, &xHigherPriorityTaskWoken);
-                
-            default:    // TIMER_MANAGER_START:
-                return xTimerStartFromISR(xTimer, &xHigherPriorityTaskWoken);
-        }
-    }
-    
-    return pdFALSE;
-}
-
-TimerHandle_t rs_esp_timer_create(const uint32_t period_ms, const UBaseType_t auto_reload, void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction) {
-    unsigned int tries = 0;
-    
-    TimerHandle_t result;
-    while (!(result = xTimerCreate(NULL, period_ms / portTICK_PERIOD_MS, auto_reload, pvTimerID, pxCallbackFunction))) {
-        tries++;
-        //printf("! Timer Create Failed (%i/%i)\n", tries, XTIMER_MAX_TRIES);
-        if (tries == XTIMER_MAX_TRIES) {
-            break;
-        }
-        vTaskDelay(tries);
-    }
-    
-    return result;
-}
-
-BaseType_t rs_esp_timer_start(TimerHandle_t xTimer) {
-    return rs_esp_timer_manager(TIMER_MANAGER_START, xTimer, 0);
-}
-
-BaseType_t rs_esp_timer_stop(TimerHandle_t xTimer) {
-    return rs_esp_timer_manager(TIMER_MANAGER_STOP, xTimer, 0);
-}
-
-BaseType_t rs_esp_timer_delete(TimerHandle_t xTimer) {
-    return rs_esp_timer_manager(TIMER_MANAGER_DELETE, xTimer, 0);
-}
-
-BaseType_t rs_esp_timer_change_period(TimerHandle_t xTimer, const uint32_t new_period_ms) {
-    return rs_esp_timer_change_period_manager(xTimer, new_period_ms, 0);
-}
-
-BaseType_t rs_esp_timer_start_forced(TimerHandle_t xTimer) {
-    return rs_esp_timer_manager(TIMER_MANAGER_START, xTimer, portMAX_DELAY);
-}
-
-BaseType_t rs_esp_timer_stop_forced(TimerHandle_t xTimer) {
-    return rs_esp_timer_manager(TIMER_MANAGER_STOP, xTimer, portMAX_DELAY);
-}
-
-BaseType_t rs_esp_timer_delete_forced(TimerHandle_t xTimer) {
-    return rs_esp_timer_manager(TIMER_MANAGER_DELETE, xTimer, portMAX_DELAY);
-}
-
-BaseType_t rs_esp_timer_change_period_forced(TimerHandle_t xTimer, const uint32_t new_period_ms) {
-    return rs_esp_timer_change_period_manager(xTimer, new_period_ms, portMAX_DELAY);
-}
-
-BaseType_t IRAM rs_esp_timer_start_from_ISR(TimerHandle_t xTimer) {
-    return rs_esp_timer_manager_from_ISR(TIMER_MANAGER_START, xTimer);
-}
-
-BaseType_t IRAM rs_esp_timer_stop_from_ISR(TimerHandle_t xTimer) {
-    return rs_esp_timer_manager_from_ISR(TIMER_MANAGER_STOP, xTimer);
-}
+/*
+ * RavenSystem ESP Timers Helper
+ *
+ * Copyright 2020-2022 José Antonio Jiménez Campos (@RavenSystem)
+ *
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+
+#include "esp_attr.h"
+#define IRAM            IRAM_ATTR
+
+#endif
+
+#include "timers_helper.h"
+
+#ifdef ESP_PLATFORM
+
+static portMUX_TYPE rs_wheel_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+#define RS_WHEEL_ENTER_CRITICAL()       taskENTER_CRITICAL(&rs_wheel_spinlock)
+#define RS_WHEEL_EXIT_CRITICAL()        taskEXIT_CRITICAL(&rs_wheel_spinlock)
+
+#else
+
+#define RS_WHEEL_ENTER_CRITICAL()       taskENTER_CRITICAL()
+#define RS_WHEEL_EXIT_CRITICAL()        taskEXIT_CRITICAL()
+
+#endif
+
+#define XTIMER_MAX_TRIES                (5)
+
+// Wheel timers: 3 levels of 64 slots, covering 2^18 ticks (43 min). Longer timers are cascaded again
+#define RS_WHEEL_LEVELS                 (3)
+#define RS_WHEEL_SLOT_BITS              (6)
+#define RS_WHEEL_SLOTS                  (1 << RS_WHEEL_SLOT_BITS)
+#define RS_WHEEL_SLOT_MASK              (RS_WHEEL_SLOTS - 1)
+#define RS_WHEEL_MAX_DELTA              ((1 << (RS_WHEEL_SLOT_BITS * RS_WHEEL_LEVELS)) - 1)
+
+#define RS_WHEEL_OS_TICKS               ((RS_WHEEL_TICK_MS / portTICK_PERIOD_MS) > 0 ? (RS_WHEEL_TICK_MS / portTICK_PERIOD_MS) : 1)
+
+static rs_wheel_timer_t* rs_wheel_slots[RS_WHEEL_LEVELS][RS_WHEEL_SLOTS];
+static uint32_t rs_wheel_tick = 0;
+static TickType_t rs_wheel_os_tick = 0;
+static uint16_t rs_wheel_active = 0;
+static uint32_t rs_wheel_max_late_ticks = 0;
+static TimerHandle_t rs_wheel_driver = NULL;
+static bool rs_wheel_driver_armed = false;
+static TickType_t rs_wheel_driver_due = 0;     // OS tick when armed driver expires
+
+BaseType_t rs_esp_timer_manager(const uint8_t option, TimerHandle_t xTimer, TickType_t xBlockTime) {
+    if (xTimer) {
+        switch (option) {
+            case TIMER_MANAGER_STOP:
+                return xTimerStop(xTimer, xBlockTime);
+                
+            case TIMER_MANAGER_DELETE:
+                return xTimerDelete(xTimer, xBlockTime);
+                
+            default:    // TIMER_MANAGER_START:
+                return xTimerStart(xTimer, xBlockTime);
+        }
+    }
+    
+    return pdFALSE;
+}
+
+BaseType_t rs_esp_timer_change_period_manager(TimerHandle_t xTimer, const uint32_t new_period_ms, TickType_t xBlockTime) {
+    if (xTimer) {
+        return xTimerChangePeriod(xTimer, new_period_ms / portTICK_PERIOD_MS, xBlockTime);
+    }
+    
+    return pdFALSE;
+}
+
+BaseType_t IRAM rs_esp_timer_manager_from_ISR(const uint8_t option, TimerHandle_t xTimer) {
+    if (xTimer) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        
+        switch (option) {
+            case TIMER_MANAGER_STOP:
+                return xTimerStopFromISR(xTimer, &xHigherPriorityTaskWoken);
+                
+            default:    // TIMER_MANAGER_START:
+                return xTimerStartFromISR(xTimer, &xHigherPriorityTaskWoken);
+        }
+    }
+    
+    return pdFALSE;
+}
+
+TimerHandle_t rs_esp_timer_create(const uint32_t period_ms, const UBaseType_t auto_reload, void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction) {
+    unsigned int tries = 0;
+    
+    TimerHandle_t result;
+    while (!(result = xTimerCreate(NULL, period_ms / portTICK_PERIOD_MS, auto_reload, pvTimerID, pxCallbackFunction))) {
+        tries++;
+        //printf("! Timer Create Failed (%i/%i)\n", tries, XTIMER_MAX_TRIES);
+        if (tries == XTIMER_MAX_TRIES) {
+            break;
+        }
+        vTaskDelay(tries);
+    }
+    
+    return result;
+}
+
+BaseType_t rs_esp_timer_start(TimerHandle_t xTimer) {
+    return rs_esp_timer_manager(TIMER_MANAGER_START, xTimer, 0);
+}
+
+BaseType_t rs_esp_timer_stop(TimerHandle_t xTimer) {
+    return rs_esp_timer_manager(TIMER_MANAGER_STOP, xTimer, 0);
+}
+
+BaseType_t rs_esp_timer_delete(TimerHandle_t xTimer) {
+    return rs_esp_timer_manager(TIMER_MANAGER_DELETE, xTimer, 0);
+}
+
+BaseType_t rs_esp_timer_change_period(TimerHandle_t xTimer, const uint32_t new_period_ms) {
+    return rs_esp_timer_change_period_manager(xTimer, new_period_ms, 0);
+}
+
+BaseType_t rs_esp_timer_start_forced(TimerHandle_t xTimer) {
+    return rs_esp_timer_manager(TIMER_MANAGER_START, xTimer, portMAX_DELAY);
+}
+
+BaseType_t rs_esp_timer_stop_forced(TimerHandle_t xTimer) {
+    return rs_esp_timer_manager(TIMER_MANAGER_STOP, xTimer, portMAX_DELAY);
+}
+
+BaseType_t rs_esp_timer_delete_forced(TimerHandle_t xTimer) {
+    return rs_esp_timer_manager(TIMER_MANAGER_DELETE, xTimer, portMAX_DELAY);
+}
+
+BaseType_t rs_esp_timer_change_period_forced(TimerHandle_t xTimer, const uint32_t new_period_ms) {
+    return rs_esp_timer_change_period_manager(xTimer, new_period_ms, portMAX_DELAY);
+}
+
+BaseType_t IRAM rs_esp_timer_start_from_ISR(TimerHandle_t xTimer) {
+    return rs_esp_timer_manager_from_ISR(TIMER_MANAGER_START, xTimer);
+}
+
+BaseType_t IRAM rs_esp_timer_stop_from_ISR(TimerHandle_t xTimer) {
+    return rs_esp_timer_manager_from_ISR(TIMER_MANAGER_STOP, xTimer);
+}
+
+// Wheel timers
+static void rs_wheel_unlink(rs_wheel_timer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+static void rs_wheel_link(rs_wheel_timer_t* timer) {
+    uint32_t delta = timer->expire_tick - rs_wheel_tick;
+    if (delta > RS_WHEEL_MAX_DELTA) {
+        delta = RS_WHEEL_MAX_DELTA;
+    }
+    
+    const uint32_t slot_tick = rs_wheel_tick + delta;
+    
+    unsigned int level = 0;
+    while (level < (RS_WHEEL_LEVELS - 1) && delta >= (1 << (RS_WHEEL_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    
+    rs_wheel_timer_t** slot = &rs_wheel_slots[level][(slot_tick >> (RS_WHEEL_SLOT_BITS * level)) & RS_WHEEL_SLOT_MASK];
+    
+    timer->next = *slot;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+static void rs_wheel_cascade(const unsigned int level) {
+    rs_wheel_timer_t** slot = &rs_wheel_slots[level][(rs_wheel_tick >> (RS_WHEEL_SLOT_BITS * level)) & RS_WHEEL_SLOT_MASK];
+    rs_wheel_timer_t* timer = *slot;
+    *slot = NULL;
+    
+    while (timer) {
+        rs_wheel_timer_t* next = timer->next;
+        rs_wheel_link(timer);
+        timer = next;
+    }
+}
+
+// Wheel ticks from current one to next one with work: a slot of level 0 expiring, or an occupied slot
+// of upper levels being cascaded. Returns 0 when wheel is empty
+static uint32_t rs_wheel_next_delta() {
+    uint32_t next_delta = 0;
+    
+    for (unsigned int level = 0; level < RS_WHEEL_LEVELS; level++) {
+        const unsigned int shift = RS_WHEEL_SLOT_BITS * level;
+        const uint32_t level_tick = rs_wheel_tick >> shift;
+        
+        for (uint32_t i = 1; i <= RS_WHEEL_SLOTS; i++) {
+            if (rs_wheel_slots[level][(level_tick + i) & RS_WHEEL_SLOT_MASK]) {
+                const uint32_t delta = ((level_tick + i) << shift) - rs_wheel_tick;
+                if (next_delta == 0 || delta < next_delta) {
+                    next_delta = delta;
+                }
+                
+                break;
+            }
+        }
+    }
+    
+    return next_delta;
+}
+
+// Driver is a one-shot timer, armed again only if its new due time is earlier. Sender checks after its command
+// that due time was not changed meanwhile by other task, so last queued command always has current due time
+static BaseType_t rs_wheel_driver_arm() {
+    bool send = false;
+    TickType_t due = 0;
+    
+    RS_WHEEL_ENTER_CRITICAL();
+    
+    const uint32_t delta = rs_wheel_next_delta();
+    if (delta > 0) {
+        due = rs_wheel_os_tick + (delta * RS_WHEEL_OS_TICKS);
+        if (!rs_wheel_driver_armed || (int32_t) (due - rs_wheel_driver_due) < 0) {
+            rs_wheel_driver_armed = true;
+            rs_wheel_driver_due = due;
+            send = true;
+        }
+    }
+    
+    RS_WHEEL_EXIT_CRITICAL();
+    
+    while (send) {
+        TickType_t period = due - xTaskGetTickCount();
+        if ((int32_t) period <= 0) {
+            period = 1;
+        }
+        
+        if (xTimerChangePeriod(rs_wheel_driver, period, 0) != pdPASS) {
+            RS_WHEEL_ENTER_CRITICAL();
+            rs_wheel_driver_armed = false;
+            RS_WHEEL_EXIT_CRITICAL();
+            
+            return pdFALSE;
+        }
+        
+        RS_WHEEL_ENTER_CRITICAL();
+        send = (rs_wheel_driver_armed && rs_wheel_driver_due != due);
+        due = rs_wheel_driver_due;
+        RS_WHEEL_EXIT_CRITICAL();
+    }
+    
+    return pdPASS;
+}
+
+static void rs_wheel_driver_worker(TimerHandle_t xTimer) {
+    RS_WHEEL_ENTER_CRITICAL();
+    rs_wheel_driver_armed = false;
+    RS_WHEEL_EXIT_CRITICAL();
+    
+    for (;;) {
+        rs_wheel_timer_t* expired = NULL;
+        
+        RS_WHEEL_ENTER_CRITICAL();
+        
+        const uint32_t steps = (xTaskGetTickCount() - rs_wheel_os_tick) / RS_WHEEL_OS_TICKS;
+        const uint32_t delta = rs_wheel_next_delta();
+        
+        if (delta == 0 || delta > steps) {
+            // Nothing to do until current time
+            rs_wheel_tick += steps;
+            rs_wheel_os_tick += steps * RS_WHEEL_OS_TICKS;
+            
+            RS_WHEEL_EXIT_CRITICAL();
+            break;
+        }
+        
+        // Ticks without work are skipped
+        rs_wheel_tick += delta;
+        rs_wheel_os_tick += delta * RS_WHEEL_OS_TICKS;
+        const uint32_t late_ticks = steps - delta;
+        
+        if ((rs_wheel_tick & RS_WHEEL_SLOT_MASK) == 0) {
+            if (((rs_wheel_tick >> RS_WHEEL_SLOT_BITS) & RS_WHEEL_SLOT_MASK) == 0) {
+                rs_wheel_cascade(2);
+            }
+            
+            rs_wheel_cascade(1);
+        }
+        
+        // Expired timers are moved to a local list, so callbacks can start or stop any timer
+        rs_wheel_timer_t** slot = &rs_wheel_slots[0][rs_wheel_tick & RS_WHEEL_SLOT_MASK];
+        expired = *slot;
+        *slot = NULL;
+        if (expired) {
+            expired->pprev = &expired;
+        }
+        
+        RS_WHEEL_EXIT_CRITICAL();
+        
+        for (;;) {
+            RS_WHEEL_ENTER_CRITICAL();
+            
+            rs_wheel_timer_t* timer = expired;
+            if (timer) {
+                rs_wheel_unlink(timer);
+                rs_wheel_active--;
+                
+                if (late_ticks > rs_wheel_max_late_ticks) {
+                    rs_wheel_max_late_ticks = late_ticks;
+                }
+            }
+            
+            RS_WHEEL_EXIT_CRITICAL();
+            
+            if (!timer) {
+                break;
+            }
+            
+            timer->callback(timer->args);
+        }
+    }
+    
+    rs_wheel_driver_arm();
+}
+
+void rs_wheel_timer_init(rs_wheel_timer_t* timer, rs_wheel_timer_callback_t callback, void* args) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->callback = callback;
+    timer->args = args;
+}
+
+BaseType_t rs_wheel_timer_start(rs_wheel_timer_t* timer, const uint32_t period_ms) {
+    if (!rs_wheel_driver) {
+        // Timer is not created inside critical section. If other task creates driver meanwhile, this one is deleted
+        TimerHandle_t driver = rs_esp_timer_create(RS_WHEEL_TICK_MS, pdFALSE, NULL, rs_wheel_driver_worker);
+        if (!driver) {
+            return pdFALSE;
+        }
+        
+        bool is_used = false;
+        
+        RS_WHEEL_ENTER_CRITICAL();
+        if (!rs_wheel_driver) {
+            rs_wheel_driver = driver;
+            is_used = true;
+        }
+        RS_WHEEL_EXIT_CRITICAL();
+        
+        if (!is_used) {
+            rs_esp_timer_delete(driver);
+        }
+    }
+    
+    uint32_t ticks = (period_ms + RS_WHEEL_TICK_MS - 1) / RS_WHEEL_TICK_MS;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    
+    RS_WHEEL_ENTER_CRITICAL();
+    
+    if (timer->pprev) {
+        rs_wheel_unlink(timer);
+    } else {
+        if (rs_wheel_active == 0) {
+            // Empty wheel is moved to current time
+            rs_wheel_os_tick = xTaskGetTickCount();
+        }
+        
+        rs_wheel_active++;
+    }
+    
+    // Ticks not processed yet by driver are counted, so timer never expires early
+    timer->expire_tick = rs_wheel_tick + ((xTaskGetTickCount() - rs_wheel_os_tick) / RS_WHEEL_OS_TICKS) + ticks;
+    rs_wheel_link(timer);
+    
+    RS_WHEEL_EXIT_CRITICAL();
+    
+    return rs_wheel_driver_arm();
+}
+
+void rs_wheel_timer_stop(rs_wheel_timer_t* timer) {
+    RS_WHEEL_ENTER_CRITICAL();
+    
+    if (timer->pprev) {
+        rs_wheel_unlink(timer);
+        rs_wheel_active--;
+    }
+    
+    RS_WHEEL_EXIT_CRITICAL();
+}
+
+uint16_t rs_wheel_timer_active_count() {
+    return rs_wheel_active;
+}
+
+uint32_t rs_wheel_timer_max_late_ms() {
+    return rs_wheel_max_late_ticks * RS_WHEEL_TICK_MS;
+}
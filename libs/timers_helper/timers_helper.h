@@ -1,56 +1,81 @@
-/*
- * RavenSystem ESP Timers Helper
- *
- * Copyright 2020-2022 José Antonio Jiménez Campos (@RavenSystem)
- *
- */
-
-#ifndef __TIMERS_HELPER_H__
-#define __TIMERS_HELPER_H__
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-
-#ifdef ESP_PLATFORM
-
-#include "freertos/FreeRTOS.h"
-#include "freertos/timers.h"
-
-#else   // ESP-OPEN-RTOS
-
-#include <FreeRTOS.h>
-#include <timers.h>
-
-#endif
-
-
-#define TIMER_MANAGER_START                                     (0)
-#define TIMER_MANAGER_STOP                                      (1)
-#define TIMER_MANAGER_DELETE                                    (2)
-
-BaseType_t rs_esp_timer_start(TimerHandle_t xTimer);
-BaseType_t rs_esp_timer_stop(TimerHandle_t xTimer);
-BaseType_t rs_esp_timer_delete(TimerHandle_t xTimer);
-BaseType_t rs_esp_timer_change_period(TimerHandle_t xTimer, const uint32_t new_period_ms);
-
-BaseType_t rs_esp_timer_start_forced(TimerHandle_t xTimer);
-BaseType_t rs_esp_timer_stop_forced(TimerHandle_t xTimer);
-BaseType_t rs_esp_timer_delete_forced(TimerHandle_t xTimer);
-BaseType_t rs_esp_timer_change_period_forced(TimerHandle_t xTimer, const uint32_t new_period_ms);
-
-BaseType_t rs_esp_timer_start_from_ISR(TimerHandle_t xTimer);
-BaseType_t rs_esp_timer_stop_from_ISR(TimerHandle_t xTimer);
-
-BaseType_t rs_esp_timer_manager(const uint8_t option, TimerHandle_t xTimer, TickType_t xBlockTime);
-BaseType_t rs_esp_timer_change_period_manager(TimerHandle_t xTimer, const uint32_t new_period_ms, TickType_t xBlockTime);
-BaseType_t rs_esp_timer_manager_from_ISR(const uint8_t option, TimerHandle_t xTimer);
-
-TimerHandle_t rs_esp_timer_create(const uint32_t period_ms, const UBaseType_t auto_reload, void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif  // __TIMERS_HELPER_H__
+/*
+ * RavenSystem ESP Timers Helper
+ *
+ * Copyright 2020-2022 José Antonio Jiménez Campos (@RavenSystem)
+ *
+ */
+
+#ifndef __TIMERS_HELPER_H__
+#define __TIMERS_HELPER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+
+#else   // ESP-OPEN-RTOS
+
+#include <FreeRTOS.h>
+#include <timers.h>
+
+#endif
+
+
+#define TIMER_MANAGER_START                                     (0)
+#define TIMER_MANAGER_STOP                                      (1)
+#define TIMER_MANAGER_DELETE                                    (2)
+
+BaseType_t rs_esp_timer_start(TimerHandle_t xTimer);
+BaseType_t rs_esp_timer_stop(TimerHandle_t xTimer);
+BaseType_t rs_esp_timer_delete(TimerHandle_t xTimer);
+BaseType_t rs_esp_timer_change_period(TimerHandle_t xTimer, const uint32_t new_period_ms);
+
+BaseType_t rs_esp_timer_start_forced(TimerHandle_t xTimer);
+BaseType_t rs_esp_timer_stop_forced(TimerHandle_t xTimer);
+BaseType_t rs_esp_timer_delete_forced(TimerHandle_t xTimer);
+BaseType_t rs_esp_timer_change_period_forced(TimerHandle_t xTimer, const uint32_t new_period_ms);
+
+BaseType_t rs_esp_timer_start_from_ISR(TimerHandle_t xTimer);
+BaseType_t rs_esp_timer_stop_from_ISR(TimerHandle_t xTimer);
+
+BaseType_t rs_esp_timer_manager(const uint8_t option, TimerHandle_t xTimer, TickType_t xBlockTime);
+BaseType_t rs_esp_timer_change_period_manager(TimerHandle_t xTimer, const uint32_t new_period_ms, TickType_t xBlockTime);
+BaseType_t rs_esp_timer_manager_from_ISR(const uint8_t option, TimerHandle_t xTimer);
+
+TimerHandle_t rs_esp_timer_create(const uint32_t period_ms, const UBaseType_t auto_reload, void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction);
+
+// Wheel timers: one-shot timers embedded in caller structs, all driven by a single one-shot FreeRTOS timer,
+// armed only for next wheel tick with work. Start and stop never allocate. Callbacks run in FreeRTOS timer task,
+// like normal timers.
+#define RS_WHEEL_TICK_MS                                        (10)
+
+typedef void (*rs_wheel_timer_callback_t)(void* args);
+
+typedef struct _rs_wheel_timer {
+    struct _rs_wheel_timer* next;
+    struct _rs_wheel_timer** pprev;     // NULL when not active
+    uint32_t expire_tick;
+    
+    rs_wheel_timer_callback_t callback;
+    void* args;
+} rs_wheel_timer_t;
+
+void rs_wheel_timer_init(rs_wheel_timer_t* timer, rs_wheel_timer_callback_t callback, void* args);
+// Arms timer, or re-arms it if already active
+BaseType_t rs_wheel_timer_start(rs_wheel_timer_t* timer, const uint32_t period_ms);
+void rs_wheel_timer_stop(rs_wheel_timer_t* timer);
+#define rs_wheel_timer_is_active(timer)                         ((timer)->pprev != NULL)
+
+uint16_t rs_wheel_timer_active_count();
+uint32_t rs_wheel_timer_max_late_ms();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __TIMERS_HELPER_H__
@@ -6,36 +6,181 @@
  */
 
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
 
 #ifndef ESP_PLATFORM
 
 #include <esplibs/libmain.h>
 
+#else
+
+#include <stdlib.h>
+
 #endif
 
 #include "unistring.h"
 
-unsigned char* uni_memdup(unsigned char* string, size_t size, unistring_t** unistrings) {
-    unistring_t* unistring = *unistrings;
+#ifndef UNISTRING_BLOCK_SIZE
+#define UNISTRING_BLOCK_SIZE        (512)
+#endif
+
+#define UNISTRING_MIN_SLOTS         (16)
+
+typedef struct _unistring_slot {
+    uint32_t hash;
+    uint32_t size;
+    unsigned char* string;          // NULL when slot is empty
+} unistring_slot_t;
+
+struct _unistring {
+    unistring_slot_t* slots;
+    size_t slot_count;              // Always power of 2
+    size_t count;
+    
+    unsigned char* block;           // Strings are bumped into blocks never freed
+    size_t block_free;
+};
+
+static uint32_t unistring_hash(const unsigned char* string, const size_t size) {
+    // FNV-1a
+    uint32_t hash = 2166136261;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= string[i];
+        hash *= 16777619;
+    }
+    
+    return hash;
+}
+
+static unistring_slot_t* unistring_find_slot(unistring_slot_t* slots, const size_t slot_count, const uint32_t hash, const unsigned char* string, const size_t size) {
+    size_t i = hash & (slot_count - 1);
+    
+    while (slots[i].string &&
+           (hash != slots[i].hash ||
+           size != slots[i].size ||
+           memcmp(string, slots[i].string, size))) {
+        i = (i + 1) & (slot_count - 1);
+    }
+    
+    return &slots[i];
+}
+
+// When there is no memory for a bigger table, current one is kept
+static bool unistring_grow(unistring_t* unistrings) {
+    const size_t slot_count = unistrings->slot_count << 1;
+    unistring_slot_t* slots = calloc(slot_count, sizeof(unistring_slot_t));
+    if (!slots) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < unistrings->slot_count; i++) {
+        unistring_slot_t* old_slot = &unistrings->slots[i];
+        if (old_slot->string) {
+            *unistring_find_slot(slots, slot_count, old_slot->hash, old_slot->string, old_slot->size) = *old_slot;
+        }
+    }
+    
+    free(unistrings->slots);
+    unistrings->slots = slots;
+    unistrings->slot_count = slot_count;
+    
+    return true;
+}
+
+static unsigned char* unistring_alloc(unistring_t* unistrings, const size_t size) {
+    if (!unistrings->block || size > unistrings->block_free) {
+        // Big strings get their own allocation, so current block is not wasted
+        if (size > (UNISTRING_BLOCK_SIZE >> 2)) {
+            return malloc(size);
+        }
+        
+        unsigned char* block = malloc(UNISTRING_BLOCK_SIZE);
+        if (!block) {
+            return NULL;
+        }
+        
+        unistrings->block = block;
+        unistrings->block_free = UNISTRING_BLOCK_SIZE;
+    }
+    
+    unsigned char* string = unistrings->block;
+    unistrings->block += size;
+    unistrings->block_free -= size;
+    
+    return string;
+}
+
+unistring_t* unistring_create(const size_t expected_strings) {
+    unistring_t* unistrings = calloc(1, sizeof(unistring_t));
+    if (!unistrings) {
+        return NULL;
+    }
+    
+    // Load factor is kept under 3/4
+    unistrings->slot_count = UNISTRING_MIN_SLOTS;
+    while (unistrings->slot_count * 3 < expected_strings * 4) {
+        unistrings->slot_count <<= 1;
+    }
     
-    while (unistring &&
-           (size != unistring->size ||
-           memcmp(string, unistring->string, size))) {
-        unistring = unistring->next;
+    unistrings->slots = calloc(unistrings->slot_count, sizeof(unistring_slot_t));
+    if (!unistrings->slots) {
+        free(unistrings);
+        return NULL;
     }
     
-    if (unistring == NULL) {
-        unistring = calloc(1, sizeof(unistring_t));
+    return unistrings;
+}
+
+// Not shared copy, used when there is no memory for table
+static unsigned char* unistring_copy(const unsigned char* string, const size_t size) {
+    unsigned char* copy = malloc(size);
+    if (copy) {
+        memcpy(copy, string, size);
+    }
+    
+    return copy;
+}
+
+unsigned char* uni_memdup(unsigned char* string, size_t size, unistring_t** unistrings) {
+    if (*unistrings == NULL) {
+        *unistrings = unistring_create(0);
+        if (*unistrings == NULL) {
+            return unistring_copy(string, size);
+        }
+    }
+    
+    unistring_t* table = *unistrings;
+    
+    const uint32_t hash = unistring_hash(string, size);
+    unistring_slot_t* slot = unistring_find_slot(table->slots, table->slot_count, hash, string, size);
+    
+    if (slot->string == NULL) {
+        if ((table->count + 1) * 4 > table->slot_count * 3) {
+            if (unistring_grow(table)) {
+                slot = unistring_find_slot(table->slots, table->slot_count, hash, string, size);
+            } else if (table->count + 2 > table->slot_count) {
+                // At least one slot must be always empty, so searches end
+                return unistring_copy(string, size);
+            }
+        }
+        
+        unsigned char* new_string = unistring_alloc(table, size);
+        if (!new_string) {
+            return NULL;
+        }
+        
+        memcpy(new_string, string, size);
         
-        unistring->size = size;
-        unistring->string = malloc(size);
-        memcpy(unistring->string, string, size);
+        slot->hash = hash;
+        slot->size = size;
+        slot->string = new_string;
         
-        unistring->next = *unistrings;
-        *unistrings = unistring;
+        table->count++;
     }
     
-    return unistring->string;
+    return slot->string;
 }
 
 char* uni_strdup(char* string, unistring_t** unistrings) {
@@ -43,19 +188,22 @@ char* uni_strdup(char* string, unistring_t** unistrings) {
 }
 
 void unistring_destroy(unistring_t* unistrings) {
-    unistring_t* unistring = unistrings;
+    if (unistrings == NULL) {
+        return;
+    }
     
-    while (unistring) {
-        unistring_t* current_unistring = unistring;
-        unistring = unistring->next;
-        
 #ifdef UNISTRING_DEBUG
-        char* str = malloc(current_unistring->size + 1);
-        snprintf(str, current_unistring->size, "%s", current_unistring->string);
-        printf("UNIString (%i): \"%s\"\n", current_unistring->size, str);
-        free(str);
-#endif
-        
-        free(current_unistring);
+    for (size_t i = 0; i < unistrings->slot_count; i++) {
+        unistring_slot_t* slot = &unistrings->slots[i];
+        if (slot->string) {
+            char* str = malloc(slot->size + 1);
+            snprintf(str, slot->size, "%s", slot->string);
+            printf("UNIString (%i): \"%s\"\n", slot->size, str);
+            free(str);
+        }
     }
+#endif
+    
+    free(unistrings->slots);
+    free(unistrings);
 }
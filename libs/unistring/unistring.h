@@ -12,15 +12,17 @@
 extern "C" {
 #endif
 
-typedef struct _unistring {
-    size_t size;
-    unsigned char* string;
-    
-    struct _unistring* next;
-} unistring_t;
+#include <stddef.h>
+
+typedef struct _unistring unistring_t;
+
+// expected_strings only sizes the hash table, which grows as needed
+unistring_t* unistring_create(const size_t expected_strings);
 
 unsigned char* uni_memdup(unsigned char* string, size_t size, unistring_t** unistrings);
 char* uni_strdup(char* string, unistring_t** unistrings);
+
+// Frees the hash table. Returned strings are kept and must never be freed
 void unistring_destroy(unistring_t* unistrings);
 
 #ifdef __cplusplus
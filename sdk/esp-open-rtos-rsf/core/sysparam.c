@@ -75,6 +75,20 @@
 #define SYSPARAM_DEBUG 0
 #endif
 
+/* Keep an in-RAM index from key hash to key and value entry addresses, so
+ * lookups do not need to walk the whole region.  If the index can not be
+ * allocated, or the region is too big for its 16-bit offsets, lookups
+ * fall back to scanning the flash.
+ */
+#ifndef SYSPARAM_INDEX
+#define SYSPARAM_INDEX 1
+#endif
+
+/* Initial number of slots of the index (must be a power of 2).  It grows when
+ * it is 3/4 full.
+ */
+#define INDEX_INITIAL_SIZE 32
+
 /******************************* Useful Macros *******************************/
 
 #define ROUND_TO_WORD_BOUNDARY(x) (((x) + 3) & 0xfffffffc)
@@ -108,6 +122,15 @@ struct sysparam_context {
     int unused_keys;
     size_t compactable;
     uint16_t max_key_id;
+    uint16_t index_slot; // Index slot + 1 of the key, or 0 if not found using index
+    bool from_index;     // Filled by an index lookup instead of a region scan
+};
+
+struct index_slot {
+    uint16_t hash;      // 0 for empty slots
+    uint16_t id;
+    uint16_t key_off;   // Offsets in bytes from region base
+    uint16_t value_off; // 0 if key has no value
 };
 
 /*************************** Global variables/data ***************************/
@@ -119,6 +142,12 @@ struct {
     size_t region_size;
     bool force_compact;
     SemaphoreHandle_t sem;
+#if SYSPARAM_INDEX
+    struct index_slot *index;
+    uint16_t index_size;
+    uint16_t index_count;
+    uint16_t index_max_key_id;
+#endif
 } _sysparam_info;
 
 /***************************** Internal routines *****************************/
@@ -408,6 +437,264 @@ static inline sysparam_status_t _delete_entry(uint32_t addr) {
     return _write_and_verify(addr, &entry, ENTRY_HEADER_SIZE);
 }
 
+#if SYSPARAM_INDEX
+/***************************** Key index routines *****************************/
+
+static inline uint16_t _index_fold_hash(uint32_t hash) {
+    hash = (hash >> 16) ^ (hash & 0xffff);
+    return hash ? hash : 1;
+}
+
+static inline uint32_t _index_hash_update(uint32_t hash, const uint8_t *data, size_t len) {
+    // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * 16777619;
+    }
+    return hash;
+}
+
+static uint16_t _index_hash_key(const char *key, uint16_t key_len) {
+    return _index_fold_hash(_index_hash_update(2166136261, (const uint8_t *)key, key_len));
+}
+
+static sysparam_status_t _index_hash_flash(uint32_t addr, uint16_t len, uint16_t *hash) {
+    uint32_t bounce[BOUNCE_BUFFER_WORDS];
+    uint32_t full_hash = 2166136261;
+
+    for (size_t i = 0; i < len; i += BOUNCE_BUFFER_SIZE) {
+        size_t count = min(len - i, BOUNCE_BUFFER_SIZE);
+        CHECK_FLASH_OP(spiflash_read(addr + i, (void*)bounce, count));
+        full_hash = _index_hash_update(full_hash, (const uint8_t *)bounce, count);
+    }
+    *hash = _index_fold_hash(full_hash);
+    return SYSPARAM_OK;
+}
+
+static inline uint16_t _index_offset(uint32_t addr) {
+    return addr - _sysparam_info.cur_base;
+}
+
+static inline uint32_t _index_address(uint16_t offset) {
+    return _sysparam_info.cur_base + offset;
+}
+
+static void _index_free() {
+    if (_sysparam_info.index) {
+        free(_sysparam_info.index);
+        _sysparam_info.index = NULL;
+    }
+    _sysparam_info.index_size = 0;
+    _sysparam_info.index_count = 0;
+}
+
+static void _index_put(struct index_slot *index, uint16_t index_size, const struct index_slot *slot) {
+    uint16_t i = slot->hash & (index_size - 1);
+    while (index[i].hash) {
+        i = (i + 1) & (index_size - 1);
+    }
+    index[i] = *slot;
+}
+
+static bool _index_add_key(uint16_t hash, uint16_t id, uint32_t key_addr) {
+    struct index_slot slot;
+
+    if (!_sysparam_info.index) return false;
+
+    if ((_sysparam_info.index_count + 1) * 4 > _sysparam_info.index_size * 3) {
+        uint16_t new_size = _sysparam_info.index_size * 2;
+        struct index_slot *new_index = calloc(new_size, sizeof(struct index_slot));
+        if (!new_index) {
+            debug(1, "no memory to grow index, falling back to flash scans");
+            _index_free();
+            return false;
+        }
+        for (uint16_t i = 0; i < _sysparam_info.index_size; i++) {
+            if (_sysparam_info.index[i].hash) {
+                _index_put(new_index, new_size, &_sysparam_info.index[i]);
+            }
+        }
+        free(_sysparam_info.index);
+        _sysparam_info.index = new_index;
+        _sysparam_info.index_size = new_size;
+    }
+
+    slot.hash = hash;
+    slot.id = id;
+    slot.key_off = _index_offset(key_addr);
+    slot.value_off = 0;
+    _index_put(_sysparam_info.index, _sysparam_info.index_size, &slot);
+    _sysparam_info.index_count++;
+    if (id > _sysparam_info.index_max_key_id) {
+        _sysparam_info.index_max_key_id = id;
+    }
+    return true;
+}
+
+static struct index_slot *_index_find_id(uint16_t hash, uint16_t id) {
+    uint16_t i = hash & (_sysparam_info.index_size - 1);
+    while (_sysparam_info.index[i].hash) {
+        if (_sysparam_info.index[i].hash == hash && _sysparam_info.index[i].id == id) {
+            return &_sysparam_info.index[i];
+        }
+        i = (i + 1) & (_sysparam_info.index_size - 1);
+    }
+    return NULL;
+}
+
+static void _index_set_value(uint16_t hash, uint16_t id, uint32_t value_addr) {
+    struct index_slot *slot;
+
+    if (!_sysparam_info.index) return;
+
+    slot = _index_find_id(hash, id);
+    if (slot) {
+        slot->value_off = value_addr ? _index_offset(value_addr) : 0;
+    } else {
+        debug(1, "key id %d missing from index, falling back to flash scans", id);
+        _index_free();
+    }
+}
+
+/** Build the index scanning the active region, first keys and then values */
+static void _index_build() {
+    struct sysparam_context ctx;
+    uint16_t hash;
+
+    _index_free();
+    _sysparam_info.index_max_key_id = 0;
+
+    if (_sysparam_info.region_size > 0xffff) {
+        debug(1, "region too big to be indexed");
+        return;
+    }
+
+    _sysparam_info.index = calloc(INDEX_INITIAL_SIZE, sizeof(struct index_slot));
+    if (!_sysparam_info.index) return;
+    _sysparam_info.index_size = INDEX_INITIAL_SIZE;
+
+    _init_context(&ctx);
+    while (_find_entry(&ctx, ENTRY_ID_ANY, false) == SYSPARAM_OK) {
+        if (_index_hash_flash(ctx.addr + ENTRY_HEADER_SIZE, ctx.entry.len, &hash) != SYSPARAM_OK ||
+            !_index_add_key(hash, ctx.entry.idflags & ENTRY_MASK_ID, ctx.addr)) {
+            _index_free();
+            return;
+        }
+    }
+
+    _init_context(&ctx);
+    while (_find_entry(&ctx, ENTRY_ID_ANY, true) == SYSPARAM_OK) {
+        uint16_t id = ctx.entry.idflags & ENTRY_MASK_ID;
+        // Values are few, so a linear search by id is cheaper than keeping a
+        // second table only for this
+        for (uint16_t i = 0; i < _sysparam_info.index_size; i++) {
+            struct index_slot *slot = &_sysparam_info.index[i];
+            if (slot->hash && slot->id == id) {
+                // Like _find_value, first alive value wins
+                if (!slot->value_off) {
+                    slot->value_off = _index_offset(ctx.addr);
+                }
+                break;
+            }
+        }
+    }
+
+    debug(2, "index built with %d keys in %d slots", _sysparam_info.index_count, _sysparam_info.index_size);
+}
+
+/** Find a key using the index.  On success `ctx` points to the key entry, as
+ *  `_find_key` would leave it.
+ */
+static sysparam_status_t _index_find_key(struct sysparam_context *ctx, const char *key, uint16_t key_len, uint16_t hash) {
+    sysparam_status_t status;
+    uint16_t i = hash & (_sysparam_info.index_size - 1);
+
+    while (_sysparam_info.index[i].hash) {
+        struct index_slot *slot = &_sysparam_info.index[i];
+        if (slot->hash == hash) {
+            ctx->addr = _index_address(slot->key_off);
+            CHECK_FLASH_OP(spiflash_read(ctx->addr, (void*) &ctx->entry, ENTRY_HEADER_SIZE));
+            if (ctx->entry.len == key_len) {
+                status = _compare_payload(ctx, (uint8_t *)key, key_len);
+                if (status == SYSPARAM_OK) {
+                    ctx->index_slot = i + 1;
+                    return SYSPARAM_OK;
+                }
+                if (status != SYSPARAM_NOTFOUND) return status;
+            }
+        }
+        i = (i + 1) & (_sysparam_info.index_size - 1);
+    }
+
+    // Leave ctx as a full scan would have done it
+    ctx->addr = _sysparam_info.end_addr;
+    ctx->entry.len = 0;
+    ctx->entry.idflags = 0;
+    ctx->max_key_id = _sysparam_info.index_max_key_id;
+    return SYSPARAM_NOTFOUND;
+}
+
+/** Find the value for the key found by `_index_find_key` */
+static sysparam_status_t _index_find_value(struct sysparam_context *ctx) {
+    struct index_slot *slot = &_sysparam_info.index[ctx->index_slot - 1];
+
+    if (!slot->value_off) {
+        ctx->entry.len = 0;
+        ctx->entry.idflags = 0;
+        return SYSPARAM_NOTFOUND;
+    }
+    ctx->addr = _index_address(slot->value_off);
+    CHECK_FLASH_OP(spiflash_read(ctx->addr, (void*) &ctx->entry, ENTRY_HEADER_SIZE));
+    return SYSPARAM_OK;
+}
+#endif
+
+#if SYSPARAM_INDEX
+#define KEY_HASH(key, key_len) _index_hash_key((key), (key_len))
+#else
+#define KEY_HASH(key, key_len) 0
+#endif
+
+/** Finish scanning the region up to the end, so `ctx` has accurate
+ *  "compactable", "unused_keys" and "max_key_id" values.
+ *
+ *  Lookups using the index do not walk the region, so in that case the scan
+ *  is restarted from the beginning.
+ */
+static void _scan_to_end(struct sysparam_context *ctx) {
+    if (ctx->from_index) {
+        size_t compactable = ctx->compactable;
+        _init_context(ctx);
+        ctx->compactable = compactable;
+    }
+    _find_entry(ctx, ENTRY_ID_END, false);
+}
+
+/** Find a key and its value, using the index if available.
+ *
+ *  On return, `ctx` is as `_find_key` and `_find_value` would leave it.
+ */
+static sysparam_status_t _lookup(struct sysparam_context *ctx, const char *key, uint16_t key_len, uint16_t hash, int *key_id) {
+    sysparam_status_t status;
+
+    _init_context(ctx);
+    *key_id = -1;
+
+#if SYSPARAM_INDEX
+    if (_sysparam_info.index) {
+        ctx->from_index = true;
+        status = _index_find_key(ctx, key, key_len, hash);
+        if (status != SYSPARAM_OK) return status;
+        *key_id = ctx->entry.idflags & ENTRY_MASK_ID;
+        return _index_find_value(ctx);
+    }
+#endif
+
+    status = _find_key(ctx, key, key_len);
+    if (status != SYSPARAM_OK) return status;
+    *key_id = ctx->entry.idflags & ENTRY_MASK_ID;
+    return _find_value(ctx, ctx->entry.idflags);
+}
+
 /** Compact the current region, removing all deleted/unused entries, and write
  *  the result to the alternate region, then make the new alternate region the
  *  active one.
@@ -428,6 +715,7 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
     sysparam_iter_t iter;
     uint16_t binary_flag;
     uint16_t num_sectors = _sysparam_info.region_size / sdk_flashchip.sector_size;
+    bool key_id_found = false;
 
     debug(1, "compacting region (current size %d, expect to recover %d%s bytes)...",
             _sysparam_info.end_addr - _sysparam_info.cur_base,
@@ -455,6 +743,7 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
         if (key_id && (iter.ctx->entry.idflags & ENTRY_MASK_ID) == *key_id) {
             // Update key_id to have the correct id for the compacted result
             *key_id = current_key_id;
+            key_id_found = true;
             // Don't copy the old value, since we'll just be deleting it
             // and writing a new one as soon as we return.
             continue;
@@ -475,6 +764,12 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
         return status;
     }
 
+    if (key_id && !key_id_found) {
+        // The key had no value, so it has been dropped as unused.  It must be
+        // written again, and its old id now belongs to another key.
+        *key_id = -1;
+    }
+
     // Switch to officially using the new region.
     status = _write_region_header(new_base, _sysparam_info.cur_base, true);
     if (status < 0) return status;
@@ -486,6 +781,10 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
     _sysparam_info.end_addr = addr;
     _sysparam_info.force_compact = false;
 
+#if SYSPARAM_INDEX
+    _index_build();
+#endif
+
     if (ctx) {
         // Fix up ctx so it doesn't point to invalid stuff
         memset(ctx, 0, sizeof(*ctx));
@@ -588,6 +887,10 @@ sysparam_status_t sysparam_init(uint32_t base_addr, uint32_t top_addr) {
         _sysparam_info.end_addr = ctx.addr;
     }
 
+#if SYSPARAM_INDEX
+    _index_build();
+#endif
+
     return SYSPARAM_OK;
 }
 
@@ -624,6 +927,9 @@ sysparam_status_t sysparam_create_area(uint32_t base_addr, uint16_t num_sectors,
         // We're reformating the same region we're already using.
         // De-initialize everything to force the caller to do a clean
         // `sysparam_init()` afterwards.
+#if SYSPARAM_INDEX
+        _index_free();
+#endif
         memset(&_sysparam_info, 0, sizeof(_sysparam_info));
     }
     status = _format_region(base_addr, num_sectors);
@@ -665,6 +971,7 @@ sysparam_status_t sysparam_get_data(const char *key, uint8_t **destptr, size_t *
     sysparam_status_t status;
     size_t key_len = strlen(key);
     uint8_t *buffer;
+    int key_id;
 
     xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
 
@@ -675,12 +982,8 @@ sysparam_status_t sysparam_get_data(const char *key, uint8_t **destptr, size_t *
         goto done;
     }
 
-    _init_context(&ctx);
-    status = _find_key(&ctx, key, key_len);
-    if (status != SYSPARAM_OK) goto done;
-
-    // Find the associated value
-    status = _find_value(&ctx, ctx.entry.idflags);
+    // Find the key and its associated value
+    status = _lookup(&ctx, key, key_len, KEY_HASH(key, key_len), &key_id);
     if (status != SYSPARAM_OK) goto done;
 
     buffer = malloc(ctx.entry.len + 1);
@@ -718,6 +1021,7 @@ sysparam_status_t sysparam_get_data_static(const char *key, uint8_t *dest, size_
     struct sysparam_context ctx;
     sysparam_status_t status = SYSPARAM_OK;
     size_t key_len = strlen(key);
+    int key_id;
 
     xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
 
@@ -728,10 +1032,7 @@ sysparam_status_t sysparam_get_data_static(const char *key, uint8_t *dest, size_
         goto done;
     }
 
-    _init_context(&ctx);
-    status = _find_key(&ctx, key, key_len);
-    if (status != SYSPARAM_OK) goto done;
-    status = _find_value(&ctx, ctx.entry.idflags);
+    status = _lookup(&ctx, key, key_len, KEY_HASH(key, key_len), &key_id);
     if (status != SYSPARAM_OK) goto done;
     status = _read_payload(&ctx, dest, dest_size);
     if (status != SYSPARAM_OK) goto done;
@@ -853,6 +1154,8 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
     int key_id = -1;
     uint32_t old_value_addr = 0;
     uint16_t binary_flag;
+    uint16_t key_hash;
+    bool key_space_counted;
 
     if (!key_len) return SYSPARAM_ERR_BADVALUE;
 #if MAX_KEY_LEN<0xffff
@@ -871,16 +1174,13 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
         goto done;
     }
 
+    key_hash = KEY_HASH(key, key_len);
+
     do {
-        _init_context(&ctx);
-        status = _find_key(&ctx, key, key_len);
+        // If key already exists, see if there's a current value.
+        status = _lookup(&ctx, key, key_len, key_hash, &key_id);
         if (status == SYSPARAM_OK) {
-            // Key already exists, see if there's a current value.
-            key_id = ctx.entry.idflags & ENTRY_MASK_ID;
-            status = _find_value(&ctx, key_id);
-            if (status == SYSPARAM_OK) {
-                old_value_addr = ctx.addr;
-            }
+            old_value_addr = ctx.addr;
         }
         if (status < 0) break;
 
@@ -911,6 +1211,7 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
             // space.
             free_space = _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr;
             needed_space = ENTRY_SIZE(value_len);
+            key_space_counted = (key_id < 0);
             if (key_id < 0) {
                 // We did not find a previous key entry matching this key.  We
                 // will need to add a key entry as well.
@@ -921,7 +1222,7 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // Can we compact things?
                 // First, scan all remaining entries up to the end so we can
                 // get a reasonably accurate "compactable" reading.
-                _find_entry(&ctx, ENTRY_ID_END, false);
+                _scan_to_end(&ctx);
                 if (needed_space <= free_space + ctx.compactable) {
                     // We should be able to get enough space by compacting.
                     status = _compact_params(&ctx, &key_id);
@@ -937,6 +1238,11 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                     old_value_addr = 0;
                 }
                 free_space = _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr;
+                if (key_id < 0 && !key_space_counted) {
+                    // Compacting dropped the unused key entry
+                    needed_space += ENTRY_SIZE(key_len);
+                    key_space_counted = true;
+                }
             }
             if (needed_space > free_space) {
                 // Nothing we can do here.. We're full.
@@ -954,6 +1260,9 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // ctx.max_key_id has the largest key_id found in the whole
                 // region.
                 if (ctx.max_key_id >= MAX_KEY_ID) {
+                    if (ctx.from_index) {
+                        _scan_to_end(&ctx);
+                    }
                     if (ctx.unused_keys > 0) {
                         status = _compact_params(&ctx, &key_id);
                         if (status < 0) break;
@@ -972,6 +1281,20 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // writing anything new, so do that.
                 status = _compact_params(&ctx, &key_id);
                 if (status < 0) break;
+                old_value_addr = 0;
+
+                // Compacting can drop the unused key entry too, so check
+                // again that key and value fit
+                free_space = _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr;
+                if (key_id < 0 && !key_space_counted) {
+                    needed_space += ENTRY_SIZE(key_len);
+                    key_space_counted = true;
+                }
+                if (needed_space > free_space) {
+                    debug(1, "region full after compacting (need %d of %d remaining)", needed_space, free_space);
+                    status = SYSPARAM_ERR_FULL;
+                    break;
+                }
             }
 
             init_write_context(&write_ctx);
@@ -981,12 +1304,18 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 key_id = ctx.max_key_id + 1;
                 status = _write_entry(write_ctx.addr, key_id, (uint8_t *)key, key_len);
                 if (status < 0) break;
+#if SYSPARAM_INDEX
+                _index_add_key(key_hash, key_id, write_ctx.addr);
+#endif
                 write_ctx.addr += ENTRY_SIZE(key_len);
             }
 
             // Write new value
             status = _write_entry(write_ctx.addr, key_id | ENTRY_FLAG_VALUE | binary_flag, value, value_len);
             if (status < 0) break;
+#if SYSPARAM_INDEX
+            _index_set_value(key_hash, key_id, write_ctx.addr);
+#endif
             write_ctx.addr += ENTRY_SIZE(value_len);
             _sysparam_info.end_addr = write_ctx.addr;
         }
@@ -995,6 +1324,11 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
         if (old_value_addr) {
             status = _delete_entry(old_value_addr);
             if (status < 0) break;
+#if SYSPARAM_INDEX
+            if (!value_len) {
+                _index_set_value(key_hash, key_id, 0);
+            }
+#endif
         }
 
         debug(1, "New addr is 0x%08x (%d bytes remaining)", _sysparam_info.end_addr, _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr);
@@ -0,0 +1,35 @@
+/*
+ * Host tests of HAA libraries
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static unsigned int host_test_failures = 0;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if (!(condition)) {                                                 \
+            printf("%s:%i: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            host_test_failures++;                                           \
+        }                                                                   \
+    } while (0)
+
+// Returns process exit status
+#define HOST_TEST_END()                                                     \
+    (printf("%s: %s\n", __FILE__, host_test_failures ? "FAILED" : "OK"), host_test_failures ? 1 : 0)
+
+static inline uint64_t host_test_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+#endif  // __HOST_TEST_H__
@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+// Defined by each test, usually as a mock I2C bus
+int adv_i2c_slave_write(uint8_t bus, uint8_t slave_addr, const uint8_t* data, const size_t data_len, const uint8_t* buf, size_t buf_len);
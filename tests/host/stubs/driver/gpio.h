@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+// Defined by each test
+int gpio_set_level(int gpio, uint32_t level);
@@ -0,0 +1,3 @@
+#pragma once
+#include <stddef.h>
+int uart_write_bytes(int port, const void* data, size_t len);
@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+
+typedef struct {
+    uint32_t sector_size;
+} sdk_flashchip_t;
+
+extern sdk_flashchip_t sdk_flashchip;
@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPI_FLASH_SECTOR_SIZE           (4096)
+
+// Defined by each test
+bool spiflash_read(uint32_t addr, uint8_t* buf, uint32_t size);
+bool spiflash_write(uint32_t addr, uint8_t* buf, uint32_t size);
+bool spiflash_erase_sector(uint32_t addr);
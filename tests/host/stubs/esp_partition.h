@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define ESP_OK                          (0)
+#define SPI_FLASH_SECTOR_SIZE           (4096)
+
+typedef int esp_err_t;
+typedef struct esp_partition esp_partition_t;
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size);
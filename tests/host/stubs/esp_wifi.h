@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+#define WIFI_IF_STA                     (0)
+void esp_wifi_get_mac(int interface, uint8_t* mac);
@@ -0,0 +1,41 @@
+/*
+ * Host stubs of FreeRTOS for library tests
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef int portMUX_TYPE;
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define portMUX_INITIALIZER_UNLOCKED    (0)
+#define portMUX_INITIALIZE(x)           (void) (x)
+#define taskENTER_CRITICAL(x)           (void) (x)
+#define taskEXIT_CRITICAL(x)            (void) (x)
+#define taskENTER_CRITICAL_ISR(x)       (void) (x)
+#define taskEXIT_CRITICAL_ISR(x)        (void) (x)
+#define taskSCHEDULER_RUNNING           (2)
+#define portTICK_PERIOD_MS              (10)
+#define portMAX_DELAY                   (0xFFFFFFFF)
+#define tskIDLE_PRIORITY                (0)
+#define pdPASS                          (1)
+#define pdFAIL                          (0)
+#define pdTRUE                          (1)
+#define pdFALSE                         (0)
+
+// Defined by each test
+int xTaskGetSchedulerState(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+bool xPortCanYield(void);
+void vTaskDelay(const TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+int xTaskCreate(void* task, const char* name, int stack, void* args, int priority, TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t handle);
+
+struct _reent;
@@ -0,0 +1,76 @@
+/*
+ * Host stubs of FreeRTOS queues for library tests, backed by POSIX threads
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "FreeRTOS.h"
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    size_t item_size;
+    unsigned int length;
+    unsigned int count;
+    unsigned int head;
+    uint8_t* items;
+} host_queue_t;
+
+typedef host_queue_t* QueueHandle_t;
+
+static inline QueueHandle_t xQueueCreate(const unsigned int length, const size_t item_size) {
+    QueueHandle_t queue = calloc(1, sizeof(host_queue_t));
+    queue->items = malloc(length * item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    return queue;
+}
+
+static inline void vQueueDelete(QueueHandle_t queue) {
+    free(queue->items);
+    free(queue);
+}
+
+// Only no wait and wait forever are supported
+static inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, const TickType_t ticks) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->length && ticks) {
+        pthread_cond_wait(&queue->changed, &queue->mutex);
+    }
+    
+    BaseType_t result = pdFALSE;
+    if (queue->count < queue->length) {
+        memcpy(queue->items + (((queue->head + queue->count) % queue->length) * queue->item_size), item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+        result = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    
+    return result;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, const TickType_t ticks) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0 && ticks) {
+        pthread_cond_wait(&queue->changed, &queue->mutex);
+    }
+    
+    BaseType_t result = pdFALSE;
+    if (queue->count > 0) {
+        memcpy(item, queue->items + (queue->head * queue->item_size), queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+        result = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    
+    return result;
+}
@@ -0,0 +1,32 @@
+/*
+ * Host stubs of FreeRTOS mutexes for library tests, backed by POSIX threads
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "FreeRTOS.h"
+
+typedef pthread_mutex_t* SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t mutex = malloc(sizeof(pthread_mutex_t));
+    if (mutex) {
+        pthread_mutex_init(mutex, NULL);
+    }
+    return mutex;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xSemaphoreCreateMutex();
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, const TickType_t ticks) {
+    return pthread_mutex_lock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+    return pthread_mutex_unlock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
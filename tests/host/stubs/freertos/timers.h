@@ -0,0 +1,20 @@
+/*
+ * Host stubs of FreeRTOS timers for library tests
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef void* TimerHandle_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t xTimer);
+
+// Defined by each test that uses them
+TimerHandle_t xTimerCreate(const char* name, const TickType_t period, const UBaseType_t auto_reload, void* id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t xTimer, const TickType_t ticks);
+BaseType_t xTimerStop(TimerHandle_t xTimer, const TickType_t ticks);
+BaseType_t xTimerDelete(TimerHandle_t xTimer, const TickType_t ticks);
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, const TickType_t period, const TickType_t ticks);
+BaseType_t xTimerStartFromISR(TimerHandle_t xTimer, BaseType_t* woken);
+BaseType_t xTimerStopFromISR(TimerHandle_t xTimer, BaseType_t* woken);
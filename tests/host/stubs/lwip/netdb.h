@@ -0,0 +1,10 @@
+#pragma once
+struct sockaddr;
+struct addrinfo {
+    int ai_family;
+    int ai_socktype;
+    struct sockaddr* ai_addr;
+    int ai_addrlen;
+};
+#define AF_UNSPEC                       (0)
+int getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res);
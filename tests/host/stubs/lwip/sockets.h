@@ -0,0 +1,6 @@
+#pragma once
+#include <stddef.h>
+#include "netdb.h"
+#define SOCK_DGRAM                      (2)
+int lwip_socket(int domain, int type, int protocol);
+int lwip_sendto(int socket, const void* data, size_t len, int flags, void* address, int address_len);
@@ -0,0 +1,11 @@
+/*
+ * lwIP architecture definitions to build network code on host
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LWIP_PLATFORM_DIAG(x)           do { printf x; } while (0)
+#define LWIP_PLATFORM_ASSERT(x)         do { printf("lwIP assert: %s\n", x); abort(); } while (0)
@@ -0,0 +1,12 @@
+/*
+ * lwIP options to build network code on host, without lwIP sources
+ */
+
+#pragma once
+
+#define NO_SYS                          1
+#define LWIP_SOCKET                     0
+#define LWIP_NETCONN                    0
+#define LWIP_IPV6                       0
+#define LWIP_IGMP                       1
+#define SYS_LIGHTWEIGHT_PROT            0
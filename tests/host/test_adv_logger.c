@@ -0,0 +1,116 @@
+/*
+ * Host test of Advanced ESP Logger ring buffer
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ * Drain task is not running, so a full ring stays full. Cost of log calls
+ * is measured with free ring and with full ring
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "lwip/sockets.h"
+
+static char uart_out[65536];
+static size_t uart_out_len = 0;
+static unsigned int delays = 0;
+
+int uart_write_bytes(int port, const void* data, size_t len) {
+    if (uart_out_len + len <= sizeof(uart_out)) {
+        memcpy(&uart_out[uart_out_len], data, len);
+        uart_out_len += len;
+    }
+    return len;
+}
+
+int64_t esp_timer_get_time(void) { return 123456789; }
+int xTaskGetSchedulerState(void) { return taskSCHEDULER_RUNNING; }
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return (TaskHandle_t) 1; }
+bool xPortCanYield(void) { return true; }
+void vTaskDelete(TaskHandle_t handle) { }
+void esp_wifi_get_mac(int interface, uint8_t* mac) { }
+int lwip_socket(int domain, int type, int protocol) { return 0; }
+int lwip_sendto(int socket, const void* data, size_t len, int flags, void* address, int address_len) { return len; }
+int getaddrinfo(const char* node, const char* service, const struct addrinfo* hints, struct addrinfo** res) { return 0; }
+
+int xTaskCreate(void* task, const char* name, int stack, void* args, int priority, TaskHandle_t* handle) {
+    if (handle) {
+        *handle = (TaskHandle_t) 2;
+    }
+    return pdPASS;
+}
+
+// A real tick, as a writer waiting for drain task would sleep
+void vTaskDelay(const TickType_t ticks) {
+    delays++;
+    usleep(ticks * portTICK_PERIOD_MS * 1000);
+}
+
+#include "../../libs/adv_logger/adv_logger.c"
+
+#define LINE                            "Log line of a typical length, with some data: 12345\n"
+#define BENCH_CALLS                     (100000)
+#define BENCH_MAX_NS                    (5000000000ULL)
+
+static uint64_t bench_log_calls(const bool drain) {
+    unsigned int calls = 0;
+    uint64_t spent_ns = 0;
+    
+    while (calls < BENCH_CALLS && spent_ns < BENCH_MAX_NS) {
+        if (drain && ADV_LOGGER_RING_SIZE - (adv_logger_data->ring_head - adv_logger_data->ring_tail) < 2 * sizeof(LINE)) {
+            adv_logger_drain();
+            uart_out_len = 0;
+        }
+        
+        const uint64_t start_ns = host_test_now_ns();
+        adv_logger_write(NULL, 1, LINE, sizeof(LINE) - 1);
+        spent_ns += host_test_now_ns() - start_ns;
+        calls++;
+    }
+    
+    return spent_ns / calls;
+}
+
+int main() {
+    adv_logger_init();
+    CHECK(adv_logger_data != NULL);
+    
+    // Records are output in order, with CRLF line ends
+    adv_logger_write(NULL, 1, "first\n", 6);
+    adv_logger_write(NULL, 1, "sec", 3);
+    adv_logger_write(NULL, 1, "ond\n", 4);
+    adv_logger_drain();
+    CHECK(uart_out_len == 15 && memcmp(uart_out, "first\r\nsecond\r\n", 15) == 0);
+    uart_out_len = 0;
+    
+    const uint64_t free_ns = bench_log_calls(true);
+    
+    // Full ring: data is dropped and counted, and writer never waits
+    while (ADV_LOGGER_RING_SIZE - (adv_logger_data->ring_head - adv_logger_data->ring_tail) >= sizeof(LINE) + 8) {
+        adv_logger_write(NULL, 1, LINE, sizeof(LINE) - 1);
+    }
+    
+    delays = 0;
+    const uint32_t dropped = adv_logger_data->dropped;
+    const uint64_t full_ns = bench_log_calls(false);
+    CHECK(delays == 0);
+    CHECK(adv_logger_data->dropped > dropped);
+    
+    // Drain task reports dropped bytes
+    uart_out_len = 0;
+    adv_logger_drain();
+    CHECK(memmem(uart_out, uart_out_len, "! Log dropped", 13) != NULL);
+    
+    printf("log call: %llu ns with free ring, %llu ns with full ring\n", (unsigned long long) free_ns, (unsigned long long) full_ns);
+    
+    return HOST_TEST_END();
+}
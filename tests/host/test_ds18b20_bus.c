@@ -0,0 +1,344 @@
+/*
+ * Host test of DS18B20 sensors sharing a 1-Wire bus, with a model of the bus and its devices
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+
+#include "../../libs/new_ds18b20/ds18b20.c"
+#include "../../HAA/HAA_Main/main/ds18b20_bus.c"
+
+static TickType_t mock_ticks = 0;
+
+TickType_t xTaskGetTickCount(void) {
+    return mock_ticks;
+}
+
+void vTaskDelay(const TickType_t ticks) {
+    mock_ticks += ticks;
+}
+
+int adv_logger_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int len = vprintf(format, args);
+    va_end(args);
+    return len;
+}
+
+// 1-Wire bus model, at ROM and function command level
+#define MODEL_DEVICES               (4)
+#define MODEL_CONVERSION_TICKS      MS_TO_TICKS(750)
+
+typedef struct _model_device {
+    onewire_addr_t addr;
+    bool present;
+    bool selected;
+    float temperature;
+    
+    uint8_t scratchpad[9];
+    bool converting;
+    TickType_t convert_tick;
+} model_device_t;
+
+static model_device_t model_devices[MODEL_DEVICES];
+static bool model_powered = false;
+static int model_read_index = -1;
+static unsigned int model_searches = 0;
+static unsigned int model_conversions = 0;
+static unsigned int model_errors = 0;     // Bus protocol violations
+
+uint8_t onewire_crc8(const uint8_t* data, uint8_t len) {
+    uint8_t crc = 0;
+    
+    while (len--) {
+        uint8_t inbyte = *data++;
+        for (int i = 8; i; i--) {
+            const uint8_t mix = (crc ^ inbyte) & 0x01;
+            crc >>= 1;
+            if (mix) {
+                crc ^= 0x8C;
+            }
+            inbyte >>= 1;
+        }
+    }
+    
+    return crc;
+}
+
+static onewire_addr_t model_addr(const uint8_t family, const uint8_t serial) {
+    uint8_t rom[8] = { family, serial, 0x5A, 0xA5, 0x00, 0x00, 0x00 };
+    rom[7] = onewire_crc8(rom, 7);
+    
+    onewire_addr_t addr = 0;
+    for (int i = 7; i >= 0; i--) {
+        addr = (addr << 8) | rom[i];
+    }
+    
+    return addr;
+}
+
+static void model_set_scratchpad(model_device_t* device, const float temperature) {
+    const int16_t raw = temperature * 16;
+    uint8_t* scratchpad = device->scratchpad;
+    scratchpad[0] = raw & 0xFF;
+    scratchpad[1] = (raw >> 8) & 0xFF;
+    scratchpad[2] = 0x4B;
+    scratchpad[3] = 0x46;
+    scratchpad[4] = 0x7F;
+    scratchpad[5] = 0xFF;
+    scratchpad[6] = 0x0C;
+    scratchpad[7] = 0x10;
+    scratchpad[8] = onewire_crc8(scratchpad, 8);
+}
+
+static void model_init() {
+    memset(model_devices, 0, sizeof(model_devices));
+    
+    const uint8_t families[MODEL_DEVICES] = { 0x28, 0x01, 0x28, 0x28 };   // 0x01 is a DS2401 serial number, not a sensor
+    const float temperatures[MODEL_DEVICES] = { 21.5f, 0, -10.25f, 30.f };
+    for (unsigned int i = 0; i < MODEL_DEVICES; i++) {
+        model_devices[i].addr = model_addr(families[i], i + 1);
+        model_devices[i].present = true;
+        model_devices[i].temperature = temperatures[i];
+        model_set_scratchpad(&model_devices[i], 85.f);     // Power on value
+    }
+}
+
+static void model_tick() {
+    for (unsigned int i = 0; i < MODEL_DEVICES; i++) {
+        model_device_t* device = &model_devices[i];
+        if (device->converting && mock_ticks - device->convert_tick >= MODEL_CONVERSION_TICKS) {
+            device->converting = false;
+            model_set_scratchpad(device, device->temperature);
+        }
+    }
+}
+
+bool onewire_reset(int pin, int pin_output) {
+    if (model_powered) {
+        // Strong pull-up must be released before talking again
+        model_errors++;
+    }
+    
+    model_tick();
+    model_read_index = -1;
+    
+    bool presence = false;
+    for (unsigned int i = 0; i < MODEL_DEVICES; i++) {
+        model_devices[i].selected = false;
+        presence |= model_devices[i].present;
+    }
+    
+    return presence;
+}
+
+bool onewire_select(int pin, int pin_output, const onewire_addr_t addr) {
+    for (unsigned int i = 0; i < MODEL_DEVICES; i++) {
+        model_devices[i].selected = model_devices[i].present && model_devices[i].addr == addr;
+    }
+    
+    return true;
+}
+
+bool onewire_skip_rom(int pin, int pin_output) {
+    for (unsigned int i = 0; i < MODEL_DEVICES; i++) {
+        model_devices[i].selected = model_devices[i].present;
+    }
+    
+    return true;
+}
+
+bool onewire_write(int pin, int pin_output, uint8_t v) {
+    if (v == DS18B20_CONVERT_T) {
+        model_conversions++;
+        for (unsigned int i = 0; i < MODEL_DEVICES; i++) {
+            model_device_t* device = &model_devices[i];
+            if (device->selected && (uint8_t) device->addr == DS18B20_FAMILY_ID) {
+                device->converting = true;
+                device->convert_tick = mock_ticks;
+            }
+        }
+    
+    } else if (v == DS18B20_READ_SCRATCHPAD) {
+        unsigned int selected_count = 0;
+        for (unsigned int i = 0; i < MODEL_DEVICES; i++) {
+            if (model_devices[i].selected) {
+                selected_count++;
+                model_read_index = i * 16;
+            }
+        }
+        
+        if (selected_count > 1) {
+            // Wired-AND of several scratchpads
+            model_errors++;
+        }
+    }
+    
+    return true;
+}
+
+int onewire_read(int pin, int pin_output) {
+    if (model_read_index < 0) {
+        return 0xFF;
+    }
+    
+    const model_device_t* device = &model_devices[model_read_index / 16];
+    const unsigned int byte = model_read_index % 16;
+    model_read_index++;
+    
+    // Reading during conversion returns previous value
+    return (byte < 9) ? device->scratchpad[byte] : 0xFF;
+}
+
+bool onewire_power(int pin, int pin_output) {
+    model_powered = true;
+    return true;
+}
+
+void onewire_depower(int pin, int pin_output) {
+    model_powered = false;
+}
+
+void onewire_search_start(onewire_search_t* search) {
+    memset(search, 0, sizeof(onewire_search_t));
+    model_searches++;
+}
+
+// Next present device in bus order, using last_discrepancy as cursor
+onewire_addr_t onewire_search_next(onewire_search_t* search, int pin, int pin_output) {
+    if (model_powered) {
+        model_errors++;
+    }
+    
+    while (search->last_discrepancy < MODEL_DEVICES) {
+        const model_device_t* device = &model_devices[search->last_discrepancy++];
+        if (device->present) {
+            return device->addr;
+        }
+    }
+    
+    return ONEWIRE_NONE;
+}
+
+static ds18b20_bus_t* bus_new() {
+    ds18b20_bus_t* ds18b20_bus = calloc(1, sizeof(ds18b20_bus_t));
+    ds18b20_bus->gpio = 4;
+    ds18b20_bus->gpio_output = -1;
+    ds18b20_bus->needs_scan = true;
+    
+    return ds18b20_bus;
+}
+
+// Advances time to end of running conversion and reads it, like temperature_task
+static void bus_finish(ds18b20_bus_t* ds18b20_bus) {
+    CHECK(ds18b20_bus->is_converting);
+    mock_ticks = ds18b20_bus->ready_tick;
+    ds18b20_bus_read(ds18b20_bus);
+}
+
+int main() {
+    model_init();
+    
+    // Three services on same bus. Shortest poll period of 10 s shares readings during 5 s
+    ds18b20_bus_t* ds18b20_bus = bus_new();
+    ds18b20_bus_add_sensor(ds18b20_bus, 1, 30);
+    ds18b20_bus_add_sensor(ds18b20_bus, 3, 10);
+    ds18b20_bus_add_sensor(ds18b20_bus, 2, 30);
+    CHECK(ds18b20_bus->sensor_count == 3);
+    CHECK(ds18b20_bus->max_age == MS_TO_TICKS(5000));
+    
+    // First request scans bus and starts one conversion for all sensors
+    float temperature_value = 0;
+    CHECK(!ds18b20_bus_request(ds18b20_bus, 1, &temperature_value));
+    CHECK(model_searches == 1);
+    CHECK(model_conversions == 1);
+    CHECK(ds18b20_bus->found_count == 3);
+    CHECK(model_powered);
+    
+    // Other services wait for the running conversion
+    mock_ticks += 10;
+    CHECK(!ds18b20_bus_request(ds18b20_bus, 2, &temperature_value));
+    CHECK(!ds18b20_bus_request(ds18b20_bus, 3, &temperature_value));
+    CHECK(model_conversions == 1);
+    
+    // Scratchpads are read after conversion time, never power on value. Serial number device is skipped
+    bus_finish(ds18b20_bus);
+    CHECK(!model_powered);
+    CHECK(ds18b20_bus_temperature(ds18b20_bus, 1) == 21.5f);
+    CHECK(ds18b20_bus_temperature(ds18b20_bus, 2) == -10.25f);
+    CHECK(ds18b20_bus_temperature(ds18b20_bus, 3) == 30.f);
+    CHECK(isnan(ds18b20_bus_temperature(ds18b20_bus, 0)));
+    CHECK(isnan(ds18b20_bus_temperature(ds18b20_bus, 4)));
+    
+    // Reading is shared without talking to the bus
+    mock_ticks += MS_TO_TICKS(1000);
+    CHECK(ds18b20_bus_request(ds18b20_bus, 2, &temperature_value) && temperature_value == -10.25f);
+    CHECK(ds18b20_bus_request(ds18b20_bus, 3, &temperature_value) && temperature_value == 30.f);
+    CHECK(model_conversions == 1);
+    
+    // Old reading starts a new conversion, with cached ROM list
+    model_devices[0].temperature = 22.f;
+    mock_ticks += ds18b20_bus->max_age;
+    CHECK(!ds18b20_bus_request(ds18b20_bus, 1, &temperature_value));
+    CHECK(isnan(ds18b20_bus_temperature(ds18b20_bus, 1)));
+    CHECK(model_conversions == 2);
+    CHECK(model_searches == 1);
+    bus_finish(ds18b20_bus);
+    CHECK(ds18b20_bus_temperature(ds18b20_bus, 1) == 22.f);
+    
+    // A lost sensor fails its reading, and ROM list is searched again in next request
+    model_devices[2].present = false;
+    mock_ticks += ds18b20_bus->max_age;
+    CHECK(!ds18b20_bus_request(ds18b20_bus, 1, &temperature_value));
+    bus_finish(ds18b20_bus);
+    CHECK(ds18b20_bus_temperature(ds18b20_bus, 1) == 22.f);
+    CHECK(isnan(ds18b20_bus_temperature(ds18b20_bus, 2)));
+    CHECK(ds18b20_bus->needs_scan);
+    CHECK(model_searches == 1);
+    
+    // Sensor indexes follow bus order
+    mock_ticks += ds18b20_bus->max_age;
+    CHECK(!ds18b20_bus_request(ds18b20_bus, 1, &temperature_value));
+    CHECK(model_searches == 2);
+    CHECK(ds18b20_bus->found_count == 2);
+    bus_finish(ds18b20_bus);
+    CHECK(ds18b20_bus_temperature(ds18b20_bus, 2) == 30.f);
+    CHECK(isnan(ds18b20_bus_temperature(ds18b20_bus, 3)));
+    CHECK(!ds18b20_bus->needs_scan);
+    
+    // Bus is searched again periodically, to find added sensors
+    model_devices[2].present = true;
+    mock_ticks += MS_TO_TICKS(DS18B20_BUS_RESCAN_PERIOD_MS);
+    CHECK(!ds18b20_bus_request(ds18b20_bus, 1, &temperature_value));
+    CHECK(model_searches == 3);
+    CHECK(ds18b20_bus->found_count == 3);
+    bus_finish(ds18b20_bus);
+    CHECK(ds18b20_bus_temperature(ds18b20_bus, 2) == -10.25f);
+    
+    // Empty bus returns error at once, without conversion, and it is searched again in next request
+    for (unsigned int i = 0; i < MODEL_DEVICES; i++) {
+        model_devices[i].present = false;
+    }
+    mock_ticks += ds18b20_bus->max_age;
+    const unsigned int conversions = model_conversions;
+    CHECK(ds18b20_bus_request(ds18b20_bus, 1, &temperature_value) && isnan(temperature_value));
+    CHECK(ds18b20_bus->needs_scan);
+    CHECK(ds18b20_bus_request(ds18b20_bus, 1, &temperature_value) && isnan(temperature_value));
+    CHECK(model_searches == 4);
+    CHECK(ds18b20_bus->found_count == 0);
+    CHECK(!ds18b20_bus->is_converting);
+    CHECK(model_conversions == conversions);
+    
+    CHECK(model_errors == 0);
+    
+    return HOST_TEST_END();
+}
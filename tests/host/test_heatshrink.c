@@ -0,0 +1,193 @@
+/*
+ * Host test of heatshrink decoder used for compressed OTA images
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ * Data is compressed with heatshrink encoder of libesphttpd, with same window
+ * and lookahead as 'heatshrink -e -w 10 -l 5', and decoded as OTA installer does:
+ * received chunks of any size are sunk, and output is polled into buffers of
+ * RECV_BUF_LEN bytes
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+
+// Decoder static configuration is included first, so encoder uses same one.
+// Internal names shared by decoder and encoder are renamed in encoder
+#include "../../libs/heatshrink/heatshrink_decoder.c"
+
+#define output_info                     encoder_output_info
+#define st_yield_literal                encoder_st_yield_literal
+#include "../../sdk/esp-open-rtos-rsf/extras/libesphttpd/libesphttpd/lib/heatshrink/heatshrink_encoder.c"
+#undef output_info
+#undef st_yield_literal
+
+#define RECV_BUF_LEN                    (1390)
+
+static size_t compress(const uint8_t* data, const size_t len, uint8_t* out, const size_t out_size) {
+    static heatshrink_encoder hse;
+    heatshrink_encoder_reset(&hse);
+    
+    size_t in = 0;
+    size_t out_len = 0;
+    while (in < len) {
+        size_t sunk = 0;
+        heatshrink_encoder_sink(&hse, (uint8_t*) &data[in], len - in, &sunk);
+        in += sunk;
+        
+        size_t polled;
+        do {
+            polled = 0;
+            heatshrink_encoder_poll(&hse, &out[out_len], out_size - out_len, &polled);
+            out_len += polled;
+        } while (polled > 0);
+    }
+    
+    while (heatshrink_encoder_finish(&hse) == HSER_FINISH_MORE) {
+        size_t polled = 0;
+        heatshrink_encoder_poll(&hse, &out[out_len], out_size - out_len, &polled);
+        out_len += polled;
+    }
+    
+    return out_len;
+}
+
+static unsigned int random_state = 1;
+
+static unsigned int test_random(const unsigned int max) {
+    random_state = (random_state * 1103515245) + 12345;
+    return ((random_state >> 16) % max) + 1;
+}
+
+// Returns decompressed size, or -1 with a decoder error
+static int decompress(const uint8_t* data, const size_t len, uint8_t* out, const size_t out_size) {
+    heatshrink_decoder hsd;
+    heatshrink_decoder_reset(&hsd);
+    
+    uint8_t out_buf[RECV_BUF_LEN];
+    size_t out_buf_len = 0;
+    size_t out_len = 0;
+    
+    void flush() {
+        if (out_len + out_buf_len <= out_size) {
+            memcpy(&out[out_len], out_buf, out_buf_len);
+        }
+        out_len += out_buf_len;
+        out_buf_len = 0;
+    }
+    
+    int poll() {
+        HSD_poll_res poll_res;
+        do {
+            size_t polled = 0;
+            poll_res = heatshrink_decoder_poll(&hsd, &out_buf[out_buf_len], RECV_BUF_LEN - out_buf_len, &polled);
+            if (poll_res < 0) {
+                return -1;
+            }
+            
+            out_buf_len += polled;
+            if (out_buf_len == RECV_BUF_LEN) {
+                flush();
+            }
+        } while (poll_res == HSDR_POLL_MORE);
+        
+        return 0;
+    }
+    
+    // Network chunks of random sizes
+    size_t in = 0;
+    while (in < len) {
+        size_t chunk = test_random(RECV_BUF_LEN);
+        if (chunk > len - in) {
+            chunk = len - in;
+        }
+        
+        const size_t chunk_end = in + chunk;
+        while (in < chunk_end) {
+            size_t sunk = 0;
+            if (heatshrink_decoder_sink(&hsd, (uint8_t*) &data[in], chunk_end - in, &sunk) < 0 || poll() < 0) {
+                return -1;
+            }
+            in += sunk;
+        }
+    }
+    
+    while (heatshrink_decoder_finish(&hsd) == HSDR_FINISH_MORE) {
+        if (poll() < 0) {
+            return -1;
+        }
+    }
+    
+    if (out_buf_len > 0) {
+        flush();
+    }
+    
+    return out_len;
+}
+
+static bool round_trip(const uint8_t* data, const size_t len, size_t* compressed_len) {
+    const size_t out_size = len + (len / 2) + 16;
+    uint8_t* compressed = malloc(out_size);
+    uint8_t* decompressed = malloc(len + 1);
+    
+    *compressed_len = compress(data, len, compressed, out_size);
+    const int decompressed_len = decompress(compressed, *compressed_len, decompressed, len);
+    const bool result = (decompressed_len == (int) len && memcmp(data, decompressed, len) == 0);
+    
+    free(compressed);
+    free(decompressed);
+    
+    return result;
+}
+
+int main() {
+    size_t compressed_len;
+    
+    // Edge cases
+    const uint8_t one_byte = 0xE9;
+    CHECK(round_trip(&one_byte, 0, &compressed_len));
+    CHECK(round_trip(&one_byte, 1, &compressed_len));
+    
+    // Erased flash padding, random data, and data longer than window with repeats
+    const size_t len = 64 * 1024;
+    uint8_t* data = malloc(len);
+    
+    memset(data, 0xFF, len);
+    CHECK(round_trip(data, len, &compressed_len) && compressed_len < len / 10);
+    
+    for (size_t i = 0; i < len; i++) {
+        data[i] = test_random(256) - 1;
+    }
+    CHECK(round_trip(data, len, &compressed_len));
+    
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (i % 3000 < 1500) ? data[i % 700] : "movi a2, 0x3ff00000\n"[i % 20];
+    }
+    CHECK(round_trip(data, len, &compressed_len) && compressed_len < len);
+    
+    // A real firmware image
+    FILE* image = fopen("../../HAA/HAA_Installer/fullhaaboot/fullrboot.bin", "rb");
+    if (image) {
+        const size_t image_len = fread(data, 1, len, image);
+        fclose(image);
+        
+        CHECK(round_trip(data, image_len, &compressed_len));
+        printf("fullrboot.bin: %zu bytes, %zu compressed\n", image_len, compressed_len);
+    }
+    
+    // Truncated stream decodes to a prefix of data, without errors
+    memset(data, 0x55, len);
+    uint8_t* compressed = malloc(len);
+    uint8_t* decompressed = malloc(len);
+    compressed_len = compress(data, 4096, compressed, len);
+    const int decompressed_len = decompress(compressed, compressed_len / 2, decompressed, len);
+    CHECK(decompressed_len >= 0 && decompressed_len < 4096 && memcmp(data, decompressed, decompressed_len) == 0);
+    
+    free(compressed);
+    free(decompressed);
+    free(data);
+    
+    return HOST_TEST_END();
+}
@@ -0,0 +1,155 @@
+/*
+ * Host test of MCP23017 and Shift Register outputs with a mock I2C bus
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "host_test.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "adv_i2c.h"
+
+#include "../../HAA/HAA_Main/main/mcp_outs.c"
+
+// Mock MCP23017: output latches, written with sequential register writes
+static uint8_t mock_olat[2] = { 0 };
+static unsigned int mock_i2c_writes = 0;
+static unsigned int mock_olata_torn = 0;
+
+int adv_i2c_slave_write(uint8_t bus, uint8_t slave_addr, const uint8_t* data, const size_t data_len, const uint8_t* buf, size_t buf_len) {
+    unsigned int reg = data[0] - 0x14;
+    for (size_t i = 0; i < buf_len && reg < 2; i++, reg++) {
+        mock_olat[reg] = buf[i];
+        sched_yield();
+    }
+    
+    mock_i2c_writes++;
+    
+    // Burst thread only outputs all its bits at once
+    if (mock_olat[0] != 0x00 && mock_olat[0] != 0xFF) {
+        mock_olata_torn++;
+    }
+    
+    return 0;
+}
+
+// Mock Shift Register: data sampled on clock rising edge, copied to outputs on latch rising edge
+#define SR_CLOCK                        (5)
+#define SR_DATA                         (6)
+#define SR_LATCH                        (7)
+
+static uint32_t mock_sr_shift = 0;
+static uint32_t mock_sr_outs = 0;
+static unsigned int mock_sr_bits = 0;
+static uint32_t mock_gpio[8] = { 0 };
+
+int gpio_set_level(int gpio, uint32_t level) {
+    if (level && !mock_gpio[gpio]) {
+        if (gpio == SR_CLOCK) {
+            mock_sr_shift |= mock_gpio[SR_DATA] << mock_sr_bits;
+            mock_sr_bits++;
+        } else if (gpio == SR_LATCH) {
+            mock_sr_outs = mock_sr_shift;
+            mock_sr_shift = 0;
+            mock_sr_bits = 0;
+        }
+    }
+    
+    mock_gpio[gpio] = level;
+    return 0;
+}
+
+static mcp23017_t mcp = {
+    .index = 1,
+    .bus = 0,
+    .addr = 0x20,
+    .latch_gpio = -1,
+    .len = 2,
+};
+
+#define BURST_ROUNDS                    (20000)
+
+static void* burst_thread(void* args) {
+    for (unsigned int round = 0; round < BURST_ROUNDS; round++) {
+        const bool value = round & 1;
+        for (unsigned int gpio = 0; gpio < 8; gpio++) {
+            mcp_set_out(&mcp, gpio, value, true);
+            sched_yield();
+        }
+        
+        mcp_write_outs(&mcp, true);
+    }
+    
+    return NULL;
+}
+
+static void* other_thread(void* args) {
+    for (unsigned int round = 0; round < BURST_ROUNDS; round++) {
+        mcp_set_out(&mcp, 8 + (round % 8), (round / 8) & 1, false);
+        mcp_write_outs(&mcp, false);
+    }
+    
+    return NULL;
+}
+
+int main() {
+    mcp_outs_init(&mcp, 2);
+    
+    // Write outside a burst only changes its out group
+    mcp_set_out(&mcp, 0, true, false);
+    mcp_write_outs(&mcp, false);
+    CHECK(mock_olat[0] == 0x01 && mock_olat[1] == 0x00 && mock_i2c_writes == 1);
+    
+    // Values set inside a burst are not written by other writes, and both groups go in one write when burst ends
+    mcp_set_out(&mcp, 1, true, true);
+    mcp_set_out(&mcp, 9, true, true);
+    mcp_set_out(&mcp, 0, false, true);
+    mcp_set_out(&mcp, 2, true, false);
+    mcp_write_outs(&mcp, false);
+    CHECK(mock_olat[0] == 0x05 && mock_olat[1] == 0x00 && mock_i2c_writes == 2);
+    mcp_write_outs(&mcp, true);
+    CHECK(mock_olat[0] == 0x06 && mock_olat[1] == 0x02 && mock_i2c_writes == 3);
+    mcp_write_outs(&mcp, true);
+    CHECK(mock_i2c_writes == 3);
+    
+    // Burst task and other task writing at same time: burst values are never output half built
+    mcp_set_out(&mcp, 1, false, false);
+    mcp_set_out(&mcp, 2, false, false);
+    mcp_write_outs(&mcp, false);
+    mock_olata_torn = 0;
+    
+    pthread_t burst, other;
+    pthread_create(&burst, NULL, burst_thread, NULL);
+    pthread_create(&other, NULL, other_thread, NULL);
+    pthread_join(burst, NULL);
+    pthread_join(other, NULL);
+    
+    CHECK(mock_olata_torn == 0);
+    CHECK(mock_olat[0] == mcp.outs[0] && mock_olat[1] == mcp.outs[1]);
+    CHECK(mcp.outs[0] == (((BURST_ROUNDS - 1) & 1) ? 0xFF : 0x00));
+    
+    // Shift Register: all bits shifted and latched once
+    mcp23017_t sr = {
+        .index = 2,
+        .bus = 100 + SR_CLOCK,
+        .addr = SR_DATA,
+        .latch_gpio = SR_LATCH,
+        .len = 12,
+    };
+    mcp_outs_init(&sr, (sr.len >> 3) + 1);
+    
+    mcp_set_out(&sr, 0, true, true);
+    mcp_set_out(&sr, 11, true, true);
+    mcp_set_out(&sr, 4, true, false);
+    mcp_write_outs(&sr, false);
+    CHECK(mock_sr_outs == 0x010);
+    mcp_write_outs(&sr, true);
+    CHECK(mock_sr_outs == 0x811);
+    
+    return HOST_TEST_END();
+}
@@ -0,0 +1,206 @@
+/*
+ * Host test of mDNS responder name compression, compressed name parsing and question matching
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <stdarg.h>
+
+#include "host_test.h"
+
+#include "../../libs/homekit-rsf/src/mdnsresponder.c"
+
+// Network and system functions are not used by tested code
+int adv_logger_printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int len = vprintf(format, args);
+    va_end(args);
+    return len;
+}
+
+uint32_t esp_random(void) { return 4; }
+TickType_t xTaskGetTickCount(void) { return 1000; }
+u16_t lwip_htons(u16_t n) { return (u16_t) ((n << 8) | (n >> 8)); }
+u32_t lwip_htonl(u32_t n) { return __builtin_bswap32(n); }
+char* ip4addr_ntoa_r(const ip4_addr_t* addr, char* buf, int buflen) { return buf; }
+err_t igmp_start(struct netif* netif) { return ERR_OK; }
+err_t igmp_joingroup_netif(struct netif* netif, const ip4_addr_t* groupaddr) { return ERR_OK; }
+struct pbuf* pbuf_alloc(pbuf_layer l, u16_t length, pbuf_type type) { return NULL; }
+u8_t pbuf_free(struct pbuf* p) { return 0; }
+struct udp_pcb* udp_new_ip_type(u8_t type) { return NULL; }
+err_t udp_bind(struct udp_pcb* pcb, const ip_addr_t* ipaddr, u16_t port) { return ERR_OK; }
+void udp_bind_netif(struct udp_pcb* pcb, const struct netif* netif) { }
+void udp_recv(struct udp_pcb* pcb, udp_recv_fn recv, void* recv_arg) { }
+err_t udp_sendto_if(struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* dst_ip, u16_t dst_port, struct netif* netif) { return ERR_OK; }
+TimerHandle_t rs_esp_timer_create(const uint32_t period_ms, const UBaseType_t auto_reload, void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction) { return NULL; }
+BaseType_t rs_esp_timer_change_period(TimerHandle_t xTimer, const uint32_t new_period_ms) { return pdPASS; }
+BaseType_t rs_esp_timer_change_period_forced(TimerHandle_t xTimer, const uint32_t new_period_ms) { return pdPASS; }
+BaseType_t rs_esp_timer_stop_forced(TimerHandle_t xTimer) { return pdPASS; }
+const ip_addr_t ip_addr_any = IPADDR4_INIT(IPADDR_ANY);
+struct ip_globals ip_data;
+struct netif* netif_default = NULL;
+
+// Expands a name of a received packet, checking every byte is inside it. Returns length of name at p, or 0 if malformed
+static int test_expand_name(u8_t* hdrP, u8_t* p, u8_t* limP, char* name) {
+    u8_t* startP = p;
+    int len = 0;
+    int hops = 0;
+    
+    name[0] = 0;
+    while (p < limP) {
+        u8_t n = *p++;
+        if ((n & 0xC0) == 0xC0) {
+            if (p >= limP || hops++ > 8) {
+                return 0;
+            }
+            if (len == 0) {
+                len = p + 1 - startP;
+            }
+            p = hdrP + (((n & 0x3F) << 8) | *p);
+            continue;
+        }
+        if (n == 0) {
+            return len ? len : p - startP;
+        }
+        if (p + n > limP) {
+            return 0;
+        }
+        strncat(name, (char*) p, n);
+        strcat(name, ".");
+        p += n;
+    }
+    
+    return 0;
+}
+
+static u8_t packet[256];
+
+int main() {
+    u8_t labels[64];
+    const int labels_len = mdns_str2labels("Dev._hap._tcp.local.", labels, sizeof(labels));
+    CHECK(labels_len == 21);
+    
+    // Name with a pointer to a previous name, in other case
+    int len = SIZEOF_DNS_HDR;
+    len += mdns_str2labels("_HAP._tcp.local.", &packet[len], 64);
+    const int name_offset = len;
+    memcpy(&packet[len], "\3dev\xC0\x0C", 6);
+    len += 6;
+    CHECK(mdns_labels_equal(packet, &packet[name_offset], &packet[len], labels));
+    
+    // Name cut by end of packet, and label beyond end of packet
+    CHECK(!mdns_labels_equal(packet, &packet[name_offset], &packet[len - 1], labels));
+    CHECK(!mdns_labels_equal(packet, &packet[name_offset], &packet[name_offset + 3], labels));
+    
+    // Pointer to itself, forward pointer, and pointer beyond end of packet
+    memcpy(&packet[len], "\3dev\xC0", 4);
+    packet[len + 4] = len + 4;
+    CHECK(!mdns_labels_equal(packet, &packet[len], &packet[len + 5], labels));
+    packet[len + 4] = len + 5;
+    CHECK(!mdns_labels_equal(packet, &packet[len], &packet[len + 6], labels));
+    memcpy(&packet[len], "\xC0\xF0", 2);
+    CHECK(!mdns_labels_equal(packet, &packet[len], &packet[len + 2], labels));
+    
+    // Chain of backward pointers longer than 8 hops
+    packet[len] = 0;
+    for (int i = 1; i <= 10; i++) {
+        packet[len + (i * 2)] = 0xC0;
+        packet[len + (i * 2) + 1] = len + ((i - 1) * 2);
+    }
+    const u8_t empty_name = 0;
+    CHECK(mdns_labels_equal(packet, &packet[len + 16], &packet[len + 22], &empty_name));
+    CHECK(!mdns_labels_equal(packet, &packet[len + 20], &packet[len + 22], &empty_name));
+    
+    // Response names are compressed, and expand to same names
+    gDictMutex = xSemaphoreCreateMutex();
+    CHECK(mdns_buffer_init(0) == 0);
+    
+    const ip4_addr_t addr4 = { 0 };
+    mdns_add_TXT("Dev._hap._tcp.local.", 4500, "\4sf=1");
+    mdns_add_A("Dev.local.", 4500, &addr4);
+    mdns_add_SRV("Dev._hap._tcp.local.", 4500, 5556, "Dev.local.");
+    mdns_add_PTR("_hap._tcp.local.", 4500, "Dev._hap._tcp.local.");
+    mdns_add_PTR("_services._dns-sd._udp.local.", 4500, "_hap._tcp.local.");
+    
+    struct netif netif;
+    memset(&netif, 0, sizeof(netif));
+    IP4_ADDR(ip_2_ip4(&netif.ip_addr), 192, 168, 1, 10);
+    
+    unsigned int wire_size = SIZEOF_DNS_HDR;
+    for (mdns_rsrc* rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+        wire_size += rsrcP->rWireSize;
+    }
+    
+    const u16_t resp_len = mdns_build_packet(&netif, MDNS_ALL_RECORDS, 0);
+    CHECK(resp_len > SIZEOF_DNS_HDR && resp_len < wire_size - 40);
+    
+    u8_t* limP = mdns_response + resp_len;
+    u8_t* p = mdns_response + SIZEOF_DNS_HDR;
+    unsigned int answers = 0;
+    for (mdns_rsrc* rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+        char name[kMaxQStr];
+        int name_len = test_expand_name(mdns_response, p, limP, name);
+        CHECK(name_len > 0 && strcasecmp(name, rsrcP->rData) == 0);
+        
+        // Every answer matches its own record as a known answer
+        u32_t known = 0;
+        u8_t* nextP = mdns_known_answer(mdns_response, p, limP, &known);
+        CHECK(nextP <= limP && known == MDNS_RSRC_BIT(rsrcP));
+        
+        p += name_len;
+        struct mdns_answer ans;
+        memcpy(&ans, p, SIZEOF_DNS_ANSWER);
+        p += SIZEOF_DNS_ANSWER;
+        
+        if (rsrcP->rType == DNS_RRTYPE_PTR || rsrcP->rType == DNS_RRTYPE_SRV) {
+            char target[kMaxQStr];
+            const int offset = (rsrcP->rType == DNS_RRTYPE_SRV) ? SIZEOF_DNS_RR_SRV : 0;
+            CHECK(test_expand_name(mdns_response, p + offset, limP, target) > 0);
+            CHECK(mdns_labels_equal(mdns_response, p + offset, p + htons(ans.len), mdns_rsrc_data(rsrcP) + offset));
+        }
+        
+        p += htons(ans.len);
+        CHECK(p == nextP);
+        answers++;
+    }
+    CHECK(p == limP && answers == 5);
+    
+    // Known answer with a pointer loop as name is skipped, without matching any record
+    u8_t* bad_answer = &mdns_response[resp_len];
+    memcpy(bad_answer, "\xC0\x00\x00\x0C\x00\x01\x00\x00\x11\x94\x00\x02\xC0\x00", 14);
+    bad_answer[1] = resp_len;
+    bad_answer[13] = resp_len + 12;
+    u32_t known = 0;
+    CHECK(mdns_known_answer(mdns_response, bad_answer, bad_answer + 14, &known) == bad_answer + 14 && known == 0);
+    
+    // Questions match record keys ignoring case, by type and hash
+    for (mdns_rsrc* rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+        CHECK(rsrcP->rKeyHash == mdns_hash(rsrcP->rData));
+    }
+    CHECK(mdns_hash("dEV._Hap._TCP.local.") == mdns_hash("Dev._hap._tcp.local."));
+    CHECK(mdns_hash("Dev._hap._tcp.local.") != mdns_hash("Dev._hap._udp.local."));
+    
+    mdns_rsrc* rsrcP = mdns_match("dEV._Hap._TCP.local.", DNS_RRTYPE_TXT);
+    CHECK(rsrcP && rsrcP->rType == DNS_RRTYPE_TXT && strcmp(rsrcP->rData, "Dev._hap._tcp.local.") == 0);
+    rsrcP = mdns_match("Dev._hap._tcp.local.", DNS_RRTYPE_ANY);
+    CHECK(rsrcP && (rsrcP->rType == DNS_RRTYPE_TXT || rsrcP->rType == DNS_RRTYPE_SRV));
+    rsrcP = mdns_match("DEV.LOCAL.", DNS_RRTYPE_A);
+    CHECK(rsrcP && rsrcP->rType == DNS_RRTYPE_A);
+    CHECK(mdns_match("Dev._hap._tcp.local.", DNS_RRTYPE_A) == NULL);
+    CHECK(mdns_match("Dev2.local.", DNS_RRTYPE_A) == NULL);
+    CHECK(mdns_match("Dev.local", DNS_RRTYPE_A) == NULL);
+    CHECK(mdns_match("_hap._tcp.local.", DNS_RRTYPE_PTR) != NULL);
+    
+    // Key is not compared when hash differs
+    rsrcP = mdns_match("DEV.LOCAL.", DNS_RRTYPE_A);
+    rsrcP->rKeyHash++;
+    CHECK(mdns_match("Dev.local.", DNS_RRTYPE_A) == NULL);
+    rsrcP->rKeyHash--;
+    CHECK(mdns_match("Dev.local.", DNS_RRTYPE_A) == rsrcP);
+    
+    printf("mDNS response: %u bytes, %u without compression\n", resp_len, wire_size);
+    
+    return HOST_TEST_END();
+}
@@ -0,0 +1,179 @@
+/*
+ * Host test of OTA flash writer and streamed hash, with a simulated HTTP link and flash
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ * Times are 1/10 of a real ESP8266 flash: 45 ms sector erase and 0.6 ms page write.
+ * Same image is written with writer task, and synchronously as when there is no
+ * memory for it, and both flash contents and hashes must be equal
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+
+#define SIM_IMAGE_SIZE                  (200 * 1024)
+#define SIM_ERASE_US                    (4500)
+#define SIM_PAGE_US                     (60)
+
+static uint8_t sim_flash[SIM_IMAGE_SIZE + 4096];
+static bool sim_task_create_fails = false;
+
+int adv_logger_printf(const char* format, ...) { return 0; }
+
+struct esp_partition { int unused; };
+static struct esp_partition sim_partition;
+
+struct esp_partition* get_partition(const unsigned int sector) {
+    return &sim_partition;
+}
+
+int esp_partition_erase_range(const struct esp_partition* partition, size_t offset, size_t size) {
+    usleep(SIM_ERASE_US);
+    memset(&sim_flash[offset], 0xFF, size);
+    return 0;
+}
+
+// Like NOR flash, bits can only be cleared
+int esp_partition_write(const struct esp_partition* partition, size_t dst_offset, const void* src, size_t size) {
+    usleep(SIM_PAGE_US * ((size + 255) / 256));
+    for (size_t i = 0; i < size; i++) {
+        sim_flash[dst_offset + i] &= ((const uint8_t*) src)[i];
+    }
+    return 0;
+}
+
+static void* sim_task(void* args) {
+    void (**task)(void*) = args;
+    (*task)(NULL);
+    return NULL;
+}
+
+int xTaskCreate(void* task, const char* name, int stack, void* args, int priority, TaskHandle_t* handle) {
+    static void* task_function;
+    static pthread_t thread;
+    
+    if (sim_task_create_fails) {
+        return pdFAIL;
+    }
+    
+    task_function = task;
+    pthread_create(&thread, NULL, sim_task, &task_function);
+    pthread_detach(thread);
+    *handle = (TaskHandle_t) &thread;
+    
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    pthread_exit(NULL);
+}
+
+#include "../../external_libs/wolfssl/wolfssl-3.13.0-stable/wolfcrypt/src/sha512.c"
+#include "../../HAA/HAA_Installer/main/ota_flash.c"
+
+static inline uint8_t sim_image_byte(const int offset) {
+    return (uint8_t) ((offset * 7) ^ (offset >> 8));
+}
+
+// Downloads image at given link speed, and returns time spent in ms
+static unsigned int sim_download(const unsigned int link_kbps, uint8_t* first_byte) {
+    memset(sim_flash, 0, sizeof(sim_flash));
+    
+    const uint64_t start_ns = host_test_now_ns();
+    char* buffer = ota_flash_pipeline_start(0x2000, 0, first_byte);
+    CHECK(buffer != NULL);
+    
+    int error = 0;
+    for (int offset = 0; offset < SIM_IMAGE_SIZE && error == 0; offset += RECV_BUF_LEN) {
+        int len = SIM_IMAGE_SIZE - offset;
+        if (len > RECV_BUF_LEN) {
+            len = RECV_BUF_LEN;
+        }
+        
+        usleep((len * 1000) / link_kbps);
+        for (int i = 0; i < len; i++) {
+            buffer[i] = sim_image_byte(offset + i);
+        }
+        
+        error = ota_flash_pipeline_write(&buffer, offset, len, SIM_IMAGE_SIZE);
+    }
+    
+    CHECK(ota_flash_pipeline_stop(buffer) == 0 && error == 0);
+    
+    return (host_test_now_ns() - start_ns) / 1000000;
+}
+
+// Hash of whole image, as read back from flash
+static void sim_image_hash(uint8_t* hash) {
+    Sha384 sha;
+    wc_InitSha384(&sha);
+    for (int i = 0; i < SIM_IMAGE_SIZE; i++) {
+        const uint8_t data = sim_image_byte(i);
+        wc_Sha384Update(&sha, &data, 1);
+    }
+    wc_Sha384Final(&sha, hash);
+}
+
+static bool sim_flash_is_image(const uint8_t first_byte) {
+    if (first_byte != sim_image_byte(0) || sim_flash[0] != 0xFF) {
+        return false;
+    }
+    
+    for (int i = 1; i < SIM_IMAGE_SIZE; i++) {
+        if (sim_flash[i] != sim_image_byte(i)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+int main() {
+    uint8_t image_hash[HASHSIZE];
+    uint8_t hash[HASHSIZE];
+    sim_image_hash(image_hash);
+    
+    // Link speeds are 10 times real ones, as flash times
+    const unsigned int links_kbps[] = { 250, 1000 };
+    
+    for (unsigned int i = 0; i < sizeof(links_kbps) / sizeof(links_kbps[0]); i++) {
+        uint8_t first_byte = 0;
+        
+        sim_task_create_fails = false;
+        const unsigned int pipelined_ms = sim_download(links_kbps[i], &first_byte);
+        CHECK(sim_flash_is_image(first_byte));
+        CHECK(ota_flash_stream_hash_final(0x2000, SIM_IMAGE_SIZE, hash) && memcmp(hash, image_hash, HASHSIZE) == 0);
+        
+        first_byte = 0;
+        sim_task_create_fails = true;
+        const unsigned int sync_ms = sim_download(links_kbps[i], &first_byte);
+        CHECK(sim_flash_is_image(first_byte));
+        CHECK(ota_flash_stream_hash_final(0x2000, SIM_IMAGE_SIZE, hash) && memcmp(hash, image_hash, HASHSIZE) == 0);
+        
+        // Streamed hash is only used once
+        CHECK(!ota_flash_stream_hash_final(0x2000, SIM_IMAGE_SIZE, hash));
+        
+        CHECK(pipelined_ms < sync_ms);
+        printf("%u KB image at %u KB/s: %u ms synchronously, %u ms with writer task\n",
+               SIM_IMAGE_SIZE / 1024, links_kbps[i], sync_ms, pipelined_ms);
+    }
+    
+    // A range downloaded again after a failure invalidates streamed hash, so image is read back from flash
+    uint8_t first_byte = 0;
+    sim_task_create_fails = false;
+    char* buffer = ota_flash_pipeline_start(0x2000, 0, &first_byte);
+    memset(buffer, 1, RECV_BUF_LEN);
+    CHECK(ota_flash_pipeline_write(&buffer, 0, RECV_BUF_LEN, SIM_IMAGE_SIZE) == 0);
+    memset(buffer, 2, RECV_BUF_LEN);
+    CHECK(ota_flash_pipeline_write(&buffer, RECV_BUF_LEN, RECV_BUF_LEN, SIM_IMAGE_SIZE) == 0);
+    CHECK(ota_flash_pipeline_write(&buffer, RECV_BUF_LEN, RECV_BUF_LEN, SIM_IMAGE_SIZE) == 0);
+    CHECK(ota_flash_pipeline_stop(buffer) == 0);
+    CHECK(!ota_flash_stream_hash_final(0x2000, 3 * RECV_BUF_LEN, hash));
+    
+    return HOST_TEST_END();
+}
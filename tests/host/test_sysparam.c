@@ -0,0 +1,136 @@
+/*
+ * Host test of sysparam compaction over a RAM backed flash
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "spiflash.h"
+#include "flashchip.h"
+
+// Two regions of one sector, between other sectors, as base address 0 means not initialized,
+// and a read can go past region end
+#define SIM_SECTORS                     (2)
+#define SIM_BASE                        (SPI_FLASH_SECTOR_SIZE)
+
+static uint8_t sim_flash[SIM_BASE + ((SIM_SECTORS + 1) * SPI_FLASH_SECTOR_SIZE)];
+
+sdk_flashchip_t sdk_flashchip = {
+    .sector_size = SPI_FLASH_SECTOR_SIZE,
+};
+
+bool spiflash_read(uint32_t addr, uint8_t* buf, uint32_t size) {
+    if (addr + size > sizeof(sim_flash)) {
+        return false;
+    }
+    
+    memcpy(buf, &sim_flash[addr], size);
+    return true;
+}
+
+// Like NOR flash, bits can only be cleared
+bool spiflash_write(uint32_t addr, uint8_t* buf, uint32_t size) {
+    if (addr + size > sizeof(sim_flash)) {
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < size; i++) {
+        sim_flash[addr + i] &= buf[i];
+    }
+    return true;
+}
+
+bool spiflash_erase_sector(uint32_t addr) {
+    if (addr % SPI_FLASH_SECTOR_SIZE || addr >= sizeof(sim_flash)) {
+        return false;
+    }
+    
+    memset(&sim_flash[addr], 0xFF, SPI_FLASH_SECTOR_SIZE);
+    return true;
+}
+
+#include "../../sdk/esp-open-rtos-rsf/core/sysparam.c"
+
+static bool check_string(const char* key, const char* expected) {
+    char* value = NULL;
+    const sysparam_status_t status = sysparam_get_string(key, &value);
+    const bool result = (status == SYSPARAM_OK && strcmp(value, expected) == 0);
+    free(value);
+    return result;
+}
+
+static size_t free_space() {
+    return _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr;
+}
+
+int main() {
+    memset(sim_flash, 0, sizeof(sim_flash));
+    CHECK(sysparam_create_area(SIM_BASE, SIM_SECTORS, true) == SYSPARAM_OK);
+    CHECK(sysparam_init(SIM_BASE, 0) == SYSPARAM_OK);
+    
+    // Rewrites of same keys fill region, and are compacted when needed
+    char key[8];
+    char value[32];
+    for (unsigned int i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "k%u", i % 10);
+        snprintf(value, sizeof(value), "value %u", i);
+        CHECK(sysparam_set_string(key, value) == SYSPARAM_OK);
+    }
+    for (unsigned int i = 990; i < 1000; i++) {
+        snprintf(key, sizeof(key), "k%u", i % 10);
+        snprintf(value, sizeof(value), "value %u", i);
+        CHECK(check_string(key, value));
+    }
+    
+    // Key without value is dropped when compacting. When compacting is forced by a previous inconsistency,
+    // key must be written again, and its old value must not be deleted from the now stale region
+    CHECK(sysparam_set_string("lonely", "first") == SYSPARAM_OK);
+    CHECK(sysparam_erase("lonely") == SYSPARAM_OK);
+    CHECK(sysparam_set_int32("counter", 1) == SYSPARAM_OK);
+    
+    const uint32_t old_base = _sysparam_info.cur_base;
+    uint8_t old_region[SPI_FLASH_SECTOR_SIZE];
+    memcpy(old_region, &sim_flash[old_base], sizeof(old_region));
+    
+    _sysparam_info.force_compact = true;
+    CHECK(sysparam_set_string("lonely", "again") == SYSPARAM_OK);
+    CHECK(_sysparam_info.cur_base != old_base && !_sysparam_info.force_compact);
+    CHECK(memcmp(&old_region[REGION_HEADER_SIZE], &sim_flash[old_base + REGION_HEADER_SIZE], sizeof(old_region) - REGION_HEADER_SIZE) == 0);
+    CHECK(check_string("lonely", "again"));
+    
+    const uint32_t counter_base = _sysparam_info.cur_base;
+    memcpy(old_region, &sim_flash[counter_base], sizeof(old_region));
+    
+    _sysparam_info.force_compact = true;
+    CHECK(sysparam_set_int32("counter", 2) == SYSPARAM_OK);
+    CHECK(memcmp(&old_region[REGION_HEADER_SIZE], &sim_flash[counter_base + REGION_HEADER_SIZE], sizeof(old_region) - REGION_HEADER_SIZE) == 0);
+    int32_t counter = 0;
+    CHECK(sysparam_get_int32("counter", &counter) == SYSPARAM_OK && counter == 2);
+    
+    // A value bigger than region, even after compacting, fails without losing anything
+    const size_t big_len = free_space() + 64;
+    char* big = malloc(big_len + 1);
+    memset(big, 'x', big_len);
+    big[big_len] = 0;
+    CHECK(sysparam_set_string("big", big) == SYSPARAM_ERR_FULL);
+    _sysparam_info.force_compact = true;
+    CHECK(sysparam_set_string("big", big) == SYSPARAM_ERR_FULL);
+    CHECK(_sysparam_info.end_addr <= _sysparam_info.cur_base + _sysparam_info.region_size);
+    free(big);
+    
+    // Everything is found again from flash, without index in RAM
+    CHECK(sysparam_init(SIM_BASE, 0) == SYSPARAM_OK);
+    CHECK(check_string("lonely", "again"));
+    CHECK(sysparam_get_int32("counter", &counter) == SYSPARAM_OK && counter == 2);
+    for (unsigned int i = 990; i < 1000; i++) {
+        snprintf(key, sizeof(key), "k%u", i % 10);
+        snprintf(value, sizeof(value), "value %u", i);
+        CHECK(check_string(key, value));
+    }
+    
+    return HOST_TEST_END();
+}
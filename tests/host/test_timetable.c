@@ -0,0 +1,114 @@
+/*
+ * Host test of timetable actions next run time, with month rollover and DST changes
+ *
+ * Part of Home Accessory Architect (HAA). Licensed under the terms in LICENSE
+ *
+ */
+
+#include <stdlib.h>
+
+#include "host_test.h"
+
+#include "../../HAA/HAA_Main/main/timetable.c"
+
+static time_t local_time(const int year, const int mon, const int mday, const int hour, const int min, const int isdst) {
+    struct tm tm = {
+        .tm_year = year - 1900,
+        .tm_mon = mon,
+        .tm_mday = mday,
+        .tm_hour = hour,
+        .tm_min = min,
+        .tm_isdst = isdst,
+    };
+    
+    return mktime(&tm);
+}
+
+static timetable_action_t timetable_action(const int mon, const int mday, const int hour, const int min, const int wday) {
+    timetable_action_t timetable_action = {
+        .mon = mon,
+        .mday = mday,
+        .hour = hour,
+        .min = min,
+        .wday = wday,
+    };
+    
+    return timetable_action;
+}
+
+int main() {
+    // Central European Time: DST from last Sunday of March 02:00 to last Sunday of October 03:00
+    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset();
+    
+    // Every minute, next is always at start of next minute
+    timetable_action_t every_minute = timetable_action(ALL_MONS, ALL_MDAYS, ALL_HOURS, ALL_MINS, ALL_WDAYS);
+    CHECK(timetable_action_next_time(&every_minute, local_time(2026, 5, 10, 12, 0, -1)) == local_time(2026, 5, 10, 12, 1, -1));
+    CHECK(timetable_action_next_time(&every_minute, local_time(2026, 5, 10, 12, 0, -1) + 59) == local_time(2026, 5, 10, 12, 1, -1));
+    CHECK(timetable_action_next_time(&every_minute, local_time(2026, 5, 10, 23, 59, -1)) == local_time(2026, 5, 11, 0, 0, -1));
+    
+    // Hourly at minute 15
+    timetable_action_t hourly = timetable_action(ALL_MONS, ALL_MDAYS, ALL_HOURS, 15, ALL_WDAYS);
+    CHECK(timetable_action_next_time(&hourly, local_time(2026, 5, 10, 12, 14, -1)) == local_time(2026, 5, 10, 12, 15, -1));
+    CHECK(timetable_action_next_time(&hourly, local_time(2026, 5, 10, 12, 15, -1)) == local_time(2026, 5, 10, 13, 15, -1));
+    CHECK(timetable_action_next_time(&hourly, local_time(2026, 5, 10, 23, 30, -1)) == local_time(2026, 5, 11, 0, 15, -1));
+    
+    // Daily at 07:30
+    timetable_action_t daily = timetable_action(ALL_MONS, ALL_MDAYS, 7, 30, ALL_WDAYS);
+    CHECK(timetable_action_next_time(&daily, local_time(2026, 5, 10, 6, 0, -1)) == local_time(2026, 5, 10, 7, 30, -1));
+    CHECK(timetable_action_next_time(&daily, local_time(2026, 5, 10, 7, 30, -1)) == local_time(2026, 5, 11, 7, 30, -1));
+    CHECK(timetable_action_next_time(&daily, local_time(2026, 5, 30, 8, 0, -1)) == local_time(2026, 6, 1, 7, 30, -1));
+    
+    // Every hour of 18h, at any minute
+    timetable_action_t hour_only = timetable_action(ALL_MONS, ALL_MDAYS, 18, ALL_MINS, ALL_WDAYS);
+    CHECK(timetable_action_next_time(&hour_only, local_time(2026, 5, 10, 17, 0, -1)) == local_time(2026, 5, 10, 18, 0, -1));
+    CHECK(timetable_action_next_time(&hour_only, local_time(2026, 5, 10, 18, 20, -1)) == local_time(2026, 5, 10, 18, 21, -1));
+    CHECK(timetable_action_next_time(&hour_only, local_time(2026, 5, 10, 18, 59, -1)) == local_time(2026, 5, 11, 18, 0, -1));
+    
+    // Weekday: Mondays at 09:00. 2026-06-10 is Wednesday
+    timetable_action_t weekly = timetable_action(ALL_MONS, ALL_MDAYS, 9, 0, 1);
+    CHECK(timetable_action_next_time(&weekly, local_time(2026, 5, 10, 12, 0, -1)) == local_time(2026, 5, 15, 9, 0, -1));
+    
+    // Month rollover: day 31 skips 30 days months
+    timetable_action_t monthly = timetable_action(ALL_MONS, 31, 0, 0, ALL_WDAYS);
+    CHECK(timetable_action_next_time(&monthly, local_time(2026, 3, 1, 0, 0, -1)) == local_time(2026, 4, 31, 0, 0, -1));
+    CHECK(timetable_action_next_time(&monthly, local_time(2026, 4, 31, 0, 0, -1)) == local_time(2026, 6, 31, 0, 0, -1));
+    
+    // Year rollover
+    CHECK(timetable_action_next_time(&monthly, local_time(2026, 11, 31, 0, 0, -1)) == local_time(2027, 0, 31, 0, 0, -1));
+    CHECK(timetable_action_next_time(&daily, local_time(2026, 11, 31, 23, 0, -1)) == local_time(2027, 0, 1, 7, 30, -1));
+    
+    // February 29th only in leap years
+    timetable_action_t leap_day = timetable_action(1, 29, 12, 0, ALL_WDAYS);
+    CHECK(timetable_action_next_time(&leap_day, local_time(2026, 5, 10, 12, 0, -1)) == local_time(2028, 1, 29, 12, 0, -1));
+    
+    // February 29th in a Tuesday: next in 2028 is Tuesday
+    timetable_action_t leap_day_tuesday = timetable_action(1, 29, 12, 0, 2);
+    CHECK(timetable_action_next_time(&leap_day_tuesday, local_time(2026, 5, 10, 12, 0, -1)) == local_time(2028, 1, 29, 12, 0, -1));
+    
+    // February 30th never happens
+    timetable_action_t never = timetable_action(1, 30, 12, 0, ALL_WDAYS);
+    CHECK(timetable_action_next_time(&never, local_time(2026, 5, 10, 12, 0, -1)) == TIMETABLE_NEVER);
+    
+    // DST starts 2026-03-29: 02:00 CET jumps to 03:00 CEST, so 02:30 runs at 03:30 CEST, only once
+    timetable_action_t gap = timetable_action(ALL_MONS, ALL_MDAYS, 2, 30, ALL_WDAYS);
+    const time_t gap_time = timetable_action_next_time(&gap, local_time(2026, 2, 29, 1, 0, 0));
+    CHECK(gap_time == local_time(2026, 2, 29, 1, 0, 0) + 3600 + 1800);
+    CHECK(timetable_action_next_time(&gap, gap_time) == local_time(2026, 2, 30, 2, 30, -1));
+    
+    // Every minute is not repeated nor lost around DST start
+    CHECK(timetable_action_next_time(&every_minute, local_time(2026, 2, 29, 1, 59, 0)) == local_time(2026, 2, 29, 1, 59, 0) + 60);
+    
+    // DST ends 2026-10-25: 03:00 CEST goes back to 02:00 CET, so 02:30 runs once, at its first occurrence
+    const time_t repeated_time = timetable_action_next_time(&gap, local_time(2026, 9, 25, 1, 0, 1));
+    CHECK(repeated_time == local_time(2026, 9, 25, 2, 30, 1));
+    CHECK(timetable_action_next_time(&gap, repeated_time) == local_time(2026, 9, 26, 2, 30, -1));
+    
+    // Every minute runs in both occurrences of repeated hour
+    time_t minute_time = local_time(2026, 9, 25, 2, 59, 1);
+    minute_time = timetable_action_next_time(&every_minute, minute_time);
+    CHECK(minute_time == local_time(2026, 9, 25, 2, 0, 0));
+    CHECK(timetable_action_next_time(&every_minute, minute_time) == minute_time + 60);
+    
+    return HOST_TEST_END();
+}